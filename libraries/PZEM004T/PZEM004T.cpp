@@ -1,31 +1,23 @@
 #include "PZEM004T.h"
 
-#define PZEM_VOLTAGE (uint8_t)0xB0
 #define RESP_VOLTAGE (uint8_t)0xA0
-
-#define PZEM_CURRENT (uint8_t)0xB1
 #define RESP_CURRENT (uint8_t)0xA1
-
-#define PZEM_POWER   (uint8_t)0xB2
 #define RESP_POWER   (uint8_t)0xA2
-
-#define PZEM_ENERGY  (uint8_t)0xB3
 #define RESP_ENERGY  (uint8_t)0xA3
-
-#define PZEM_SET_ADDRESS (uint8_t)0xB4
 #define RESP_SET_ADDRESS (uint8_t)0xA4
-
-#define PZEM_POWER_ALARM (uint8_t)0xB5
 #define RESP_POWER_ALARM (uint8_t)0xA5
 
+// Each reply code is its request code less 0x10
+#define PZEM_RESPONSE(cmd) (uint8_t)((cmd) - 0x10)
+// Accept a reply to any request
+#define PZEM_ANY_RESPONSE (uint8_t)0
+
 #define RESPONSE_SIZE sizeof(PZEMCommand)
 #define RESPONSE_DATA_SIZE RESPONSE_SIZE - 2
 
 #define PZEM_BAUD_RATE 9600
 #define PZEM_DEFAULT_READ_TIMEOUT 1000
 
-#define PZEM_ERROR_VALUE -1.0
-
 
 PZEM004T::PZEM004T(uint8_t receivePin, uint8_t transmitPin)
 {
@@ -34,6 +26,7 @@ PZEM004T::PZEM004T(uint8_t receivePin, uint8_t transmitPin)
     this->serial = port;
     this->_readTimeOut = PZEM_DEFAULT_READ_TIMEOUT;
     this->_isSoft = true;
+    this->_status = PZEM_IDLE;
 }
 
 PZEM004T::PZEM004T(HardwareSerial *port)
@@ -42,6 +35,7 @@ PZEM004T::PZEM004T(HardwareSerial *port)
     this->serial = port;
     this->_readTimeOut = PZEM_DEFAULT_READ_TIMEOUT;
     this->_isSoft = false;
+    this->_status = PZEM_IDLE;
 }
 
 PZEM004T::~PZEM004T()
@@ -63,7 +57,7 @@ float PZEM004T::voltage(const IPAddress &addr)
     if(!recieve(RESP_VOLTAGE, data))
         return PZEM_ERROR_VALUE;
 
-    return (data[0] << 8) + data[1] + (data[2] / 10.0);
+    return decode(RESP_VOLTAGE, data);
 }
 
 float PZEM004T::current(const IPAddress &addr)
@@ -74,7 +68,7 @@ float PZEM004T::current(const IPAddress &addr)
     if(!recieve(RESP_CURRENT, data))
         return PZEM_ERROR_VALUE;
 
-    return (data[0] << 8) + data[1] + (data[2] / 100.0);
+    return decode(RESP_CURRENT, data);
 }
 
 float PZEM004T::power(const IPAddress &addr)
@@ -85,7 +79,7 @@ float PZEM004T::power(const IPAddress &addr)
     if(!recieve(RESP_POWER, data))
         return PZEM_ERROR_VALUE;
 
-    return (data[0] << 8) + data[1];
+    return decode(RESP_POWER, data);
 }
 
 float PZEM004T::energy(const IPAddress &addr)
@@ -96,7 +90,7 @@ float PZEM004T::energy(const IPAddress &addr)
     if(!recieve(RESP_ENERGY, data))
         return PZEM_ERROR_VALUE;
 
-    return ((uint32_t)data[0] << 16) + ((uint16_t)data[1] << 8) + data[2];
+    return decode(RESP_ENERGY, data);
 }
 
 bool PZEM004T::setAddress(const IPAddress &newAddr)
@@ -111,63 +105,159 @@ bool PZEM004T::setPowerAlarm(const IPAddress &addr, uint8_t threshold)
     return recieve(RESP_POWER_ALARM);
 }
 
-void PZEM004T::send(const IPAddress &addr, uint8_t cmd, uint8_t data)
+bool PZEM004T::readAll(const IPAddress &addr, PZEMReading &reading)
 {
-    PZEMCommand pzem;
+    PZEMCommand pzem[4];
+    float *fields[4] = {&reading.voltage, &reading.current, &reading.power, &reading.energy};
+
+    for(uint8_t i=0; i<4; i++)
+    {
+        command(pzem[i], addr, PZEM_VOLTAGE + i, 0);
+        *fields[i] = PZEM_ERROR_VALUE;
+    }
+    reading.frequency = PZEM_ERROR_VALUE;
+    reading.powerFactor = PZEM_ERROR_VALUE;
+    reading.valid = 0;
+
+    while(serial->available())
+        serial->read();
+
+    serial->write((uint8_t*)pzem, sizeof(pzem));
+
+    // The whole exchange shares one read timeout
+    expect(PZEM_ANY_RESPONSE);
+    while(reading.valid != PZEM_VALID_ALL)
+    {
+        uint8_t status = poll();
+        if(status == PZEM_BUSY)
+        {
+            yield();
+            continue;
+        }
+        if(status == PZEM_TIMEOUT)
+            break;
+
+        uint8_t field = _rx[0] - RESP_VOLTAGE;
+        if(status == PZEM_DONE && field < 4)
+        {
+            *fields[field] = decode(_rx[0], _rx + 1);
+            reading.valid |= 1 << field;
+        }
+        _rxLen = 0;
+        _status = PZEM_BUSY;
+    }
+    _status = PZEM_IDLE;
 
+    return reading.valid == PZEM_VALID_ALL;
+}
+
+void PZEM004T::command(PZEMCommand &pzem, const IPAddress &addr, uint8_t cmd, uint8_t data)
+{
     pzem.command = cmd;
     for(int i=0; i<sizeof(pzem.addr); i++)
         pzem.addr[i] = addr[i];
     pzem.data = data;
 
-    uint8_t *bytes = (uint8_t*)&pzem;
-    pzem.crc = crc(bytes, sizeof(pzem) - 1);
+    pzem.crc = crc((uint8_t*)&pzem, sizeof(pzem) - 1);
+}
+
+void PZEM004T::send(const IPAddress &addr, uint8_t cmd, uint8_t data)
+{
+    PZEMCommand pzem;
+    command(pzem, addr, cmd, data);
 
     while(serial->available())
         serial->read();
 
-    serial->write(bytes, sizeof(pzem));
+    serial->write((uint8_t*)&pzem, sizeof(pzem));
 }
 
-bool PZEM004T::recieve(uint8_t resp, uint8_t *data)
+void PZEM004T::begin(const IPAddress &addr, uint8_t cmd, uint8_t data)
 {
-    uint8_t buffer[RESPONSE_SIZE];
+    send(addr, cmd, data);
+    expect(PZEM_RESPONSE(cmd));
+}
 
+void PZEM004T::expect(uint8_t resp)
+{
     if(_isSoft)
         ((SoftwareSerial *)serial)->listen();
 
-    unsigned long startTime = millis();
-    uint8_t len = 0;
-    while((len < RESPONSE_SIZE) && (millis() - startTime < _readTimeOut))
+    _expect = resp;
+    _rxLen = 0;
+    _sentAt = millis();
+    _status = PZEM_BUSY;
+}
+
+uint8_t PZEM004T::poll()
+{
+    if(_status != PZEM_BUSY)
+        return _status;
+
+    while(serial->available() > 0)
     {
-        if(serial->available() > 0)
+        uint8_t c = (uint8_t)serial->read();
+        if(!c && !_rxLen)
+            continue; // skip 0 at startup
+        _rx[_rxLen++] = c;
+        if(_rxLen == RESPONSE_SIZE)
         {
-            uint8_t c = (uint8_t)serial->read();
-            if(!c && !len)
-                continue; // skip 0 at startup
-            buffer[len++] = c;
+            if(_rx[6] != crc(_rx, RESPONSE_SIZE - 1) || (_expect != PZEM_ANY_RESPONSE && _rx[0] != _expect))
+                _status = PZEM_ERROR;
+            else
+                _status = PZEM_DONE;
+            return _status;
         }
-        yield();	// do background netw tasks while blocked for IO (prevents ESP watchdog trigger)
     }
 
-    if(len != RESPONSE_SIZE)
-        return false;
+    if(millis() - _sentAt >= _readTimeOut)
+        _status = PZEM_TIMEOUT;
+    return _status;
+}
 
-    if(buffer[6] != crc(buffer, len - 1))
-        return false;
+float PZEM004T::value()
+{
+    if(_status != PZEM_DONE)
+        return PZEM_ERROR_VALUE;
+    return decode(_rx[0], _rx + 1);
+}
 
-    if(buffer[0] != resp)
+bool PZEM004T::recieve(uint8_t resp, uint8_t *data)
+{
+    expect(resp);
+    while(poll() == PZEM_BUSY)
+        yield();	// do background netw tasks while blocked for IO (prevents ESP watchdog trigger)
+
+    if(_status != PZEM_DONE)
         return false;
 
     if(data)
     {
         for(int i=0; i<RESPONSE_DATA_SIZE; i++)
-            data[i] = buffer[1 + i];
+            data[i] = _rx[1 + i];
     }
 
     return true;
 }
 
+float PZEM004T::decode(uint8_t resp, const uint8_t *data)
+{
+    switch(resp)
+    {
+    case RESP_VOLTAGE:
+        return (data[0] << 8) + data[1] + (data[2] / 10.0);
+    case RESP_CURRENT:
+        return (data[0] << 8) + data[1] + (data[2] / 100.0);
+    case RESP_POWER:
+        return (data[0] << 8) + data[1];
+    case RESP_ENERGY:
+        return ((uint32_t)data[0] << 16) + ((uint16_t)data[1] << 8) + data[2];
+    default:
+        // Replies to settings carry no reading
+        return 0;
+    }
+}
+
 uint8_t PZEM004T::crc(uint8_t *data, uint8_t sz)
 {
     uint16_t crc = 0;
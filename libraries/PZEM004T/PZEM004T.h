@@ -10,6 +10,22 @@
 #include <SoftwareSerial.h>
 #include <IPAddress.h>
 
+#define PZEM_VOLTAGE (uint8_t)0xB0
+#define PZEM_CURRENT (uint8_t)0xB1
+#define PZEM_POWER   (uint8_t)0xB2
+#define PZEM_ENERGY  (uint8_t)0xB3
+#define PZEM_SET_ADDRESS (uint8_t)0xB4
+#define PZEM_POWER_ALARM (uint8_t)0xB5
+
+#define PZEM_ERROR_VALUE -1.0
+
+// State of a request started with begin()
+#define PZEM_IDLE    0
+#define PZEM_BUSY    1
+#define PZEM_DONE    2
+#define PZEM_TIMEOUT 3
+#define PZEM_ERROR   4
+
 struct PZEMCommand {
     uint8_t command;
     uint8_t addr[4];
@@ -17,6 +33,26 @@ struct PZEMCommand {
     uint8_t crc;
 };
 
+// Which fields of a PZEMReading were read
+#define PZEM_VALID_VOLTAGE 0x01
+#define PZEM_VALID_CURRENT 0x02
+#define PZEM_VALID_POWER   0x04
+#define PZEM_VALID_ENERGY  0x08
+#define PZEM_VALID_ALL     0x0F
+// Only given by the Modbus meters, see PZEMModbus
+#define PZEM_VALID_FREQUENCY    0x10
+#define PZEM_VALID_POWER_FACTOR 0x20
+
+struct PZEMReading {
+    float voltage;
+    float current;
+    float power;
+    float energy;
+    float frequency;
+    float powerFactor;
+    uint8_t valid;
+};
+
 class PZEM004T
 {
 public:
@@ -26,23 +62,46 @@ public:
 
     void setReadTimeout(unsigned long msec);
     unsigned long readTimeout() {return _readTimeOut;}
+    // SoftwareSerial ports receive one at a time, see listen()
+    bool isSoft() {return _isSoft;}
 
     float voltage(const IPAddress &addr);
     float current(const IPAddress &addr);
     float power(const IPAddress &addr);
     float energy(const IPAddress &addr);
+    // Send all four requests at once and sort the replies as they arrive.
+    // Fields without a reply are PZEM_ERROR_VALUE and left out of valid.
+    // Returns true if all four were read
+    bool readAll(const IPAddress &addr, PZEMReading &reading);
 
     bool setAddress(const IPAddress &newAddr);
     bool setPowerAlarm(const IPAddress &addr, uint8_t threshold);
 
+    // Send a request without waiting for the reply, then call poll() until
+    // it is no longer PZEM_BUSY. Replies are parsed as their bytes arrive.
+    void begin(const IPAddress &addr, uint8_t cmd, uint8_t data = 0);
+    uint8_t poll();
+    uint8_t status() {return _status;}
+    // The reading of a PZEM_DONE request, or PZEM_ERROR_VALUE
+    float value();
+
 private:
     Stream *serial;
 
     unsigned long _readTimeOut;
     bool _isSoft;
 
+    uint8_t _status;
+    uint8_t _expect;
+    uint8_t _rxLen;
+    uint8_t _rx[sizeof(PZEMCommand)];
+    unsigned long _sentAt;
+
+    void command(PZEMCommand &pzem, const IPAddress &addr, uint8_t cmd, uint8_t data);
     void send(const IPAddress &addr, uint8_t cmd, uint8_t data = 0);
+    void expect(uint8_t resp);
     bool recieve(uint8_t resp, uint8_t *data = 0);
+    static float decode(uint8_t resp, const uint8_t *data);
 
     uint8_t crc(uint8_t *data, uint8_t sz);
 };
@@ -0,0 +1,161 @@
+#include "PZEMGroup.h"
+
+static const uint8_t commands[PZEM_GROUP_VALUES] = {
+    PZEM_VOLTAGE, PZEM_CURRENT, PZEM_POWER, PZEM_ENERGY
+};
+
+PZEMGroup::PZEMGroup()
+{
+    this->_count = 0;
+    this->_busy = false;
+}
+
+PZEMGroup::Member *PZEMGroup::addMember()
+{
+    if(_count >= PZEM_GROUP_SIZE)
+        return NULL;
+
+    Member &m = _members[_count++];
+    m.meter = NULL;
+    m.modbus = NULL;
+    m.addr = IPAddress();
+    m.step = PZEM_GROUP_VALUES;
+    m.soft = false;
+    m.waiting = false;
+    for(int i=0; i<PZEM_GROUP_VALUES; i++)
+        m.values[i] = PZEM_ERROR_VALUE;
+    return &m;
+}
+
+bool PZEMGroup::add(PZEM004T *meter, const IPAddress &addr)
+{
+    if(meter == NULL)
+        return false;
+
+    Member *m = addMember();
+    if(m == NULL)
+        return false;
+
+    m->meter = meter;
+    m->addr = addr;
+    m->soft = meter->isSoft();
+    return true;
+}
+
+bool PZEMGroup::add(PZEMModbus *meter)
+{
+    if(meter == NULL)
+        return false;
+
+    Member *m = addMember();
+    if(m == NULL)
+        return false;
+
+    m->modbus = meter;
+    m->soft = meter->isSoft();
+    return true;
+}
+
+void PZEMGroup::start(Member &m)
+{
+    m.waiting = false;
+    if(m.modbus)
+        m.modbus->begin();
+    else
+        m.meter->begin(m.addr, commands[0]);
+}
+
+bool PZEMGroup::startWaiting()
+{
+    for(uint8_t i=0; i<_count; i++)
+    {
+        if(_members[i].waiting)
+        {
+            start(_members[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+void PZEMGroup::begin()
+{
+    bool listening = false;
+    for(uint8_t i=0; i<_count; i++)
+    {
+        Member &m = _members[i];
+        m.step = 0;
+        // Listening on another SoftwareSerial port would drop this one's reply
+        m.waiting = m.soft && listening;
+        if(m.soft)
+            listening = true;
+        if(!m.waiting)
+            start(m);
+    }
+    _busy = (_count > 0);
+}
+
+bool PZEMGroup::poll()
+{
+    if(!_busy)
+        return true;
+
+    bool done = true;
+    for(uint8_t i=0; i<_count; i++)
+    {
+        Member &m = _members[i];
+        if(m.step >= PZEM_GROUP_VALUES)
+            continue;
+        if(m.waiting)
+        {
+            done = false;
+            continue;
+        }
+
+        uint8_t status = m.modbus ? m.modbus->poll() : m.meter->poll();
+        if(status == PZEM_BUSY)
+        {
+            done = false;
+            continue;
+        }
+
+        if(m.modbus)
+        {
+            PZEMReading reading;
+            m.modbus->result(reading);
+            m.values[PZEM_GROUP_VOLTAGE] = reading.voltage;
+            m.values[PZEM_GROUP_CURRENT] = reading.current;
+            m.values[PZEM_GROUP_POWER] = reading.power;
+            m.values[PZEM_GROUP_ENERGY] = reading.energy;
+            m.step = PZEM_GROUP_VALUES;
+        }
+        else
+        {
+            m.values[m.step++] = m.meter->value();
+            if(status == PZEM_TIMEOUT)
+            {
+                // A meter that does not answer would time out on the rest too
+                while(m.step < PZEM_GROUP_VALUES)
+                    m.values[m.step++] = PZEM_ERROR_VALUE;
+            }
+            else if(m.step < PZEM_GROUP_VALUES)
+            {
+                m.meter->begin(m.addr, commands[m.step]);
+                done = false;
+            }
+        }
+
+        if(m.soft && m.step >= PZEM_GROUP_VALUES && startWaiting())
+            done = false;
+    }
+
+    _busy = !done;
+    return done;
+}
+
+float PZEMGroup::value(uint8_t meter, uint8_t quantity)
+{
+    if(meter >= _count || quantity >= PZEM_GROUP_VALUES)
+        return PZEM_ERROR_VALUE;
+    return _members[meter].values[quantity];
+}
@@ -0,0 +1,72 @@
+#ifndef PZEMGROUP_H
+#define PZEMGROUP_H
+
+#include "PZEM004T.h"
+#include "PZEMModbus.h"
+
+#ifndef PZEM_GROUP_SIZE
+#define PZEM_GROUP_SIZE 3
+#endif
+
+// Quantities of a snapshot
+#define PZEM_GROUP_VOLTAGE 0
+#define PZEM_GROUP_CURRENT 1
+#define PZEM_GROUP_POWER   2
+#define PZEM_GROUP_ENERGY  3
+#define PZEM_GROUP_VALUES  4
+
+// Reads meters on separate serial ports at the same time. Each meter moves
+// on to its next quantity as soon as it has answered the last one, so a
+// snapshot of all of them takes about as long as reading one. Modbus meters
+// answer every quantity at once. SoftwareSerial can only listen on one port,
+// so meters on SoftwareSerial take turns, each read after the one before.
+class PZEMGroup
+{
+public:
+    PZEMGroup();
+
+    // Returns false if the group is full or meter is NULL
+    bool add(PZEM004T *meter, const IPAddress &addr);
+    // A Modbus meter gives all its readings in one reply
+    bool add(PZEMModbus *meter);
+    uint8_t count() {return _count;}
+
+    // Start a snapshot of voltage, current, power and energy on every meter
+    void begin();
+    // Read the replies that have arrived and send the next requests
+    // Returns true once the snapshot is complete
+    bool poll();
+    bool busy() {return _busy;}
+
+    // A reading of the snapshot, once poll() has returned true, or
+    // PZEM_ERROR_VALUE if the meter did not give it
+    float value(uint8_t meter, uint8_t quantity);
+    float voltage(uint8_t meter) {return value(meter, PZEM_GROUP_VOLTAGE);}
+    float current(uint8_t meter) {return value(meter, PZEM_GROUP_CURRENT);}
+    float power(uint8_t meter) {return value(meter, PZEM_GROUP_POWER);}
+    float energy(uint8_t meter) {return value(meter, PZEM_GROUP_ENERGY);}
+
+private:
+    struct Member {
+        PZEM004T *meter;
+        PZEMModbus *modbus;
+        IPAddress addr;
+        uint8_t step;
+        bool soft;
+        bool waiting;
+        float values[PZEM_GROUP_VALUES];
+    };
+
+    Member _members[PZEM_GROUP_SIZE];
+    uint8_t _count;
+    bool _busy;
+
+    // The next free member, cleared, or NULL if the group is full
+    Member *addMember();
+    void start(Member &m);
+    // Start the next SoftwareSerial meter waiting for its turn
+    // Returns false if none was waiting
+    bool startWaiting();
+};
+
+#endif // PZEMGROUP_H
@@ -0,0 +1,109 @@
+#include "PZEMHistory.h"
+
+PZEMHistory::PZEMHistory()
+{
+    this->_head = 0;
+    this->_count = 0;
+    this->_n = 0;
+    this->_hasEnergy = false;
+}
+
+bool PZEMHistory::add(const PZEMReading &reading)
+{
+    if((reading.valid & PZEM_VALID_ALL) != PZEM_VALID_ALL)
+        return false;
+
+    add(toSample(reading));
+    return true;
+}
+
+void PZEMHistory::add(const PZEMSample &sample)
+{
+    _ring[_head] = sample;
+    _head = (_head + 1) % PZEM_HISTORY_SIZE;
+    if(_count < PZEM_HISTORY_SIZE)
+        _count++;
+
+    uint16_t values[PZEM_HISTORY_VALUES] = {sample.voltage, sample.current, sample.power};
+    if(_n == 0)
+    {
+        for(uint8_t i=0; i<PZEM_HISTORY_VALUES; i++)
+        {
+            _min[i] = _max[i] = values[i];
+            _sum[i] = 0;
+        }
+        if(!_hasEnergy)
+            _energyStart = sample.energy;
+        _hasEnergy = true;
+    }
+    else if(_n == 0xFFFF)
+    {
+        // The sums could overflow, so the rest of the interval is left out
+        return;
+    }
+
+    for(uint8_t i=0; i<PZEM_HISTORY_VALUES; i++)
+    {
+        if(values[i] < _min[i])
+            _min[i] = values[i];
+        if(values[i] > _max[i])
+            _max[i] = values[i];
+        _sum[i] += values[i];
+    }
+    _energyLast = sample.energy;
+    _n++;
+}
+
+bool PZEMHistory::sample(uint8_t i, PZEMSample &out)
+{
+    if(i >= _count)
+        return false;
+
+    out = _ring[(_head + PZEM_HISTORY_SIZE - 1 - i) % PZEM_HISTORY_SIZE];
+    return true;
+}
+
+bool PZEMHistory::takeStats(PZEMStats &stats)
+{
+    stats.count = _n;
+    if(_n == 0)
+    {
+        for(uint8_t i=0; i<PZEM_HISTORY_VALUES; i++)
+            stats.min[i] = stats.max[i] = stats.mean[i] = 0;
+        stats.energy = 0;
+        return false;
+    }
+
+    for(uint8_t i=0; i<PZEM_HISTORY_VALUES; i++)
+    {
+        stats.min[i] = _min[i];
+        stats.max[i] = _max[i];
+        stats.mean[i] = (_sum[i] + _n / 2) / _n;
+    }
+    // The meter's counter only goes back on a reset
+    stats.energy = (_energyLast >= _energyStart) ? _energyLast - _energyStart : _energyLast;
+
+    _energyStart = _energyLast;
+    _n = 0;
+    return true;
+}
+
+PZEMSample PZEMHistory::toSample(const PZEMReading &reading)
+{
+    PZEMSample sample;
+    sample.voltage = fixed(reading.voltage, 10);
+    sample.current = fixed(reading.current, 100);
+    sample.power = fixed(reading.power, 1);
+    sample.energy = (reading.energy > 0) ? (uint32_t)(reading.energy + 0.5) : 0;
+    return sample;
+}
+
+uint16_t PZEMHistory::fixed(float value, uint16_t scale)
+{
+    value = value * scale + 0.5;
+    if(value <= 0)
+        return 0;
+    if(value >= 65535)
+        return 65535;
+    return (uint16_t)value;
+}
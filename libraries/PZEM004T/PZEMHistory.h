@@ -0,0 +1,78 @@
+#ifndef PZEMHISTORY_H
+#define PZEMHISTORY_H
+
+#include "PZEM004T.h"
+
+// PZEM_HISTORY_SIZE : samples kept by each PZEMHistory, 10 bytes each on AVR
+#ifndef PZEM_HISTORY_SIZE
+#define PZEM_HISTORY_SIZE 16
+#endif
+
+// Quantities of PZEMStats
+#define PZEM_HISTORY_VOLTAGE 0
+#define PZEM_HISTORY_CURRENT 1
+#define PZEM_HISTORY_POWER   2
+#define PZEM_HISTORY_VALUES  3
+
+// A reading in fixed point
+struct PZEMSample {
+    uint16_t voltage;   // 0.1 V
+    uint16_t current;   // 0.01 A
+    uint16_t power;     // 1 W
+    uint32_t energy;    // 1 Wh
+};
+
+// Aggregates of the samples added over an interval, indexed by
+// PZEM_HISTORY_VOLTAGE and the others, in the units of PZEMSample
+struct PZEMStats {
+    uint16_t count;
+    uint16_t min[PZEM_HISTORY_VALUES];
+    uint16_t max[PZEM_HISTORY_VALUES];
+    uint16_t mean[PZEM_HISTORY_VALUES];
+    // Energy used since the last sample of the previous interval, in Wh
+    uint32_t energy;
+};
+
+// Keeps the latest samples of one meter or phase in a ring, and running
+// aggregates that cost the same to update however many samples there are.
+// Sample often, and report the aggregates of each interval so spikes
+// between reports are not lost.
+class PZEMHistory
+{
+public:
+    PZEMHistory();
+
+    // Add a reading. It is left out, and false returned, unless voltage,
+    // current, power and energy are all valid.
+    bool add(const PZEMReading &reading);
+    void add(const PZEMSample &sample);
+
+    // Number of samples in the ring
+    uint8_t count() {return _count;}
+    // Sample i, 0 being the latest
+    // Returns false if there is no such sample
+    bool sample(uint8_t i, PZEMSample &out);
+
+    // Aggregates since the last call, then start a new interval
+    // Returns false if no samples were added in the interval
+    bool takeStats(PZEMStats &stats);
+
+    static PZEMSample toSample(const PZEMReading &reading);
+
+private:
+    PZEMSample _ring[PZEM_HISTORY_SIZE];
+    uint8_t _head;
+    uint8_t _count;
+
+    uint16_t _n;
+    uint16_t _min[PZEM_HISTORY_VALUES];
+    uint16_t _max[PZEM_HISTORY_VALUES];
+    uint32_t _sum[PZEM_HISTORY_VALUES];
+    uint32_t _energyStart;
+    uint32_t _energyLast;
+    bool _hasEnergy;
+
+    static uint16_t fixed(float value, uint16_t scale);
+};
+
+#endif // PZEMHISTORY_H
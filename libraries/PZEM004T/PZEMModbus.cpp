@@ -0,0 +1,223 @@
+#include "PZEMModbus.h"
+
+#define MODBUS_READ_INPUT     (uint8_t)0x04
+#define MODBUS_WRITE_REGISTER (uint8_t)0x06
+#define MODBUS_RESET_ENERGY   (uint8_t)0x42
+#define MODBUS_EXCEPTION      (uint8_t)0x80
+
+// Input registers 0x0000 to 0x0009 hold the readings, the 32 bit ones low
+// word first. The holding register 0x0002 holds the Modbus address.
+#define REG_VOLTAGE      0
+#define REG_CURRENT      1
+#define REG_POWER        3
+#define REG_ENERGY       5
+#define REG_FREQUENCY    7
+#define REG_POWER_FACTOR 8
+#define REG_COUNT        10
+#define REG_ADDRESS      2
+
+// An exception reply is the address, the function | 0x80, a code and the CRC
+#define EXCEPTION_SIZE 5
+
+#define PZEM_BAUD_RATE 9600
+#define PZEM_DEFAULT_READ_TIMEOUT 1000
+
+// CRC-16/MODBUS, reflected polynomial 0xA001, one lookup per byte
+static const uint16_t crcTable[256] PROGMEM = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+
+PZEMModbus::PZEMModbus(uint8_t receivePin, uint8_t transmitPin, uint8_t addr)
+{
+    SoftwareSerial *port = new SoftwareSerial(receivePin, transmitPin);
+    port->begin(PZEM_BAUD_RATE);
+    this->serial = port;
+    this->_readTimeOut = PZEM_DEFAULT_READ_TIMEOUT;
+    this->_isSoft = true;
+    this->_addr = addr;
+    this->_status = PZEM_IDLE;
+}
+
+PZEMModbus::PZEMModbus(HardwareSerial *port, uint8_t addr)
+{
+    port->begin(PZEM_BAUD_RATE);
+    this->serial = port;
+    this->_readTimeOut = PZEM_DEFAULT_READ_TIMEOUT;
+    this->_isSoft = false;
+    this->_addr = addr;
+    this->_status = PZEM_IDLE;
+}
+
+PZEMModbus::~PZEMModbus()
+{
+    if(_isSoft)
+        delete this->serial;
+}
+
+void PZEMModbus::setReadTimeout(unsigned long msec)
+{
+    _readTimeOut = msec;
+}
+
+bool PZEMModbus::readAll(PZEMReading &reading)
+{
+    begin();
+    wait();
+    return result(reading);
+}
+
+bool PZEMModbus::resetEnergy()
+{
+    uint8_t frame[4] = {_addr, MODBUS_RESET_ENERGY};
+    request(frame, 4, 4);
+    return wait();
+}
+
+bool PZEMModbus::setAddress(uint8_t newAddr)
+{
+    if(newAddr < 0x01 || newAddr > 0xF7)
+        return false;
+
+    uint8_t frame[PZEM_MODBUS_REQUEST_SIZE] = {_addr, MODBUS_WRITE_REGISTER, 0, REG_ADDRESS, 0, newAddr};
+    request(frame, PZEM_MODBUS_REQUEST_SIZE, PZEM_MODBUS_REQUEST_SIZE);
+    if(!wait())
+        return false;
+
+    _addr = newAddr;
+    return true;
+}
+
+void PZEMModbus::begin()
+{
+    uint8_t frame[PZEM_MODBUS_REQUEST_SIZE] = {_addr, MODBUS_READ_INPUT, 0, REG_VOLTAGE, 0, REG_COUNT};
+    request(frame, PZEM_MODBUS_REQUEST_SIZE, PZEM_MODBUS_RESPONSE_SIZE);
+}
+
+void PZEMModbus::request(uint8_t *frame, uint8_t len, uint8_t expectLen)
+{
+    uint16_t crc = crc16(frame, len - 2);
+    frame[len - 2] = crc & 0xFF;
+    frame[len - 1] = crc >> 8;
+
+    while(serial->available())
+        serial->read();
+
+    serial->write(frame, len);
+
+    if(_isSoft)
+        ((SoftwareSerial *)serial)->listen();
+
+    _function = frame[1];
+    _expectLen = expectLen;
+    _rxLen = 0;
+    _sentAt = millis();
+    _status = PZEM_BUSY;
+}
+
+uint8_t PZEMModbus::poll()
+{
+    if(_status != PZEM_BUSY)
+        return _status;
+
+    while(serial->available() > 0)
+    {
+        _rx[_rxLen++] = (uint8_t)serial->read();
+        if(_rxLen == 2 && (_rx[1] & MODBUS_EXCEPTION))
+            _expectLen = EXCEPTION_SIZE;
+        if(_rxLen == _expectLen)
+        {
+            uint16_t crc = crc16(_rx, _rxLen - 2);
+            if(_rx[_rxLen - 2] != (crc & 0xFF) || _rx[_rxLen - 1] != (crc >> 8))
+                _status = PZEM_ERROR;
+            else if(_rx[1] != _function)
+                _status = PZEM_ERROR; // the meter refused the request
+            else if(_addr != PZEM_MODBUS_DEFAULT_ADDR && _rx[0] != _addr)
+                _status = PZEM_ERROR;
+            else
+                _status = PZEM_DONE;
+            return _status;
+        }
+    }
+
+    if(millis() - _sentAt >= _readTimeOut)
+        _status = PZEM_TIMEOUT;
+    return _status;
+}
+
+bool PZEMModbus::wait()
+{
+    while(poll() == PZEM_BUSY)
+        yield();	// do background netw tasks while blocked for IO (prevents ESP watchdog trigger)
+    return _status == PZEM_DONE;
+}
+
+bool PZEMModbus::result(PZEMReading &reading)
+{
+    if(_status != PZEM_DONE || _function != MODBUS_READ_INPUT || _rx[2] != REG_COUNT * 2)
+    {
+        reading.voltage = reading.current = reading.power = reading.energy = PZEM_ERROR_VALUE;
+        reading.frequency = reading.powerFactor = PZEM_ERROR_VALUE;
+        reading.valid = 0;
+        return false;
+    }
+
+    reading.voltage = reg(REG_VOLTAGE) / 10.0;
+    reading.current = reg32(REG_CURRENT) / 1000.0;
+    reading.power = reg32(REG_POWER) / 10.0;
+    reading.energy = reg32(REG_ENERGY);
+    reading.frequency = reg(REG_FREQUENCY) / 10.0;
+    reading.powerFactor = reg(REG_POWER_FACTOR) / 100.0;
+    reading.valid = PZEM_VALID_ALL | PZEM_VALID_FREQUENCY | PZEM_VALID_POWER_FACTOR;
+    return true;
+}
+
+uint16_t PZEMModbus::reg(uint8_t i)
+{
+    // The data follow the address, function and byte count, big-endian
+    return ((uint16_t)_rx[3 + 2*i] << 8) | _rx[4 + 2*i];
+}
+
+uint32_t PZEMModbus::reg32(uint8_t i)
+{
+    return ((uint32_t)reg(i + 1) << 16) | reg(i);
+}
+
+uint16_t PZEMModbus::crc16(const uint8_t *data, uint8_t sz)
+{
+    uint16_t crc = 0xFFFF;
+    for(uint8_t i=0; i<sz; i++)
+        crc = (crc >> 8) ^ pgm_read_word(&crcTable[(crc ^ *data++) & 0xFF]);
+    return crc;
+}
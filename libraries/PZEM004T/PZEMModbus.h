@@ -0,0 +1,66 @@
+#ifndef PZEMMODBUS_H
+#define PZEMMODBUS_H
+
+#include "PZEM004T.h"
+
+#define PZEM_MODBUS_DEFAULT_ADDR 0xF8
+
+// Frame sizes, with the CRC
+#define PZEM_MODBUS_REQUEST_SIZE 8
+#define PZEM_MODBUS_RESPONSE_SIZE 25
+
+// Driver for the PZEM-004T v3 meters, which speak Modbus-RTU. A single read
+// of the input registers returns every reading at once, including the
+// frequency and power factor the older meters do not have.
+class PZEMModbus
+{
+public:
+    // addr is the meter's Modbus address. The default reaches whichever
+    // meter is on the port, so it is only for a port with one meter.
+    PZEMModbus(uint8_t receivePin, uint8_t transmitPin, uint8_t addr = PZEM_MODBUS_DEFAULT_ADDR);
+    PZEMModbus(HardwareSerial *port, uint8_t addr = PZEM_MODBUS_DEFAULT_ADDR);
+    ~PZEMModbus();
+
+    void setReadTimeout(unsigned long msec);
+    unsigned long readTimeout() {return _readTimeOut;}
+
+    // Returns true if all six readings were read
+    bool readAll(PZEMReading &reading);
+    bool resetEnergy();
+    // Give the meter a new Modbus address, 0x01 to 0xF7
+    bool setAddress(uint8_t newAddr);
+
+    // Start a read of all the readings, then call poll() until it is no
+    // longer PZEM_BUSY, as for PZEM004T::begin()
+    void begin();
+    uint8_t poll();
+    uint8_t status() {return _status;}
+    // SoftwareSerial ports receive one at a time, see listen()
+    bool isSoft() {return _isSoft;}
+    // The readings of a PZEM_DONE read
+    // Returns true if they were all there
+    bool result(PZEMReading &reading);
+
+    static uint16_t crc16(const uint8_t *data, uint8_t sz);
+
+private:
+    Stream *serial;
+
+    unsigned long _readTimeOut;
+    bool _isSoft;
+    uint8_t _addr;
+
+    uint8_t _status;
+    uint8_t _function;
+    uint8_t _expectLen;
+    uint8_t _rxLen;
+    uint8_t _rx[PZEM_MODBUS_RESPONSE_SIZE];
+    unsigned long _sentAt;
+
+    void request(uint8_t *frame, uint8_t len, uint8_t expectLen);
+    bool wait();
+    uint16_t reg(uint8_t i);
+    uint32_t reg32(uint8_t i);
+};
+
+#endif // PZEMMODBUS_H
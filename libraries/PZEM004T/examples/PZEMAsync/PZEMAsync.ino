@@ -0,0 +1,30 @@
+#include <SoftwareSerial.h> // Arduino IDE <1.6.6
+#include <PZEM004T.h>
+
+PZEM004T pzem(&Serial1);
+IPAddress ip(192,168,1,1);
+
+// Readings requested in turn, one at a time
+const uint8_t commands[] = { PZEM_VOLTAGE, PZEM_CURRENT, PZEM_POWER, PZEM_ENERGY };
+const char *units[] = { "V; ", "A; ", "W; ", "Wh; " };
+uint8_t next = 0;
+
+void setup() {
+  Serial.begin(9600);
+  pzem.setAddress(ip);
+  pzem.begin(ip, commands[next]);
+}
+
+void loop() {
+  // Returns at once, so the rest of loop() keeps running while the meter replies
+  uint8_t status = pzem.poll();
+  if(status == PZEM_BUSY)
+    return;
+
+  if(status == PZEM_DONE){ Serial.print(pzem.value());Serial.print(units[next]); }
+
+  next = (next + 1) % 4;
+  if(next == 0)
+    Serial.println();
+  pzem.begin(ip, commands[next]);
+}
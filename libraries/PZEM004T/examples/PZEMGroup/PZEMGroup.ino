@@ -0,0 +1,42 @@
+#include <SoftwareSerial.h> // Arduino IDE <1.6.6
+#include <PZEM004T.h>
+#include <PZEMGroup.h>
+
+// One meter per phase, each on its own port
+PZEM004T pzem1(&Serial1);
+PZEM004T pzem2(&Serial2);
+PZEM004T pzem3(&Serial3);
+IPAddress ip(192,168,1,1);
+
+PZEMGroup phases;
+unsigned long lastSnapshot = 0;
+
+void setup() {
+  Serial.begin(9600);
+  pzem1.setAddress(ip);
+  pzem2.setAddress(ip);
+  pzem3.setAddress(ip);
+
+  phases.add(&pzem1, ip);
+  phases.add(&pzem2, ip);
+  phases.add(&pzem3, ip);
+}
+
+void loop() {
+  if(!phases.busy() && millis() - lastSnapshot > 1000) {
+    lastSnapshot = millis();
+    phases.begin();
+  }
+
+  // Returns at once; true when every phase has been read
+  if(phases.busy() && phases.poll()) {
+    float p = 0;
+    for(uint8_t i = 0; i < phases.count(); i++) {
+      Serial.print(phases.voltage(i));Serial.print("V; ");
+      Serial.print(phases.current(i));Serial.print("A; ");
+      if(phases.power(i) >= 0.0)
+        p += phases.power(i);
+    }
+    Serial.print(p);Serial.println("W total");
+  }
+}
@@ -0,0 +1,39 @@
+#include <SoftwareSerial.h> // Arduino IDE <1.6.6
+#include <PZEM004T.h>
+#include <PZEMHistory.h>
+
+PZEM004T pzem(&Serial1);
+IPAddress ip(192,168,1,1);
+
+PZEMHistory history;
+unsigned long lastSample = 0;
+unsigned long lastReport = 0;
+
+void setup() {
+  Serial.begin(9600);
+  pzem.setAddress(ip);
+}
+
+void loop() {
+  // Sample every second
+  if(millis() - lastSample > 1000) {
+    lastSample = millis();
+    PZEMReading r;
+    pzem.readAll(ip, r);
+    history.add(r);
+  }
+
+  // Report the spread of each minute
+  if(millis() - lastReport > 60000) {
+    lastReport = millis();
+    PZEMStats s;
+    if(history.takeStats(s)) {
+      Serial.print(s.min[PZEM_HISTORY_VOLTAGE] / 10.0);Serial.print("..");
+      Serial.print(s.max[PZEM_HISTORY_VOLTAGE] / 10.0);Serial.print("V, mean ");
+      Serial.print(s.mean[PZEM_HISTORY_VOLTAGE] / 10.0);Serial.print("V; ");
+      Serial.print(s.max[PZEM_HISTORY_POWER]);Serial.print("W peak; ");
+      Serial.print(s.energy);Serial.print("Wh; ");
+      Serial.print(s.count);Serial.println(" samples");
+    }
+  }
+}
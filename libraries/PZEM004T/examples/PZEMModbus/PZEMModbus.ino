@@ -0,0 +1,28 @@
+#include <SoftwareSerial.h> // Arduino IDE <1.6.6
+#include <PZEMModbus.h>
+
+// A PZEM-004T v3 meter, which speaks Modbus-RTU
+PZEMModbus pzem(&Serial1);
+
+void setup() {
+  Serial.begin(9600);
+}
+
+void loop() {
+  PZEMReading r;
+
+  // One request returns every reading
+  if(pzem.readAll(r)) {
+    Serial.print(r.voltage);Serial.print("V; ");
+    Serial.print(r.current);Serial.print("A; ");
+    Serial.print(r.power);Serial.print("W; ");
+    Serial.print(r.energy);Serial.print("Wh; ");
+    Serial.print(r.frequency);Serial.print("Hz; ");
+    Serial.print(r.powerFactor);Serial.print("PF");
+  } else {
+    Serial.print("No reply");
+  }
+  Serial.println();
+
+  delay(1000);
+}
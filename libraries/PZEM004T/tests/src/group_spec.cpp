@@ -0,0 +1,159 @@
+#include "PZEMGroup.h"
+#include "SoftwareSerial.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+#include <math.h>
+
+IPAddress ip(192,168,1,1);
+
+uint8_t voltageReply[] = {0xA0,0x00,0xE6,0x02,0x00,0x00,0x88};      // 230.2 V
+uint8_t currentReply[] = {0xA1,0x00,0x11,0x20,0x00,0x00,0xD2};      // 17.32 A
+uint8_t powerReply[] = {0xA2,0x08,0x98,0x00,0x00,0x00,0x42};        // 2200 W
+uint8_t energyReply[] = {0xA3,0x01,0x86,0x9F,0x00,0x00,0xC9};       // 99999 Wh
+uint8_t *replies[] = {voltageReply, currentReply, powerReply, energyReply};
+
+bool near(float a, float b)
+{
+    return fabs(a - b) < 0.001;
+}
+
+int test_group_add()
+{
+    IT("refuses a NULL meter and more than PZEM_GROUP_SIZE meters");
+    HardwareSerial ports[PZEM_GROUP_SIZE + 1];
+    PZEMGroup group;
+
+    IS_FALSE(group.add((PZEM004T *)NULL, ip));
+    IS_FALSE(group.add((PZEMModbus *)NULL));
+    IS_TRUE(group.count() == 0);
+
+    PZEM004T *meters[PZEM_GROUP_SIZE + 1];
+    for(int i=0; i<PZEM_GROUP_SIZE + 1; i++)
+        meters[i] = new PZEM004T(&ports[i]);
+    for(int i=0; i<PZEM_GROUP_SIZE; i++)
+        IS_TRUE(group.add(meters[i], ip));
+    IS_FALSE(group.add(meters[PZEM_GROUP_SIZE], ip));
+    IS_TRUE(group.count() == PZEM_GROUP_SIZE);
+    for(int i=0; i<PZEM_GROUP_SIZE + 1; i++)
+        delete meters[i];
+
+    // An empty group has nothing to wait for
+    PZEMGroup empty;
+    empty.begin();
+    IS_FALSE(empty.busy());
+    IS_TRUE(empty.poll());
+
+    END_IT
+}
+
+int test_group_snapshot()
+{
+    IT("reads the meters side by side, one quantity per reply");
+    HardwareSerial ports[3];
+    PZEM004T a(&ports[0]), b(&ports[1]), c(&ports[2]);
+    c.setReadTimeout(100);
+    PZEMGroup group;
+    IS_TRUE(group.add(&a, ip));
+    IS_TRUE(group.add(&b, ip));
+    IS_TRUE(group.add(&c, ip));
+
+    group.begin();
+    IS_TRUE(group.busy());
+    for(int q=0; q<PZEM_GROUP_VALUES; q++)
+    {
+        // Each meter that answers has been sent the request for the same
+        // quantity
+        for(int k=0; k<2; k++)
+        {
+            IS_TRUE(ports[k].sentLength() == 7 * (q + 1));
+            IS_TRUE(ports[k].sent()[7 * q] == PZEM_VOLTAGE + q);
+        }
+        IS_FALSE(group.poll());
+        // The third meter never answers
+        ports[0].respond(replies[q], 7);
+        ports[1].respond(replies[q], 7);
+        if(q == 0)
+            advanceMillis(100);
+        bool done = group.poll();
+        IS_TRUE(done == (q == PZEM_GROUP_VALUES - 1));
+    }
+    IS_FALSE(group.busy());
+
+    for(int k=0; k<2; k++)
+    {
+        IS_TRUE(near(group.voltage(k), 230.2));
+        IS_TRUE(near(group.current(k), 17.32));
+        IS_TRUE(near(group.power(k), 2200));
+        IS_TRUE(near(group.energy(k), 99999));
+    }
+    // Given up on after its first timeout, not after one per quantity
+    IS_TRUE(ports[2].sentLength() == 7);
+    for(int q=0; q<PZEM_GROUP_VALUES; q++)
+        IS_TRUE(near(group.value(2, q), PZEM_ERROR_VALUE));
+    IS_TRUE(near(group.value(3, 0), PZEM_ERROR_VALUE));
+
+    END_IT
+}
+
+int test_group_soft_serial()
+{
+    IT("reads meters on SoftwareSerial one after another");
+    HardwareSerial port;
+    PZEM004T hard(&port);
+    PZEM004T softA(10, 11);
+    SoftwareSerial *portA = SoftwareSerial::last;
+    PZEM004T softB(12, 13);
+    SoftwareSerial *portB = SoftwareSerial::last;
+    IS_FALSE(hard.isSoft());
+    IS_TRUE(softA.isSoft());
+
+    PZEMGroup group;
+    IS_TRUE(group.add(&softA, ip));
+    IS_TRUE(group.add(&hard, ip));
+    IS_TRUE(group.add(&softB, ip));
+
+    group.begin();
+    // The second SoftwareSerial meter waits until the first is done
+    IS_TRUE(portA->sentLength() == 7);
+    IS_TRUE(port.sentLength() == 7);
+    IS_TRUE(portB->sentLength() == 0);
+    IS_TRUE(portA->isListening());
+
+    for(int q=0; q<PZEM_GROUP_VALUES; q++)
+    {
+        portA->respond(replies[q], 7);
+        port.respond(replies[q], 7);
+        IS_FALSE(group.poll());
+    }
+    IS_TRUE(portB->sentLength() == 7);
+    IS_TRUE(portB->isListening());
+
+    for(int q=0; q<PZEM_GROUP_VALUES; q++)
+    {
+        portB->respond(replies[q], 7);
+        bool done = group.poll();
+        IS_TRUE(done == (q == PZEM_GROUP_VALUES - 1));
+    }
+    IS_FALSE(group.busy());
+
+    for(int k=0; k<3; k++)
+    {
+        IS_TRUE(near(group.voltage(k), 230.2));
+        IS_TRUE(near(group.current(k), 17.32));
+        IS_TRUE(near(group.power(k), 2200));
+        IS_TRUE(near(group.energy(k), 99999));
+    }
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("PZEMGroup");
+    test_group_add();
+    test_group_snapshot();
+    test_group_soft_serial();
+
+    FINISH
+}
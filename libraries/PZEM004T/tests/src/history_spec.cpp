@@ -0,0 +1,132 @@
+#include "PZEMHistory.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+PZEMSample make(uint16_t voltage, uint16_t current, uint16_t power, uint32_t energy)
+{
+    PZEMSample sample;
+    sample.voltage = voltage;
+    sample.current = current;
+    sample.power = power;
+    sample.energy = energy;
+    return sample;
+}
+
+int test_history_ring()
+{
+    IT("keeps the latest PZEM_HISTORY_SIZE samples across the wrap");
+    PZEMHistory history;
+    PZEMSample s;
+    IS_TRUE(history.count() == 0);
+    IS_FALSE(history.sample(0, s));
+
+    for(int i=0; i<PZEM_HISTORY_SIZE + 4; i++)
+        history.add(make(2300 + i, 150, 345, 1000 + i));
+    IS_TRUE(history.count() == PZEM_HISTORY_SIZE);
+
+    IS_TRUE(history.sample(0, s));
+    IS_TRUE(s.voltage == 2300 + PZEM_HISTORY_SIZE + 3);
+    IS_TRUE(s.energy == 1000 + PZEM_HISTORY_SIZE + 3);
+    // The 4 oldest were overwritten
+    IS_TRUE(history.sample(PZEM_HISTORY_SIZE - 1, s));
+    IS_TRUE(s.voltage == 2304);
+    IS_FALSE(history.sample(PZEM_HISTORY_SIZE, s));
+
+    END_IT
+}
+
+int test_history_stats()
+{
+    IT("aggregates every sample of the interval, including overwritten ones");
+    PZEMHistory history;
+
+    // A spike early on, gone from the ring by the time the stats are taken
+    for(int i=0; i<PZEM_HISTORY_SIZE + 4; i++)
+    {
+        uint16_t voltage = (i == 1) ? 2450 : 2300 + (i % 3);
+        uint16_t current = (i == 2) ? 10 : 150;
+        history.add(make(voltage, current, 300 + i, 1000 + i));
+    }
+    PZEMSample s;
+    IS_TRUE(history.sample(PZEM_HISTORY_SIZE - 1, s));
+    IS_TRUE(s.voltage != 2450);
+
+    PZEMStats stats;
+    IS_TRUE(history.takeStats(stats));
+    IS_TRUE(stats.count == PZEM_HISTORY_SIZE + 4);
+    IS_TRUE(stats.max[PZEM_HISTORY_VOLTAGE] == 2450);
+    IS_TRUE(stats.min[PZEM_HISTORY_VOLTAGE] == 2300);
+    IS_TRUE(stats.min[PZEM_HISTORY_CURRENT] == 10);
+    IS_TRUE(stats.max[PZEM_HISTORY_CURRENT] == 150);
+    IS_TRUE(stats.min[PZEM_HISTORY_POWER] == 300);
+    IS_TRUE(stats.max[PZEM_HISTORY_POWER] == 300 + PZEM_HISTORY_SIZE + 3);
+    // Means are rounded: power 300..319 averages 309.5
+    IS_TRUE(stats.mean[PZEM_HISTORY_POWER] == 310);
+    IS_TRUE(stats.mean[PZEM_HISTORY_CURRENT] == (150 * 19 + 10 + 10) / 20);
+    uint32_t sum = 0;
+    for(int i=0; i<PZEM_HISTORY_SIZE + 4; i++)
+        sum += (i == 1) ? 2450 : 2300 + (i % 3);
+    IS_TRUE(stats.mean[PZEM_HISTORY_VOLTAGE] == (sum + 10) / 20);
+    IS_TRUE(stats.energy == PZEM_HISTORY_SIZE + 3);
+
+    // Taking them starts a new interval, the ring is kept
+    IS_FALSE(history.takeStats(stats));
+    IS_TRUE(stats.count == 0);
+    IS_TRUE(stats.max[PZEM_HISTORY_VOLTAGE] == 0);
+    IS_TRUE(stats.energy == 0);
+    IS_TRUE(history.count() == PZEM_HISTORY_SIZE);
+
+    history.add(make(2310, 150, 345, 1030));
+    IS_TRUE(history.takeStats(stats));
+    IS_TRUE(stats.count == 1);
+    IS_TRUE(stats.min[PZEM_HISTORY_VOLTAGE] == 2310);
+    IS_TRUE(stats.max[PZEM_HISTORY_VOLTAGE] == 2310);
+    IS_TRUE(stats.mean[PZEM_HISTORY_VOLTAGE] == 2310);
+    // Counted from the last sample of the previous interval
+    IS_TRUE(stats.energy == 1030 - (1000 + PZEM_HISTORY_SIZE + 3));
+
+    // The meter's counter was reset
+    history.add(make(2310, 150, 345, 4));
+    IS_TRUE(history.takeStats(stats));
+    IS_TRUE(stats.energy == 4);
+
+    END_IT
+}
+
+int test_history_readings()
+{
+    IT("converts complete readings to fixed point");
+    PZEMHistory history;
+    PZEMReading reading = {230.25, 17.32, 2200, 99999, PZEM_ERROR_VALUE, PZEM_ERROR_VALUE, PZEM_VALID_ALL};
+    IS_TRUE(history.add(reading));
+    PZEMSample s;
+    IS_TRUE(history.sample(0, s));
+    IS_TRUE(s.voltage == 2303);
+    IS_TRUE(s.current == 1732);
+    IS_TRUE(s.power == 2200);
+    IS_TRUE(s.energy == 99999);
+
+    // Out of range values are clamped
+    reading.current = -1;
+    reading.power = 70000;
+    s = PZEMHistory::toSample(reading);
+    IS_TRUE(s.current == 0);
+    IS_TRUE(s.power == 65535);
+
+    // Left out unless all four were read
+    reading.valid = PZEM_VALID_ALL & ~PZEM_VALID_ENERGY;
+    IS_FALSE(history.add(reading));
+    IS_TRUE(history.count() == 1);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("PZEMHistory");
+    test_history_ring();
+    test_history_stats();
+    test_history_readings();
+
+    FINISH
+}
@@ -0,0 +1,18 @@
+#include "Arduino.h"
+
+static unsigned long now = 0;
+
+unsigned long millis()
+{
+    return now;
+}
+
+void yield()
+{
+    now++;
+}
+
+void advanceMillis(unsigned long ms)
+{
+    now += ms;
+}
@@ -0,0 +1,23 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+// Each call takes a millisecond of the shim clock
+void yield();
+
+// Moves the shim clock forward, so timeouts can be tested without sleeping
+void advanceMillis(unsigned long ms);
+
+#define PROGMEM
+#define pgm_read_word(x) (*(x))
+
+#include "HardwareSerial.h"
+
+#endif // Arduino_h
@@ -0,0 +1,58 @@
+#include "HardwareSerial.h"
+
+HardwareSerial::HardwareSerial()
+{
+    _rxHead = _rxTail = 0;
+    _txLen = 0;
+    _replyLen = 0;
+    _baud = 0;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    _baud = baud;
+}
+
+int HardwareSerial::available()
+{
+    return _rxTail - _rxHead;
+}
+
+int HardwareSerial::read()
+{
+    if(_rxHead == _rxTail)
+        return -1;
+    return _rx[_rxHead++];
+}
+
+size_t HardwareSerial::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t size)
+{
+    size_t n = 0;
+    while(n < size && _txLen < SHIM_SERIAL_SIZE)
+        _tx[_txLen++] = buf[n++];
+    if(_replyLen > 0)
+    {
+        respond(_reply, _replyLen);
+        _replyLen = 0;
+    }
+    return n;
+}
+
+void HardwareSerial::respond(const uint8_t *buf, size_t size)
+{
+    if(_rxHead == _rxTail)
+        _rxHead = _rxTail = 0;
+    for(size_t i=0; i<size && _rxTail < SHIM_SERIAL_SIZE; i++)
+        _rx[_rxTail++] = buf[i];
+}
+
+void HardwareSerial::reply(const uint8_t *buf, size_t size)
+{
+    for(size_t i=0; i<size && _replyLen < SHIM_SERIAL_SIZE; i++)
+        _reply[_replyLen++] = buf[i];
+}
@@ -0,0 +1,49 @@
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHIM_SERIAL_SIZE 256
+
+class Stream {
+public:
+    virtual ~Stream() {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+};
+
+// A port that keeps what is written to it and gives back the bytes passed to
+// respond(), as if the meter had sent them
+class HardwareSerial : public Stream {
+protected:
+    uint8_t _rx[SHIM_SERIAL_SIZE];
+    uint16_t _rxHead;
+    uint16_t _rxTail;
+    uint8_t _tx[SHIM_SERIAL_SIZE];
+    uint16_t _txLen;
+    uint8_t _reply[SHIM_SERIAL_SIZE];
+    uint16_t _replyLen;
+    unsigned long _baud;
+public:
+    HardwareSerial();
+    void begin(unsigned long baud);
+    virtual int available();
+    virtual int read();
+    virtual size_t write(uint8_t b);
+    virtual size_t write(const uint8_t *buf, size_t size);
+
+    void respond(const uint8_t *buf, size_t size);
+    // As respond(), once the next request has been written, so a blocking
+    // call that empties the port before sending still gets it
+    void reply(const uint8_t *buf, size_t size);
+    // Bytes written since the last clearSent()
+    const uint8_t *sent() {return _tx;}
+    uint16_t sentLength() {return _txLen;}
+    void clearSent() {_txLen = 0;}
+    unsigned long baud() {return _baud;}
+};
+
+#endif
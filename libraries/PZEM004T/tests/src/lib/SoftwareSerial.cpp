@@ -0,0 +1,42 @@
+#include "SoftwareSerial.h"
+
+SoftwareSerial *SoftwareSerial::_listening = NULL;
+SoftwareSerial *SoftwareSerial::last = NULL;
+
+SoftwareSerial::SoftwareSerial(uint8_t receivePin, uint8_t transmitPin)
+{
+    last = this;
+}
+
+SoftwareSerial::~SoftwareSerial()
+{
+    if(_listening == this)
+        _listening = NULL;
+    if(last == this)
+        last = NULL;
+}
+
+bool SoftwareSerial::listen()
+{
+    if(_listening == this)
+        return false;
+    if(_listening)
+        _listening->_rxHead = _listening->_rxTail = 0;
+    _listening = this;
+    _rxHead = _rxTail = 0;
+    return true;
+}
+
+int SoftwareSerial::available()
+{
+    if(!isListening())
+        return 0;
+    return HardwareSerial::available();
+}
+
+int SoftwareSerial::read()
+{
+    if(!isListening())
+        return -1;
+    return HardwareSerial::read();
+}
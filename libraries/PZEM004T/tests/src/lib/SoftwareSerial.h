@@ -0,0 +1,23 @@
+#ifndef SoftwareSerial_h
+#define SoftwareSerial_h
+
+#include "Arduino.h"
+
+// As on the device, only the port that last called listen() receives, and
+// switching ports drops what the previous one had buffered
+class SoftwareSerial : public HardwareSerial {
+private:
+    static SoftwareSerial *_listening;
+public:
+    // The port created last, so a spec can answer for a meter that made its own
+    static SoftwareSerial *last;
+
+    SoftwareSerial(uint8_t receivePin, uint8_t transmitPin);
+    ~SoftwareSerial();
+    bool listen();
+    bool isListening() {return _listening == this;}
+    virtual int available();
+    virtual int read();
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "PZEMModbus.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+#include <math.h>
+
+// Frames with their CRC. The first is the read example of the PZEM-004T v3
+// manual, the others were worked out apart from the library.
+uint8_t readRequest1[] = {0x01,0x04,0x00,0x00,0x00,0x0A,0x70,0x0D};
+uint8_t resetEnergy[] = {0xF8,0x42,0xC2,0x41};
+uint8_t readRequest[] = {0xF8,0x04,0x00,0x00,0x00,0x0A,0x64,0x64};
+uint8_t setAddress5[] = {0xF8,0x06,0x00,0x02,0x00,0x05,0xFC,0x60};
+// 230.2 V, 17.32 A, 2200 W, 99999 Wh, 50 Hz, power factor 0.95
+uint8_t readReply[] = {0xF8,0x04,0x14,0x08,0xFE,0x43,0xA8,0x00,0x00,0x55,0xF0,0x00,0x00,
+    0x86,0x9F,0x00,0x01,0x01,0xF4,0x00,0x5F,0x00,0x00,0x59,0x4D};
+// Illegal data address
+uint8_t exceptionReply[] = {0xF8,0x84,0x02,0x12,0xF0};
+
+bool near(float a, float b)
+{
+    return fabs(a - b) < 0.001;
+}
+
+int test_modbus_crc()
+{
+    IT("computes the CRC16 of known frames");
+    IS_TRUE(PZEMModbus::crc16(readRequest1, 6) == 0x0D70);
+    IS_TRUE(PZEMModbus::crc16(resetEnergy, 2) == 0x41C2);
+    IS_TRUE(PZEMModbus::crc16(readReply, 23) == 0x4D59);
+    // Over a frame and its CRC the remainder is 0
+    IS_TRUE(PZEMModbus::crc16(readRequest, 8) == 0);
+
+    END_IT
+}
+
+int test_modbus_read_all()
+{
+    IT("reads all six readings from one block of input registers");
+    HardwareSerial port;
+    PZEMModbus pzem(&port);
+
+    port.reply(readReply, sizeof(readReply));
+    PZEMReading reading;
+    IS_TRUE(pzem.readAll(reading));
+    IS_TRUE(port.sentLength() == 8);
+    IS_TRUE(memcmp(port.sent(), readRequest, 8) == 0);
+
+    IS_TRUE(reading.valid == (PZEM_VALID_ALL | PZEM_VALID_FREQUENCY | PZEM_VALID_POWER_FACTOR));
+    IS_TRUE(near(reading.voltage, 230.2));
+    IS_TRUE(near(reading.current, 17.32));
+    IS_TRUE(near(reading.power, 2200));
+    IS_TRUE(near(reading.energy, 99999));
+    IS_TRUE(near(reading.frequency, 50));
+    IS_TRUE(near(reading.powerFactor, 0.95));
+
+    END_IT
+}
+
+int test_modbus_async()
+{
+    IT("parses a reply as its bytes arrive");
+    HardwareSerial port;
+    PZEMModbus pzem(&port, 0x01);
+
+    pzem.begin();
+    IS_TRUE(memcmp(port.sent(), readRequest1, 8) == 0);
+    IS_TRUE(pzem.poll() == PZEM_BUSY);
+
+    // The same reply from address 1
+    uint8_t reply[sizeof(readReply)];
+    memcpy(reply, readReply, sizeof(reply));
+    reply[0] = 0x01;
+    uint16_t crc = PZEMModbus::crc16(reply, sizeof(reply) - 2);
+    reply[sizeof(reply) - 2] = crc & 0xFF;
+    reply[sizeof(reply) - 1] = crc >> 8;
+    port.respond(reply, 10);
+    IS_TRUE(pzem.poll() == PZEM_BUSY);
+    port.respond(reply + 10, sizeof(reply) - 10);
+    IS_TRUE(pzem.poll() == PZEM_DONE);
+    PZEMReading reading;
+    IS_TRUE(pzem.result(reading));
+    IS_TRUE(near(reading.voltage, 230.2));
+
+    // A reply from another meter is refused
+    pzem.begin();
+    port.respond(readReply, sizeof(readReply));
+    IS_TRUE(pzem.poll() == PZEM_ERROR);
+
+    END_IT
+}
+
+int test_modbus_errors()
+{
+    IT("reports exception replies, bad CRCs and timeouts");
+    HardwareSerial port;
+    PZEMModbus pzem(&port);
+    pzem.setReadTimeout(100);
+    PZEMReading reading;
+
+    // Five bytes are enough once the exception bit is seen
+    pzem.begin();
+    port.respond(exceptionReply, sizeof(exceptionReply));
+    IS_TRUE(pzem.poll() == PZEM_ERROR);
+    IS_FALSE(pzem.result(reading));
+    IS_TRUE(reading.valid == 0);
+    IS_TRUE(near(reading.voltage, PZEM_ERROR_VALUE));
+    IS_TRUE(near(reading.powerFactor, PZEM_ERROR_VALUE));
+
+    uint8_t corrupt[sizeof(readReply)];
+    memcpy(corrupt, readReply, sizeof(corrupt));
+    corrupt[4] ^= 0x01;
+    pzem.begin();
+    port.respond(corrupt, sizeof(corrupt));
+    IS_TRUE(pzem.poll() == PZEM_ERROR);
+
+    pzem.begin();
+    port.respond(readReply, 24);
+    advanceMillis(100);
+    IS_TRUE(pzem.poll() == PZEM_TIMEOUT);
+    IS_FALSE(pzem.result(reading));
+
+    END_IT
+}
+
+int test_modbus_settings()
+{
+    IT("resets the energy and changes the address");
+    HardwareSerial port;
+    PZEMModbus pzem(&port);
+
+    port.reply(resetEnergy, sizeof(resetEnergy));
+    IS_TRUE(pzem.resetEnergy());
+    IS_TRUE(port.sentLength() == 4);
+    IS_TRUE(memcmp(port.sent(), resetEnergy, 4) == 0);
+
+    // The meter echoes the write
+    port.clearSent();
+    port.reply(setAddress5, sizeof(setAddress5));
+    IS_TRUE(pzem.setAddress(0x05));
+    IS_TRUE(memcmp(port.sent(), setAddress5, 8) == 0);
+    port.clearSent();
+    pzem.begin();
+    IS_TRUE(port.sent()[0] == 0x05);
+
+    // Out of range, nothing is sent
+    port.clearSent();
+    IS_FALSE(pzem.setAddress(0x00));
+    IS_FALSE(pzem.setAddress(0xF8));
+    IS_TRUE(port.sentLength() == 0);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("PZEMModbus");
+    test_modbus_crc();
+    test_modbus_read_all();
+    test_modbus_async();
+    test_modbus_errors();
+    test_modbus_settings();
+
+    FINISH
+}
@@ -0,0 +1,201 @@
+#include "PZEM004T.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+#include <math.h>
+
+IPAddress ip(192,168,1,1);
+
+// Frames of the README, to and from 192.168.1.1
+uint8_t voltageRequest[] = {0xB0,0xC0,0xA8,0x01,0x01,0x00,0x1A};
+uint8_t voltageReply[] = {0xA0,0x00,0xE6,0x02,0x00,0x00,0x88};      // 230.2 V
+uint8_t currentReply[] = {0xA1,0x00,0x11,0x20,0x00,0x00,0xD2};      // 17.32 A
+uint8_t powerReply[] = {0xA2,0x08,0x98,0x00,0x00,0x00,0x42};        // 2200 W
+uint8_t energyReply[] = {0xA3,0x01,0x86,0x9F,0x00,0x00,0xC9};       // 99999 Wh
+
+bool near(float a, float b)
+{
+    return fabs(a - b) < 0.001;
+}
+
+int test_pzem_async()
+{
+    IT("sends a request and parses the reply as its bytes arrive");
+    HardwareSerial port;
+    PZEM004T pzem(&port);
+    IS_TRUE(port.baud() == 9600);
+    IS_TRUE(pzem.status() == PZEM_IDLE);
+
+    pzem.begin(ip, PZEM_VOLTAGE);
+    IS_TRUE(port.sentLength() == 7);
+    IS_TRUE(memcmp(port.sent(), voltageRequest, 7) == 0);
+    IS_TRUE(pzem.poll() == PZEM_BUSY);
+
+    port.respond(voltageReply, 3);
+    IS_TRUE(pzem.poll() == PZEM_BUSY);
+    IS_TRUE(near(pzem.value(), PZEM_ERROR_VALUE));
+    port.respond(voltageReply + 3, 4);
+    IS_TRUE(pzem.poll() == PZEM_DONE);
+    IS_TRUE(pzem.status() == PZEM_DONE);
+    IS_TRUE(near(pzem.value(), 230.2));
+
+    END_IT
+}
+
+int test_pzem_async_timeout()
+{
+    IT("times out a meter that does not answer");
+    HardwareSerial port;
+    PZEM004T pzem(&port);
+    pzem.setReadTimeout(100);
+
+    pzem.begin(ip, PZEM_CURRENT);
+    advanceMillis(99);
+    IS_TRUE(pzem.poll() == PZEM_BUSY);
+    advanceMillis(1);
+    IS_TRUE(pzem.poll() == PZEM_TIMEOUT);
+    IS_TRUE(near(pzem.value(), PZEM_ERROR_VALUE));
+
+    // A late reply is left for the next request to clear
+    port.respond(currentReply, 7);
+    IS_TRUE(pzem.poll() == PZEM_TIMEOUT);
+
+    END_IT
+}
+
+int test_pzem_async_error()
+{
+    IT("rejects a reply with a bad checksum or to another request");
+    HardwareSerial port;
+    PZEM004T pzem(&port);
+
+    pzem.begin(ip, PZEM_VOLTAGE);
+    uint8_t corrupt[7];
+    memcpy(corrupt, voltageReply, 7);
+    corrupt[2] ^= 0x01;
+    port.respond(corrupt, 7);
+    IS_TRUE(pzem.poll() == PZEM_ERROR);
+    IS_TRUE(near(pzem.value(), PZEM_ERROR_VALUE));
+
+    pzem.begin(ip, PZEM_VOLTAGE);
+    port.respond(currentReply, 7);
+    IS_TRUE(pzem.poll() == PZEM_ERROR);
+
+    // Zero bytes ahead of a reply are skipped
+    pzem.begin(ip, PZEM_ENERGY);
+    uint8_t zeros[] = {0x00,0x00};
+    port.respond(zeros, 2);
+    port.respond(energyReply, 7);
+    IS_TRUE(pzem.poll() == PZEM_DONE);
+    IS_TRUE(near(pzem.value(), 99999));
+
+    END_IT
+}
+
+int test_pzem_blocking()
+{
+    IT("answers the blocking reads through the same engine");
+    HardwareSerial port;
+    PZEM004T pzem(&port);
+
+    // Left over from an earlier exchange, and cleared before sending
+    port.respond(currentReply, 7);
+    port.reply(voltageReply, 7);
+    IS_TRUE(near(pzem.voltage(ip), 230.2));
+    port.reply(currentReply, 7);
+    IS_TRUE(near(pzem.current(ip), 17.32));
+    port.reply(powerReply, 7);
+    IS_TRUE(near(pzem.power(ip), 2200));
+    port.reply(energyReply, 7);
+    IS_TRUE(near(pzem.energy(ip), 99999));
+    IS_TRUE(pzem.status() == PZEM_DONE);
+
+    // No reply, given up after the read timeout
+    pzem.setReadTimeout(50);
+    unsigned long start = millis();
+    IS_TRUE(near(pzem.voltage(ip), PZEM_ERROR_VALUE));
+    IS_TRUE(millis() - start >= 50 && millis() - start <= 51);
+    IS_TRUE(pzem.status() == PZEM_TIMEOUT);
+
+    END_IT
+}
+
+int test_pzem_read_all()
+{
+    IT("reads all four quantities from replies in any order");
+    HardwareSerial port;
+    PZEM004T pzem(&port);
+
+    port.reply(energyReply, 7);
+    port.reply(voltageReply, 7);
+    port.reply(powerReply, 7);
+    port.reply(currentReply, 7);
+    PZEMReading reading;
+    IS_TRUE(pzem.readAll(ip, reading));
+    IS_TRUE(reading.valid == PZEM_VALID_ALL);
+    IS_TRUE(near(reading.voltage, 230.2));
+    IS_TRUE(near(reading.current, 17.32));
+    IS_TRUE(near(reading.power, 2200));
+    IS_TRUE(near(reading.energy, 99999));
+    // Not given by these meters
+    IS_TRUE(near(reading.frequency, PZEM_ERROR_VALUE));
+    IS_TRUE(near(reading.powerFactor, PZEM_ERROR_VALUE));
+
+    // The four requests go out back to back
+    IS_TRUE(port.sentLength() == 28);
+    IS_TRUE(memcmp(port.sent(), voltageRequest, 7) == 0);
+    for(int i=1; i<4; i++)
+    {
+        IS_TRUE(port.sent()[7 * i] == PZEM_VOLTAGE + i);
+        IS_TRUE(port.sent()[7 * i + 6] == voltageRequest[6] + i);
+    }
+    IS_TRUE(pzem.status() == PZEM_IDLE);
+
+    END_IT
+}
+
+int test_pzem_read_all_missing()
+{
+    IT("marks the quantities without a good reply once the timeout passes");
+    HardwareSerial port;
+    PZEM004T pzem(&port);
+    pzem.setReadTimeout(50);
+
+    uint8_t corrupt[7];
+    memcpy(corrupt, energyReply, 7);
+    corrupt[6]++;
+    port.reply(powerReply, 7);
+    port.reply(corrupt, 7);
+    port.reply(voltageReply, 7);
+    PZEMReading reading;
+    unsigned long start = millis();
+    IS_FALSE(pzem.readAll(ip, reading));
+    // One timeout for the whole exchange
+    IS_TRUE(millis() - start >= 50 && millis() - start <= 51);
+
+    IS_TRUE(reading.valid == (PZEM_VALID_VOLTAGE | PZEM_VALID_POWER));
+    IS_TRUE(near(reading.voltage, 230.2));
+    IS_TRUE(near(reading.power, 2200));
+    IS_TRUE(near(reading.current, PZEM_ERROR_VALUE));
+    IS_TRUE(near(reading.energy, PZEM_ERROR_VALUE));
+
+    // A silent meter gives nothing
+    IS_FALSE(pzem.readAll(ip, reading));
+    IS_TRUE(reading.valid == 0);
+    IS_TRUE(near(reading.voltage, PZEM_ERROR_VALUE));
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("PZEM004T");
+    test_pzem_async();
+    test_pzem_async_timeout();
+    test_pzem_async_error();
+    test_pzem_blocking();
+    test_pzem_read_all();
+    test_pzem_read_all_missing();
+
+    FINISH
+}
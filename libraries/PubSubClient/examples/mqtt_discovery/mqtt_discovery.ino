@@ -0,0 +1,77 @@
+/*
+ Discovery MQTT example
+
+ This sketch announces a voltage sensor and a relay to Home
+ Assistant. The entity table and its strings are kept in flash,
+ and each config message is streamed from there, so it may be
+ larger than the packet buffer. The client sends them all again
+ after every connect.
+
+ The states are published to "asc/node1/voltage1" and
+ "asc/node1/relay1", and the relay is switched by messages to
+ "asc/node1/relay1/set".
+
+*/
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <PubSubClient.h>
+#include <MQTTDiscovery.h>
+#include <MQTTReconnect.h>
+
+// Update these with values suitable for your hardware/network.
+byte mac[]    = {  0xDE, 0xED, 0xBA, 0xFE, 0xFE, 0xED };
+IPAddress ip(172, 16, 0, 100);
+IPAddress server(172, 16, 0, 2);
+
+const char nameVoltage[] PROGMEM = "Voltage";
+const char nameRelay[] PROGMEM = "Relay";
+const char unitVolt[] PROGMEM = "V";
+const char suffixVoltage[] PROGMEM = "voltage1";
+const char suffixRelay[] PROGMEM = "relay1";
+const char classVoltage[] PROGMEM = "voltage";
+
+const MQTTEntity entities[] PROGMEM = {
+  { MQTT_DISCOVERY_SENSOR, nameVoltage, unitVolt, suffixVoltage, classVoltage },
+  { MQTT_DISCOVERY_SWITCH, nameRelay, NULL, suffixRelay, NULL }
+};
+
+const char* topics[] = { "asc/node1/relay1/set" };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+EthernetClient ethClient;
+PubSubClient client(ethClient);
+MQTTReconnect reconnect(1000, 60000, 25, 0);
+MQTTDiscovery discovery("homeassistant", "asc_node1", "asc/node1");
+long lastMsg = 0;
+
+void setup()
+{
+  client.setServer(server, 1883);
+  client.setCallback(callback);
+
+  reconnect.setConnect("asc_node1")
+           .setSubscriptions(topics, NULL, 1);
+  client.setReconnect(reconnect);
+  discovery.setEntities(entities, 2)
+           .setDevice("ASC node 1");
+  client.setDiscovery(discovery);
+
+  Ethernet.begin(mac, ip);
+  delay(1500);
+}
+
+void loop()
+{
+  // Also reconnects, and sends the config messages after connecting
+  client.loop();
+
+  long now = millis();
+  if (client.connected() && now - lastMsg > 10000) {
+    lastMsg = now;
+    client.publish("asc/node1/voltage1", "230.1");
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ Binary payload MQTT example
+
+ This sketch sends a set of readings every 10 seconds as one
+ packed message on "sensor/readings", rather than publishing
+ each value as text on its own topic.
+
+ The message starts with the schema id (1, two bytes little-endian)
+ followed by the uptime in seconds and the three analog inputs as
+ floats, each four bytes little-endian.
+
+*/
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <PubSubClient.h>
+#include <MQTTPayload.h>
+
+// Update these with values suitable for your hardware/network.
+byte mac[]    = {  0xDE, 0xED, 0xBA, 0xFE, 0xFE, 0xED };
+IPAddress ip(172, 16, 0, 100);
+IPAddress server(172, 16, 0, 2);
+
+#define SCHEMA_READINGS 1
+
+EthernetClient ethClient;
+PubSubClient client(ethClient);
+uint8_t buffer[32];
+MQTTPayload payload(buffer, sizeof(buffer), MQTT_PAYLOAD_PACKED);
+
+long lastReconnectAttempt = 0;
+long lastReading = 0;
+
+void setup()
+{
+  client.setServer(server, 1883);
+
+  Ethernet.begin(mac, ip);
+  delay(1500);
+}
+
+void loop()
+{
+  long now = millis();
+  if (!client.connected()) {
+    if (now - lastReconnectAttempt > 5000) {
+      lastReconnectAttempt = now;
+      client.connect("arduinoClient");
+    }
+  } else {
+    client.loop();
+  }
+
+  if (now - lastReading > 10000) {
+    lastReading = now;
+    payload.begin(SCHEMA_READINGS);
+    payload.addUInt(now / 1000);
+    payload.addFloat(analogRead(A0) * 5.0 / 1023);
+    payload.addFloat(analogRead(A1) * 5.0 / 1023);
+    payload.addFloat(analogRead(A2) * 5.0 / 1023);
+    if (payload.end()) {
+      client.publish("sensor/readings", payload.data(), payload.length());
+    }
+  }
+}
@@ -0,0 +1,52 @@
+/*
+ Reconnecting MQTT example - with backoff
+
+ This sketch leaves reconnecting to the client. loop() tries to
+ connect 1 second after losing the connection, then waits twice
+ as long after each failed attempt, up to 2 minutes. Up to a
+ quarter of each wait is random, seeded from the MAC address,
+ so a number of these devices do not all return at the same
+ moment after the server restarts. After every connect the
+ client subscribes to "inTopic" again.
+
+*/
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <PubSubClient.h>
+#include <MQTTReconnect.h>
+
+// Update these with values suitable for your hardware/network.
+byte mac[]    = {  0xDE, 0xED, 0xBA, 0xFE, 0xFE, 0xED };
+IPAddress ip(172, 16, 0, 100);
+IPAddress server(172, 16, 0, 2);
+
+const char* topics[] = { "inTopic" };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+EthernetClient ethClient;
+PubSubClient client(ethClient);
+MQTTReconnect reconnect(1000, 120000, 25, 0);
+
+void setup()
+{
+  client.setServer(server, 1883);
+  client.setCallback(callback);
+
+  reconnect.setConnect("arduinoClient")
+           .setSubscriptions(topics, NULL, 1)
+           .setSeed(((uint32_t)mac[3] << 16) | (mac[4] << 8) | mac[5]);
+  client.setReconnect(reconnect);
+
+  Ethernet.begin(mac, ip);
+  delay(1500);
+}
+
+void loop()
+{
+  // Also connects, and reconnects when needed
+  client.loop();
+}
@@ -0,0 +1,77 @@
+/*
+ Report by exception MQTT example
+
+ This sketch reads a voltage and a current every second, but
+ only publishes a reading when it has moved by more than a
+ set amount since it was last sent: 0.5 V for the voltage and
+ 0.05 A for the current. Steady readings are still sent every
+ 10 minutes, so the server can tell the device is alive.
+
+ The readings go to "meter-01/voltage" and "meter-01/current".
+
+*/
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <PubSubClient.h>
+#include <MQTTReport.h>
+
+// Update these with values suitable for your hardware/network.
+byte mac[]    = {  0xDE, 0xED, 0xBA, 0xFE, 0xFE, 0xED };
+IPAddress ip(172, 16, 0, 100);
+IPAddress server(172, 16, 0, 2);
+
+const char voltage[] PROGMEM = "voltage";
+const char current[] PROGMEM = "current";
+const char* const topics[] PROGMEM = { voltage, current };
+
+#define VOLTAGE 0
+#define CURRENT 1
+
+EthernetClient ethClient;
+PubSubClient client(ethClient);
+MQTTReportEntry entries[2];
+MQTTReport report(client, entries, 2);
+long lastRead = 0;
+
+void reconnect() {
+  // Loop until we're reconnected
+  while (!client.connected()) {
+    if (client.connect("meter-01")) {
+      // The server may have missed changes while we were away
+      report.resend();
+    } else {
+      // Wait 5 seconds before retrying
+      delay(5000);
+    }
+  }
+}
+
+void setup()
+{
+  client.setServer(server, 1883);
+  client.setTopicPrefix("meter-01/");
+  client.setTopicTable(topics, 2);
+
+  report.setDeadband(VOLTAGE, 5, 1)
+        .setDeadband(CURRENT, 5, 2)
+        .setMaxSilence(600);
+
+  Ethernet.begin(mac, ip);
+  delay(1500);
+}
+
+void loop()
+{
+  if (!client.connected()) {
+    reconnect();
+  }
+  client.loop();
+
+  long now = millis();
+  if (now - lastRead > 1000) {
+    lastRead = now;
+    report.report(VOLTAGE, analogRead(A0) * 0.3f);
+    report.report(CURRENT, analogRead(A1) * 0.01f);
+  }
+}
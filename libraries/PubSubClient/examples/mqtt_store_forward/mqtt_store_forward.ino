@@ -0,0 +1,82 @@
+/*
+ Store-and-forward MQTT example
+
+ This sketch publishes a reading every 10 seconds. While the
+ client is disconnected the readings are kept in the EEPROM,
+ and once it has reconnected they are sent from loop(), one
+ every 500ms, before any newer reading.
+
+*/
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <EEPROM.h>
+#include <PubSubClient.h>
+#include <MQTTStore.h>
+
+// Update these with values suitable for your hardware/network.
+byte mac[]    = {  0xDE, 0xED, 0xBA, 0xFE, 0xFE, 0xED };
+IPAddress ip(172, 16, 0, 100);
+IPAddress server(172, 16, 0, 2);
+
+// Keeps the store in the EEPROM, from offset 0
+class EEPROMStorage : public MQTTStorage {
+public:
+  uint32_t size() {
+    return EEPROM.length();
+  }
+  void read(uint32_t address, uint8_t* buf, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+      buf[i] = EEPROM.read(address+i);
+    }
+  }
+  void write(uint32_t address, const uint8_t* buf, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+      EEPROM.update(address+i,buf[i]);
+    }
+  }
+};
+
+// Stored messages refer to their topic by its index in this table
+const char* topics[] = { "sensor/temperature", "sensor/humidity" };
+
+EthernetClient ethClient;
+PubSubClient client(ethClient);
+EEPROMStorage storage;
+MQTTStore store(storage);
+
+long lastReconnectAttempt = 0;
+long lastReading = 0;
+
+void setup()
+{
+  client.setServer(server, 1883);
+  client.setStore(store, topics, 2);
+  client.setStoreDrainRate(1, 500);
+
+  Ethernet.begin(mac, ip);
+  delay(1500);
+}
+
+void loop()
+{
+  long now = millis();
+  if (!client.connected()) {
+    if (now - lastReconnectAttempt > 5000) {
+      lastReconnectAttempt = now;
+      client.connect("arduinoClient");
+    }
+  } else {
+    // Also sends the stored messages
+    client.loop();
+  }
+
+  if (now - lastReading > 10000) {
+    lastReading = now;
+    char payload[8];
+    itoa(analogRead(A0), payload, 10);
+    client.publishOrStore(0, payload);
+    itoa(analogRead(A1), payload, 10);
+    client.publishOrStore(1, payload);
+  }
+}
@@ -0,0 +1,62 @@
+/*
+ Streaming receive MQTT example
+
+  - connects to an MQTT server
+  - subscribes to the topic "config"
+  - writes each message received on it straight to the EEPROM,
+    a piece at a time, so it can be larger than the client buffer
+
+*/
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include <EEPROM.h>
+#include <PubSubClient.h>
+
+// Update these with values suitable for your network.
+byte mac[]    = {  0xDE, 0xED, 0xBA, 0xFE, 0xFE, 0xED };
+IPAddress ip(172, 16, 0, 100);
+IPAddress server(172, 16, 0, 2);
+
+EthernetClient ethClient;
+PubSubClient client(ethClient);
+
+unsigned int address;
+boolean accept;
+
+void messageBegin(char* topic, uint32_t length) {
+  address = 0;
+  accept = (strcmp(topic, "config") == 0 && length <= EEPROM.length());
+}
+
+void messageData(uint8_t* data, unsigned int length) {
+  if (accept) {
+    for (unsigned int i = 0; i < length; i++) {
+      EEPROM.update(address++, data[i]);
+    }
+  }
+}
+
+void messageEnd(boolean complete) {
+  if (accept && complete) {
+    Serial.print("Stored ");
+    Serial.print(address);
+    Serial.println(" bytes of config");
+  }
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  Ethernet.begin(mac, ip);
+  client.setServer(server, 1883);
+  client.setMessageCallbacks(messageBegin, messageData, messageEnd);
+  if (client.connect("arduinoClient")) {
+    client.subscribe("config");
+  }
+}
+
+void loop()
+{
+  client.loop();
+}
@@ -0,0 +1,139 @@
+/*
+  MQTTDiscovery.cpp - Home Assistant style discovery messages for PubSubClient.
+*/
+
+#include "MQTTDiscovery.h"
+#include "PubSubClient.h"
+
+#ifndef pgm_read_ptr
+#define pgm_read_ptr(addr) ((const void*)pgm_read_word(addr))
+#endif
+
+static const char componentSensor[] PROGMEM = "sensor";
+static const char componentBinarySensor[] PROGMEM = "binary_sensor";
+static const char componentSwitch[] PROGMEM = "switch";
+static const char componentNumber[] PROGMEM = "number";
+static const char* const components[] PROGMEM = {
+    componentSensor, componentBinarySensor, componentSwitch, componentNumber
+};
+
+MQTTDiscovery::MQTTDiscovery(const char* prefix, const char* nodeId, const char* baseTopic) {
+    this->_prefix = prefix;
+    this->_nodeId = nodeId;
+    this->_baseTopic = baseTopic;
+    this->_device = NULL;
+    this->_entities = NULL;
+    this->_count = 0;
+    this->_next = 0;
+}
+
+MQTTDiscovery& MQTTDiscovery::setEntities(const MQTTEntity* entities, uint8_t count) {
+    this->_entities = entities;
+    this->_count = count;
+    this->_next = 0;
+    return *this;
+}
+
+MQTTDiscovery& MQTTDiscovery::setDevice(const char* name) {
+    this->_device = name;
+    return *this;
+}
+
+uint8_t MQTTDiscovery::pending() {
+    return _count - _next;
+}
+
+void MQTTDiscovery::restart() {
+    _next = 0;
+}
+
+uint16_t MQTTDiscovery::put(PubSubClient* client, const char* string, boolean progmem) {
+    uint16_t length = progmem ? strlen_P(string) : strlen(string);
+    if (client != NULL) {
+        if (progmem) {
+            client->writeP((const uint8_t*)string,length);
+        } else {
+            client->write((const uint8_t*)string,length);
+        }
+    }
+    return length;
+}
+
+uint16_t MQTTDiscovery::writePayload(PubSubClient* client, const MQTTEntity& entity) {
+    // With no client only the length is counted, so both passes produce the
+    // same bytes. The literals stay in flash like the entity strings.
+    uint16_t length = 0;
+    length += put(client,PSTR("{\"~\":\""),true);
+    length += put(client,_baseTopic,false);
+    length += put(client,PSTR("\",\"name\":\""),true);
+    length += put(client,entity.name,true);
+    length += put(client,PSTR("\",\"stat_t\":\"~/"),true);
+    length += put(client,entity.suffix,true);
+    if (entity.component == MQTT_DISCOVERY_SWITCH || entity.component == MQTT_DISCOVERY_NUMBER) {
+        length += put(client,PSTR("\",\"cmd_t\":\"~/"),true);
+        length += put(client,entity.suffix,true);
+        length += put(client,PSTR("/set"),true);
+    }
+    if (entity.unit != NULL) {
+        length += put(client,PSTR("\",\"unit_of_meas\":\""),true);
+        length += put(client,entity.unit,true);
+    }
+    if (entity.deviceClass != NULL) {
+        length += put(client,PSTR("\",\"dev_cla\":\""),true);
+        length += put(client,entity.deviceClass,true);
+    }
+    length += put(client,PSTR("\",\"uniq_id\":\""),true);
+    length += put(client,_nodeId,false);
+    length += put(client,PSTR("_"),true);
+    length += put(client,entity.suffix,true);
+    if (_device != NULL) {
+        length += put(client,PSTR("\",\"dev\":{\"ids\":\""),true);
+        length += put(client,_nodeId,false);
+        length += put(client,PSTR("\",\"name\":\""),true);
+        length += put(client,_device,false);
+        length += put(client,PSTR("\"}}"),true);
+    } else {
+        length += put(client,PSTR("\"}"),true);
+    }
+    return length;
+}
+
+boolean MQTTDiscovery::publish(PubSubClient& client, uint8_t index) {
+    if (_entities == NULL || index >= _count) {
+        return false;
+    }
+    MQTTEntity entity;
+    memcpy_P(&entity,&_entities[index],sizeof(MQTTEntity));
+    if (entity.component >= sizeof(components)/sizeof(components[0])) {
+        return false;
+    }
+    const char* component = (const char*)pgm_read_ptr(&components[entity.component]);
+
+    uint16_t plen = strlen(_prefix);
+    uint16_t clen = strlen_P(component);
+    uint16_t nlen = strlen(_nodeId);
+    uint16_t slen = strlen_P(entity.suffix);
+    if (plen + clen + nlen + slen + 11 > MQTT_DISCOVERY_TOPIC_SIZE) {
+        return false;
+    }
+    char topic[MQTT_DISCOVERY_TOPIC_SIZE];
+    uint16_t pos = 0;
+    memcpy(topic+pos,_prefix,plen);
+    pos += plen;
+    topic[pos++] = '/';
+    memcpy_P(topic+pos,component,clen);
+    pos += clen;
+    topic[pos++] = '/';
+    memcpy(topic+pos,_nodeId,nlen);
+    pos += nlen;
+    topic[pos++] = '/';
+    memcpy_P(topic+pos,entity.suffix,slen);
+    pos += slen;
+    memcpy_P(topic+pos,PSTR("/config"),8);
+
+    if (!client.beginPublish(topic,writePayload(NULL,entity),true)) {
+        return false;
+    }
+    writePayload(&client,entity);
+    return client.endPublish();
+}
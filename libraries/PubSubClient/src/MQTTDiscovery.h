@@ -0,0 +1,76 @@
+/*
+ MQTTDiscovery.h - Home Assistant style discovery messages for PubSubClient.
+*/
+
+#ifndef MQTTDiscovery_h
+#define MQTTDiscovery_h
+
+#include <Arduino.h>
+
+// MQTT_DISCOVERY_TOPIC_SIZE : longest discovery topic, built on the stack
+#ifndef MQTT_DISCOVERY_TOPIC_SIZE
+#define MQTT_DISCOVERY_TOPIC_SIZE 96
+#endif
+
+// MQTT_DISCOVERY_BATCH : most discovery messages sent by each call to loop()
+#ifndef MQTT_DISCOVERY_BATCH
+#define MQTT_DISCOVERY_BATCH 4
+#endif
+
+// Entity components. Switches and numbers are also given a command topic,
+// the state topic followed by /set.
+#define MQTT_DISCOVERY_SENSOR        0
+#define MQTT_DISCOVERY_BINARY_SENSOR 1
+#define MQTT_DISCOVERY_SWITCH        2
+#define MQTT_DISCOVERY_NUMBER        3
+
+class PubSubClient;
+
+// One entry of the entity table. The table and its strings live in PROGMEM.
+// unit and deviceClass may be NULL. The suffix is appended to the base topic
+// to give the state topic, and to the node id to give the unique id, so it
+// should only hold letters, digits, - and _. No string may contain a quote.
+struct MQTTEntity {
+   uint8_t component;
+   const char* name;
+   const char* unit;
+   const char* suffix;
+   const char* deviceClass;
+};
+
+// Sends a retained config message for each entity of a table, to
+// <prefix>/<component>/<nodeId>/<suffix>/config. Each message is streamed
+// from flash with beginPublish(), so it may be larger than the packet buffer.
+// Once set on a client, the messages are sent again after every connect.
+class MQTTDiscovery {
+private:
+   friend class PubSubClient;
+   const char* _prefix;
+   const char* _nodeId;
+   const char* _baseTopic;
+   const char* _device;
+   const MQTTEntity* _entities;
+   uint8_t _count;
+   uint8_t _next;
+   uint16_t put(PubSubClient* client, const char* string, boolean progmem);
+   uint16_t writePayload(PubSubClient* client, const MQTTEntity& entity);
+public:
+   // prefix is the discovery prefix, usually "homeassistant". baseTopic is
+   // where the entities publish their state. The strings must outlive this.
+   MQTTDiscovery(const char* prefix, const char* nodeId, const char* baseTopic);
+
+   // Set the PROGMEM table of count entities
+   MQTTDiscovery& setEntities(const MQTTEntity* entities, uint8_t count);
+   // Group the entities under a device of this name
+   MQTTDiscovery& setDevice(const char* name);
+
+   // Publish the config message of entity index
+   // Returns 1 if it was sent, 0 otherwise
+   boolean publish(PubSubClient& client, uint8_t index);
+   // Number of entities still to be sent on this connection
+   uint8_t pending();
+   // Send every entity again, such as when the server announces a restart
+   void restart();
+};
+
+#endif
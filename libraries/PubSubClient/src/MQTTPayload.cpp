@@ -0,0 +1,110 @@
+/*
+  MQTTPayload.cpp - Compact binary payload encoder for PubSubClient.
+*/
+
+#include "MQTTPayload.h"
+
+MQTTPayload::MQTTPayload(uint8_t* buf, uint16_t size, uint8_t format) {
+    this->_buf = buf;
+    this->_size = size;
+    this->_format = format;
+    this->_length = 0;
+    this->_failed = false;
+}
+
+void MQTTPayload::put(uint8_t b) {
+    if (_length < _size) {
+        _buf[_length++] = b;
+    } else {
+        _failed = true;
+    }
+}
+
+void MQTTPayload::putLE(uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        put(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+void MQTTPayload::putCBOR(uint8_t major, uint32_t value) {
+    // Shortest encoding of the argument, big-endian
+    major <<= 5;
+    if (value < 24) {
+        put(major | value);
+    } else if (value <= 0xFF) {
+        put(major | 24);
+        put(value);
+    } else if (value <= 0xFFFF) {
+        put(major | 25);
+        put(value >> 8);
+        put(value & 0xFF);
+    } else {
+        put(major | 26);
+        put(value >> 24);
+        put((value >> 16) & 0xFF);
+        put((value >> 8) & 0xFF);
+        put(value & 0xFF);
+    }
+}
+
+void MQTTPayload::begin(uint16_t schemaId) {
+    _length = 0;
+    _failed = false;
+    if (_format == MQTT_PAYLOAD_CBOR) {
+        // Indefinite length array
+        put(0x9F);
+        putCBOR(0,schemaId);
+    } else {
+        putLE(schemaId,2);
+    }
+}
+
+void MQTTPayload::addFloat(float value) {
+    uint32_t bits;
+    memcpy(&bits,&value,4);
+    if (_format == MQTT_PAYLOAD_CBOR) {
+        put(0xFA);
+        put(bits >> 24);
+        put((bits >> 16) & 0xFF);
+        put((bits >> 8) & 0xFF);
+        put(bits & 0xFF);
+    } else {
+        putLE(bits,4);
+    }
+}
+
+void MQTTPayload::addInt(int32_t value) {
+    if (_format == MQTT_PAYLOAD_CBOR) {
+        if (value < 0) {
+            putCBOR(1,(uint32_t)(-1-value));
+        } else {
+            putCBOR(0,value);
+        }
+    } else {
+        putLE((uint32_t)value,4);
+    }
+}
+
+void MQTTPayload::addUInt(uint32_t value) {
+    if (_format == MQTT_PAYLOAD_CBOR) {
+        putCBOR(0,value);
+    } else {
+        putLE(value,4);
+    }
+}
+
+boolean MQTTPayload::end() {
+    if (_format == MQTT_PAYLOAD_CBOR) {
+        put(0xFF);
+    }
+    return !_failed;
+}
+
+const uint8_t* MQTTPayload::data() {
+    return _buf;
+}
+
+uint16_t MQTTPayload::length() {
+    return _length;
+}
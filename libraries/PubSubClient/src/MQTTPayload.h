@@ -0,0 +1,47 @@
+/*
+ MQTTPayload.h - Compact binary payload encoder for PubSubClient.
+*/
+
+#ifndef MQTTPayload_h
+#define MQTTPayload_h
+
+#include <Arduino.h>
+
+// Payload formats
+//  MQTT_PAYLOAD_PACKED : the schema id in 2 bytes, then each value in 4 bytes,
+//                        both little-endian
+//  MQTT_PAYLOAD_CBOR   : an indefinite CBOR array of the schema id then each value
+#define MQTT_PAYLOAD_PACKED 0
+#define MQTT_PAYLOAD_CBOR   1
+
+// Serialises a set of readings into one message, so a cycle of readings can
+// go out as a single publish without formatting floats as text.
+// The schema id tells the receiver which values follow, and in what order.
+class MQTTPayload {
+private:
+   uint8_t* _buf;
+   uint16_t _size;
+   uint16_t _length;
+   uint8_t _format;
+   boolean _failed;
+   void put(uint8_t b);
+   void putLE(uint32_t value, uint8_t bytes);
+   void putCBOR(uint8_t major, uint32_t value);
+public:
+   // buf is caller supplied storage for up to size bytes
+   MQTTPayload(uint8_t* buf, uint16_t size, uint8_t format);
+
+   // Start a new message
+   void begin(uint16_t schemaId);
+   void addFloat(float value);
+   void addInt(int32_t value);
+   void addUInt(uint32_t value);
+   // Finish the message
+   // Returns 1 if it fitted in the buffer, 0 otherwise
+   boolean end();
+
+   const uint8_t* data();
+   uint16_t length();
+};
+
+#endif
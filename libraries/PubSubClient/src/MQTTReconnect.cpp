@@ -0,0 +1,146 @@
+/*
+  MQTTReconnect.cpp - Reconnect policy for PubSubClient.
+*/
+
+#include "MQTTReconnect.h"
+
+MQTTReconnect::MQTTReconnect(uint32_t minDelay, uint32_t maxDelay, uint8_t jitter, uint16_t maxAttempts) {
+    this->_minDelay = minDelay;
+    this->_maxDelay = (maxDelay > minDelay) ? maxDelay : minDelay;
+    this->_jitter = (jitter < 100) ? jitter : 100;
+    this->_maxAttempts = maxAttempts;
+    // Taken from the clock on first use unless setSeed() is called
+    this->_seed = 0;
+    this->_id = NULL;
+    this->_user = NULL;
+    this->_pass = NULL;
+    this->_willTopic = NULL;
+    this->_willQos = 0;
+    this->_willRetain = false;
+    this->_willMessage = NULL;
+    this->_cleanSession = true;
+    this->_topics = NULL;
+    this->_qos = NULL;
+    this->_topicCount = 0;
+    reset();
+}
+
+MQTTReconnect& MQTTReconnect::setConnect(const char* id) {
+    return setConnect(id,NULL,NULL);
+}
+
+MQTTReconnect& MQTTReconnect::setConnect(const char* id, const char* user, const char* pass) {
+    this->_id = id;
+    this->_user = user;
+    this->_pass = pass;
+    return *this;
+}
+
+MQTTReconnect& MQTTReconnect::setWill(const char* topic, uint8_t qos, boolean retain, const char* message) {
+    this->_willTopic = topic;
+    this->_willQos = qos;
+    this->_willRetain = retain;
+    this->_willMessage = message;
+    return *this;
+}
+
+MQTTReconnect& MQTTReconnect::setCleanSession(boolean cleanSession) {
+    this->_cleanSession = cleanSession;
+    return *this;
+}
+
+MQTTReconnect& MQTTReconnect::setSubscriptions(const char* const* topics, const uint8_t* qos, uint8_t count) {
+    this->_topics = topics;
+    this->_qos = qos;
+    this->_topicCount = count;
+    return *this;
+}
+
+MQTTReconnect& MQTTReconnect::setSeed(uint32_t seed) {
+    if (seed != 0) {
+        this->_seed = seed;
+    }
+    return *this;
+}
+
+uint32_t MQTTReconnect::nextRandom() {
+    if (_seed == 0) {
+        // The first failed attempt ends at a time that differs between
+        // devices, as it depends on how long their network took to fail
+        _seed = micros() ^ 2463534242UL;
+        if (_seed == 0) {
+            _seed = 2463534242UL;
+        }
+    }
+    // xorshift32, so the sequence depends only on the seed
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+}
+
+uint32_t MQTTReconnect::backoff() {
+    uint32_t wait = _minDelay;
+    for (uint16_t i = 1; i < _attempts && wait < _maxDelay; i++) {
+        wait <<= 1;
+    }
+    if (wait > _maxDelay) {
+        wait = _maxDelay;
+    }
+    if (_jitter > 0) {
+        // Up to wait * jitter / 100, without overflowing
+        wait -= nextRandom() % (wait / 100 * _jitter + wait % 100 * _jitter / 100 + 1);
+    }
+    return wait;
+}
+
+boolean MQTTReconnect::due(unsigned long t) {
+    if (_state != MQTT_RECONNECT_WAITING || exhausted()) {
+        return false;
+    }
+    return t - _last >= _wait;
+}
+
+void MQTTReconnect::attempt() {
+    _state = MQTT_RECONNECT_PENDING;
+}
+
+void MQTTReconnect::failed(unsigned long t) {
+    _attempts++;
+    _state = MQTT_RECONNECT_WAITING;
+    _last = t;
+    _wait = backoff();
+}
+
+void MQTTReconnect::connected() {
+    _attempts = 0;
+    _state = MQTT_RECONNECT_CONNECTED;
+}
+
+void MQTTReconnect::lost(unsigned long t) {
+    // Wait before the first attempt too, as every other client of the
+    // server may have just lost its connection as well
+    _attempts = 0;
+    _state = MQTT_RECONNECT_WAITING;
+    _last = t;
+    _wait = backoff();
+}
+
+uint16_t MQTTReconnect::getAttempts() {
+    return _attempts;
+}
+
+uint32_t MQTTReconnect::getDelay() {
+    return _wait;
+}
+
+boolean MQTTReconnect::exhausted() {
+    return _maxAttempts != 0 && _attempts >= _maxAttempts;
+}
+
+void MQTTReconnect::reset() {
+    _attempts = 0;
+    _state = MQTT_RECONNECT_WAITING;
+    _last = 0;
+    _wait = 0;
+}
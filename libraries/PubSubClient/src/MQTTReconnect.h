@@ -0,0 +1,81 @@
+/*
+ MQTTReconnect.h - Reconnect policy for PubSubClient.
+*/
+
+#ifndef MQTTReconnect_h
+#define MQTTReconnect_h
+
+#include <Arduino.h>
+
+// States of the policy
+#define MQTT_RECONNECT_WAITING   0
+#define MQTT_RECONNECT_PENDING   1
+#define MQTT_RECONNECT_CONNECTED 2
+
+class PubSubClient;
+
+// Reconnects a PubSubClient from loop() without blocking, backing off
+// exponentially between failed attempts. Part of each wait is random so that
+// devices dropped by the same server restart do not all return at once.
+class MQTTReconnect {
+private:
+   friend class PubSubClient;
+   uint32_t _minDelay;
+   uint32_t _maxDelay;
+   uint8_t _jitter;
+   uint16_t _maxAttempts;
+   uint16_t _attempts;
+   uint8_t _state;
+   unsigned long _last;
+   uint32_t _wait;
+   uint32_t _seed;
+   const char* _id;
+   const char* _user;
+   const char* _pass;
+   const char* _willTopic;
+   uint8_t _willQos;
+   boolean _willRetain;
+   const char* _willMessage;
+   boolean _cleanSession;
+   const char* const* _topics;
+   const uint8_t* _qos;
+   uint8_t _topicCount;
+   uint32_t nextRandom();
+   uint32_t backoff();
+   // Called by the client
+   boolean due(unsigned long t);
+   void attempt();
+   void failed(unsigned long t);
+   void connected();
+   void lost(unsigned long t);
+public:
+   // Wait from minDelay up to maxDelay milliseconds between attempts, doubling
+   // after each failure, less a random part of up to jitter percent.
+   // Give up after maxAttempts failures in a row, or never if it is 0.
+   MQTTReconnect(uint32_t minDelay, uint32_t maxDelay, uint8_t jitter, uint16_t maxAttempts);
+
+   // Connect with these parameters, as for PubSubClient::connect(). The strings
+   // must outlive the policy.
+   MQTTReconnect& setConnect(const char* id);
+   MQTTReconnect& setConnect(const char* id, const char* user, const char* pass);
+   MQTTReconnect& setWill(const char* topic, uint8_t qos, boolean retain, const char* message);
+   MQTTReconnect& setCleanSession(boolean cleanSession);
+   // Subscribe to count topic filters after every connect. qos may be NULL to
+   // subscribe at QoS 0. The arrays must outlive the policy.
+   MQTTReconnect& setSubscriptions(const char* const* topics, const uint8_t* qos, uint8_t count);
+   // Seed the random part of the waits with something that differs between
+   // devices, such as the end of the MAC address. Without it, micros() at the
+   // first failed attempt is used.
+   MQTTReconnect& setSeed(uint32_t seed);
+
+   // Number of failed attempts since the last connection
+   uint16_t getAttempts();
+   // The current wait before the next attempt, in milliseconds
+   uint32_t getDelay();
+   // Returns 1 once maxAttempts attempts have failed
+   boolean exhausted();
+   // Start attempting again, straight away
+   void reset();
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*
+  MQTTReport.cpp - Report by exception for PubSubClient.
+*/
+
+#include "MQTTReport.h"
+#include "PubSubClient.h"
+
+// Set while the entry holds a value that was sent
+#define MQTT_REPORT_SENT 0x01
+
+MQTTReport::MQTTReport(PubSubClient& client, MQTTReportEntry* entries, uint8_t count) {
+    this->_client = &client;
+    this->_entries = entries;
+    this->_count = count;
+    this->_maxSilence = 0;
+    this->_retained = false;
+    for (uint8_t i = 0; i < count; i++) {
+        entries[i].last = 0;
+        entries[i].deadband = 0;
+        entries[i].sentAt = 0;
+        entries[i].decimals = 0;
+        entries[i].flags = 0;
+    }
+}
+
+MQTTReport& MQTTReport::setDeadband(uint8_t handle, uint16_t deadband, uint8_t decimals) {
+    if (handle < _count) {
+        _entries[handle].deadband = deadband;
+        _entries[handle].decimals = (decimals < 9) ? decimals : 9;
+    }
+    return *this;
+}
+
+MQTTReport& MQTTReport::setMaxSilence(uint16_t seconds) {
+    this->_maxSilence = seconds;
+    return *this;
+}
+
+MQTTReport& MQTTReport::setRetained(boolean retained) {
+    this->_retained = retained;
+    return *this;
+}
+
+void MQTTReport::resend() {
+    for (uint8_t i = 0; i < _count; i++) {
+        _entries[i].flags &= ~MQTT_REPORT_SENT;
+    }
+}
+
+boolean MQTTReport::report(uint8_t handle, float value) {
+    if (handle >= _count) {
+        return false;
+    }
+    for (uint8_t i = 0; i < _entries[handle].decimals; i++) {
+        value *= 10;
+    }
+    return report(handle,(long)(value < 0 ? value - 0.5f : value + 0.5f));
+}
+
+boolean MQTTReport::report(uint8_t handle, int value) {
+    return report(handle,(long)value);
+}
+
+boolean MQTTReport::report(uint8_t handle, long v) {
+    if (handle >= _count) {
+        return false;
+    }
+    int32_t value = (int32_t)v;
+    MQTTReportEntry* entry = &_entries[handle];
+    // Seconds wrap after 18 hours, which only matters to longer silences
+    uint16_t now = millis() / 1000;
+    if (entry->flags & MQTT_REPORT_SENT) {
+        uint32_t change = (value > entry->last) ? (uint32_t)value - entry->last : (uint32_t)entry->last - value;
+        boolean moved = (change > 0 && change >= entry->deadband);
+        boolean silent = (_maxSilence > 0 && (uint16_t)(now - entry->sentAt) >= _maxSilence);
+        if (!moved && !silent) {
+            return false;
+        }
+    }
+    char buf[13];
+    uint8_t length = format(buf,value,entry->decimals);
+    if (!_client->publishTopic(handle,(const uint8_t*)buf,length,_retained)) {
+        // Left as it was, so the next report tries again
+        return false;
+    }
+    entry->last = value;
+    entry->sentAt = now;
+    entry->flags |= MQTT_REPORT_SENT;
+    return true;
+}
+
+uint8_t MQTTReport::format(char* buf, int32_t value, uint8_t decimals) {
+    // Digits are written backwards from the end of a scratch area
+    char digits[12];
+    uint8_t n = 0;
+    uint32_t v = (value < 0) ? (uint32_t)0 - (uint32_t)value : (uint32_t)value;
+    do {
+        digits[n++] = '0' + (v % 10);
+        v /= 10;
+    } while (v > 0 || n <= decimals);
+    uint8_t pos = 0;
+    if (value < 0) {
+        buf[pos++] = '-';
+    }
+    while (n > 0) {
+        if (n == decimals) {
+            buf[pos++] = '.';
+        }
+        buf[pos++] = digits[--n];
+    }
+    return pos;
+}
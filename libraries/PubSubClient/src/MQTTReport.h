@@ -0,0 +1,59 @@
+/*
+ MQTTReport.h - Report by exception for PubSubClient.
+*/
+
+#ifndef MQTTReport_h
+#define MQTTReport_h
+
+#include <Arduino.h>
+
+class PubSubClient;
+
+// What is kept for each topic handle. The value is held as a whole number
+// of 10^-decimals units, and the time it was sent in seconds, so an entry
+// stays small. The caller supplies an array of them.
+struct MQTTReportEntry {
+   int32_t last;
+   uint16_t deadband;
+   uint16_t sentAt;
+   uint8_t decimals;
+   uint8_t flags;
+};
+
+// Publishes a value only when it has moved by at least the deadband since
+// it was last sent, or when it has not been sent for the max silence, so
+// steady readings do not keep going out. Handle i publishes to entry i of
+// the client's setTopicTable() table.
+class MQTTReport {
+private:
+   PubSubClient* _client;
+   MQTTReportEntry* _entries;
+   uint8_t _count;
+   uint16_t _maxSilence;
+   boolean _retained;
+   static uint8_t format(char* buf, int32_t value, uint8_t decimals);
+public:
+   // entries is caller supplied storage for count handles
+   MQTTReport(PubSubClient& client, MQTTReportEntry* entries, uint8_t count);
+
+   // Values of handle are sent with decimals digits after the point, once
+   // they have moved by deadband units of the last digit. A deadband of 0
+   // sends every change.
+   MQTTReport& setDeadband(uint8_t handle, uint16_t deadband, uint8_t decimals);
+   // Send a value that has not changed after seconds, 0 to never repeat it
+   MQTTReport& setMaxSilence(uint16_t seconds);
+   MQTTReport& setRetained(boolean retained);
+
+   // Offer a value, in units of the last digit (230.1 V at 1 decimal is 2301)
+   // Returns 1 if it was published, 0 if it was held back or the publish failed
+   // Values are kept as 32 bits. Both int and long are taken so that neither
+   // is ambiguous with float where int32_t is the other one, such as on AVR.
+   boolean report(uint8_t handle, long value);
+   boolean report(uint8_t handle, int value);
+   // As above, rounded to the decimals of handle
+   boolean report(uint8_t handle, float value);
+   // Send every handle on its next report, such as after reconnecting
+   void resend();
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+  MQTTRouter.cpp - Subscription dispatch table for PubSubClient.
+*/
+
+#include "MQTTRouter.h"
+
+MQTTRouter::MQTTRouter(MQTTRoute* routes, uint8_t size) {
+    this->_routes = routes;
+    this->_size = (size < MQTT_ROUTE_NONE) ? size : MQTT_ROUTE_NONE - 1;
+    clear();
+}
+
+uint16_t MQTTRouter::hash(const char* topic) {
+    // FNV-1a, folded to 16 bits
+    uint32_t h = 2166136261UL;
+    while (*topic) {
+        h ^= (uint8_t)*topic++;
+        h *= 16777619UL;
+    }
+    return (h >> 16) ^ (h & 0xFFFF);
+}
+
+boolean MQTTRouter::add(const char* filter, MQTTHandler handler, void* context) {
+    if (_count >= _size || filter == NULL || *filter == 0 || handler == NULL) {
+        return false;
+    }
+    boolean wildcard = false;
+    for (const char* p = filter; *p; p++) {
+        if (*p == '+' || *p == '#') {
+            // Wildcards must take up a whole level, and # must be the last one
+            if ((p != filter && p[-1] != '/') || (p[1] != 0 && (*p == '#' || p[1] != '/'))) {
+                return false;
+            }
+            wildcard = true;
+        }
+    }
+    MQTTRoute* route = &_routes[_count];
+    route->filter = filter;
+    route->handler = handler;
+    route->context = context;
+    route->next = MQTT_ROUTE_NONE;
+    if (wildcard) {
+        route->hash = 0;
+        // Keep the wildcard routes in the order they were added
+        uint8_t* last = &_wildcards;
+        while (*last != MQTT_ROUTE_NONE) {
+            last = &_routes[*last].next;
+        }
+        *last = _count;
+    } else {
+        route->hash = hash(filter);
+        uint8_t* last = &_buckets[route->hash % MQTT_ROUTER_BUCKETS];
+        while (*last != MQTT_ROUTE_NONE) {
+            last = &_routes[*last].next;
+        }
+        *last = _count;
+    }
+    _count++;
+    return true;
+}
+
+void MQTTRouter::clear() {
+    _count = 0;
+    _wildcards = MQTT_ROUTE_NONE;
+    memset(_buckets,MQTT_ROUTE_NONE,sizeof(_buckets));
+}
+
+uint8_t MQTTRouter::count() {
+    return _count;
+}
+
+uint8_t MQTTRouter::dispatch(char* topic, uint8_t* payload, unsigned int length) {
+    uint8_t called = 0;
+    uint16_t h = hash(topic);
+    for (uint8_t i = _buckets[h % MQTT_ROUTER_BUCKETS]; i != MQTT_ROUTE_NONE; i = _routes[i].next) {
+        MQTTRoute* route = &_routes[i];
+        if (route->hash == h && strcmp(route->filter,topic) == 0) {
+            route->handler(topic,payload,length,route->context);
+            called++;
+        }
+    }
+    for (uint8_t i = _wildcards; i != MQTT_ROUTE_NONE; i = _routes[i].next) {
+        MQTTRoute* route = &_routes[i];
+        if (matches(route->filter,topic)) {
+            route->handler(topic,payload,length,route->context);
+            called++;
+        }
+    }
+    return called;
+}
+
+boolean MQTTRouter::matches(const char* filter, const char* topic) {
+    // Wildcards at the first level do not match topics starting with $
+    if (*topic == '$' && (*filter == '+' || *filter == '#')) {
+        return false;
+    }
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        } else if (*filter == '+') {
+            while (*topic && *topic != '/') {
+                topic++;
+            }
+            filter++;
+        } else if (*filter == *topic) {
+            filter++;
+            topic++;
+        } else {
+            // "a/#" also matches "a"
+            return *topic == 0 && strcmp(filter,"/#") == 0;
+        }
+    }
+    return *topic == 0;
+}
@@ -0,0 +1,59 @@
+/*
+ MQTTRouter.h - Subscription dispatch table for PubSubClient.
+*/
+
+#ifndef MQTTRouter_h
+#define MQTTRouter_h
+
+#include <Arduino.h>
+
+// MQTT_ROUTER_BUCKETS : number of hash buckets for exact topic filters
+#ifndef MQTT_ROUTER_BUCKETS
+#define MQTT_ROUTER_BUCKETS 16
+#endif
+
+#define MQTT_ROUTE_NONE 0xFF
+
+typedef void (*MQTTHandler)(char* topic, uint8_t* payload, unsigned int length, void* context);
+
+// One entry of the table. The router links the entries by index, so an
+// array of them is all the memory it needs.
+struct MQTTRoute {
+   const char* filter;
+   MQTTHandler handler;
+   void* context;
+   uint16_t hash;
+   uint8_t next;
+};
+
+// Routes inbound messages to handlers by topic filter, without allocating.
+// Filters without wildcards are found through a hash table, so their cost
+// does not grow with the number of routes; filters with + or # are
+// matched one by one.
+class MQTTRouter {
+private:
+   MQTTRoute* _routes;
+   uint8_t _size;
+   uint8_t _count;
+   uint8_t _buckets[MQTT_ROUTER_BUCKETS];
+   uint8_t _wildcards;
+   static uint16_t hash(const char* topic);
+public:
+   // routes is caller supplied storage for up to size entries
+   MQTTRouter(MQTTRoute* routes, uint8_t size);
+
+   // Add a route. The filter string must outlive the router.
+   // Returns 1 if added, 0 if the table is full or the filter is invalid
+   boolean add(const char* filter, MQTTHandler handler, void* context);
+   void clear();
+   uint8_t count();
+
+   // Call the handler of every route matching topic
+   // Returns the number of handlers called
+   uint8_t dispatch(char* topic, uint8_t* payload, unsigned int length);
+
+   // Returns 1 if topic matches filter
+   static boolean matches(const char* filter, const char* topic);
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*
+  MQTTStore.cpp - Store-and-forward queue for PubSubClient.
+*/
+
+#include "MQTTStore.h"
+
+MQTTRamStorage::MQTTRamStorage(uint8_t* buf, uint32_t size) {
+    this->_buf = buf;
+    this->_size = size;
+}
+
+uint32_t MQTTRamStorage::size() {
+    return this->_size;
+}
+
+void MQTTRamStorage::read(uint32_t address, uint8_t* buf, uint16_t length) {
+    memcpy(buf,this->_buf+address,length);
+}
+
+void MQTTRamStorage::write(uint32_t address, const uint8_t* buf, uint16_t length) {
+    memcpy(this->_buf+address,buf,length);
+}
+
+MQTTStore::MQTTStore(MQTTStorage& storage) {
+    this->_storage = &storage;
+    this->_capacity = storage.size();
+    this->_dropped = 0;
+    clear();
+}
+
+void MQTTStore::readAt(uint32_t address, uint8_t* buf, uint16_t length) {
+    address = address % _capacity;
+    uint32_t first = _capacity - address;
+    if (first >= length) {
+        _storage->read(address,buf,length);
+    } else {
+        _storage->read(address,buf,first);
+        _storage->read(0,buf+first,length-first);
+    }
+}
+
+void MQTTStore::writeAt(uint32_t address, const uint8_t* buf, uint16_t length) {
+    address = address % _capacity;
+    uint32_t first = _capacity - address;
+    if (first >= length) {
+        _storage->write(address,buf,length);
+    } else {
+        _storage->write(address,buf,first);
+        _storage->write(0,buf+first,length-first);
+    }
+}
+
+boolean MQTTStore::push(uint8_t topicId, uint32_t timestamp, const uint8_t* payload, uint8_t length) {
+    uint32_t need = MQTT_STORE_RECORD_HEADER + length;
+    if (need > _capacity) {
+        return false;
+    }
+    while (_capacity - _used < need) {
+        pop();
+        _dropped++;
+    }
+    uint8_t header[MQTT_STORE_RECORD_HEADER];
+    header[0] = length;
+    header[1] = topicId;
+    header[2] = (timestamp >> 24);
+    header[3] = (timestamp >> 16) & 0xFF;
+    header[4] = (timestamp >> 8) & 0xFF;
+    header[5] = (timestamp & 0xFF);
+    uint32_t address = _first + _used;
+    writeAt(address,header,MQTT_STORE_RECORD_HEADER);
+    writeAt(address+MQTT_STORE_RECORD_HEADER,payload,length);
+    _used += need;
+    _count++;
+    return true;
+}
+
+boolean MQTTStore::peek(uint8_t* topicId, uint32_t* timestamp, uint8_t* length) {
+    if (_count == 0) {
+        return false;
+    }
+    uint8_t header[MQTT_STORE_RECORD_HEADER];
+    readAt(_first,header,MQTT_STORE_RECORD_HEADER);
+    *length = header[0];
+    *topicId = header[1];
+    *timestamp = ((uint32_t)header[2] << 24) | ((uint32_t)header[3] << 16) | ((uint32_t)header[4] << 8) | header[5];
+    return true;
+}
+
+uint8_t MQTTStore::read(uint8_t offset, uint8_t* buf, uint8_t size) {
+    if (_count == 0) {
+        return 0;
+    }
+    uint8_t length;
+    readAt(_first,&length,1);
+    if (offset >= length) {
+        return 0;
+    }
+    if (size > length - offset) {
+        size = length - offset;
+    }
+    readAt(_first+MQTT_STORE_RECORD_HEADER+offset,buf,size);
+    return size;
+}
+
+void MQTTStore::pop() {
+    if (_count == 0) {
+        return;
+    }
+    uint8_t length;
+    readAt(_first,&length,1);
+    _first = (_first + MQTT_STORE_RECORD_HEADER + length) % _capacity;
+    _used -= MQTT_STORE_RECORD_HEADER + length;
+    _count--;
+}
+
+void MQTTStore::clear() {
+    _first = 0;
+    _used = 0;
+    _count = 0;
+}
+
+boolean MQTTStore::empty() {
+    return _count == 0;
+}
+
+uint16_t MQTTStore::count() {
+    return _count;
+}
+
+uint32_t MQTTStore::used() {
+    return _used;
+}
+
+uint32_t MQTTStore::capacity() {
+    return _capacity;
+}
+
+uint16_t MQTTStore::dropped() {
+    return _dropped;
+}
@@ -0,0 +1,72 @@
+/*
+ MQTTStore.h - Store-and-forward queue for PubSubClient.
+*/
+
+#ifndef MQTTStore_h
+#define MQTTStore_h
+
+#include <Arduino.h>
+
+// Size of the record header: payload length, topic id and timestamp
+#define MQTT_STORE_RECORD_HEADER 6
+
+// Byte addressed storage behind an MQTTStore. Implement this to keep the
+// queue in EEPROM or external flash; MQTTRamStorage keeps it in RAM.
+class MQTTStorage {
+public:
+   virtual uint32_t size() = 0;
+   virtual void read(uint32_t address, uint8_t* buf, uint16_t length) = 0;
+   virtual void write(uint32_t address, const uint8_t* buf, uint16_t length) = 0;
+};
+
+class MQTTRamStorage : public MQTTStorage {
+private:
+   uint8_t* _buf;
+   uint32_t _size;
+public:
+   MQTTRamStorage(uint8_t* buf, uint32_t size);
+   virtual uint32_t size();
+   virtual void read(uint32_t address, uint8_t* buf, uint16_t length);
+   virtual void write(uint32_t address, const uint8_t* buf, uint16_t length);
+};
+
+// A ring of (topic id, timestamp, payload) records, oldest first.
+// When the ring is full the oldest records are dropped to make room.
+// The read and write positions are held in RAM, so a persistent storage
+// keeps the contents across a reset but the queue restarts empty.
+class MQTTStore {
+private:
+   MQTTStorage* _storage;
+   uint32_t _capacity;
+   uint32_t _first;
+   uint32_t _used;
+   uint16_t _count;
+   uint16_t _dropped;
+   void readAt(uint32_t address, uint8_t* buf, uint16_t length);
+   void writeAt(uint32_t address, const uint8_t* buf, uint16_t length);
+public:
+   MQTTStore(MQTTStorage& storage);
+
+   // Append a record, dropping the oldest ones if needed.
+   // Returns 1 if the record was stored, 0 if it can never fit in the storage
+   boolean push(uint8_t topicId, uint32_t timestamp, const uint8_t* payload, uint8_t length);
+   // Read the header of the oldest record
+   // Returns 1 if there is one, 0 if the store is empty
+   boolean peek(uint8_t* topicId, uint32_t* timestamp, uint8_t* length);
+   // Read size bytes of the oldest record's payload, starting at offset
+   // Returns the number of bytes read
+   uint8_t read(uint8_t offset, uint8_t* buf, uint8_t size);
+   // Remove the oldest record
+   void pop();
+   void clear();
+
+   boolean empty();
+   uint16_t count();
+   // Bytes in use, including record headers
+   uint32_t used();
+   uint32_t capacity();
+   // Number of records dropped because the store was full
+   uint16_t dropped();
+};
+
+#endif
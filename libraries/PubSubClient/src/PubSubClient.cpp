@@ -5,42 +5,44 @@
 */
 
 #include "PubSubClient.h"
+#include "MQTTStore.h"
+#include "MQTTRouter.h"
+#include "MQTTReconnect.h"
+#include "MQTTDiscovery.h"
 #include "Arduino.h"
 
+#ifndef pgm_read_ptr
+#define pgm_read_ptr(addr) ((const void*)pgm_read_word(addr))
+#endif
+
 PubSubClient::PubSubClient() {
-    this->_state = MQTT_DISCONNECTED;
-    this->_client = NULL;
-    this->stream = NULL;
-    setCallback(NULL);
+    init();
 }
 
 PubSubClient::PubSubClient(Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setClient(client);
-    this->stream = NULL;
 }
 
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(addr, port);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(addr,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(addr, port);
     setCallback(callback);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(addr,port);
     setCallback(callback);
     setClient(client);
@@ -48,26 +50,24 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATUR
 }
 
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(ip, port);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(ip,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(ip, port);
     setCallback(callback);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(ip,port);
     setCallback(callback);
     setClient(client);
@@ -75,32 +75,97 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE,
 }
 
 PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(domain,port);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(domain,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(domain,port);
     setCallback(callback);
     setClient(client);
-    this->stream = NULL;
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
-    this->_state = MQTT_DISCONNECTED;
+    init();
     setServer(domain,port);
     setCallback(callback);
     setClient(client);
     setStream(stream);
 }
 
+void PubSubClient::sendDiscovery() {
+    for (uint8_t n = 0; n < MQTT_DISCOVERY_BATCH && discovery->pending() > 0; n++) {
+        if (!discovery->publish(*this,discovery->_next) && !connected()) {
+            // Sent again after the next connect
+            return;
+        }
+        // An entry that cannot be sent while connected never will be
+        discovery->_next++;
+    }
+}
+
+void PubSubClient::init() {
+    this->_state = MQTT_DISCONNECTED;
+    this->_client = NULL;
+    this->stream = NULL;
+    this->callback = NULL;
+    this->domain = NULL;
+    this->router = NULL;
+    this->reconnect = NULL;
+    this->discovery = NULL;
+#if MQTT_STATS
+    resetStats();
+#endif
+    this->onMessageBegin = NULL;
+    this->onMessageData = NULL;
+    this->onMessageEnd = NULL;
+    this->subackMsgId = 0;
+    this->subackCount = 0;
+    this->keepAlive = MQTT_KEEPALIVE;
+    this->keepAliveMode = MQTT_KEEPALIVE_FIXED;
+    this->keepAliveInterval = MQTT_KEEPALIVE*1000UL;
+    this->pingInterval = MQTT_KEEPALIVE*1000UL;
+    this->store = NULL;
+    this->topicPrefix = NULL;
+    this->topicTable = NULL;
+    this->topicTableCount = 0;
+#if MQTT_VERSION == MQTT_VERSION_5
+    this->topicAliasMax = 0;
+    this->topicAliasSent = 0;
+#endif
+    this->drainCount = MQTT_STORE_DRAIN_COUNT;
+    this->drainInterval = MQTT_STORE_DRAIN_INTERVAL;
+    this->onStoreDrain = NULL;
+    this->writeBuffer = NULL;
+    this->writeBufferSize = 0;
+    this->writeBufferUsed = 0;
+    this->writeFailed = false;
+    this->batchBuffer = NULL;
+    this->buffer = NULL;
+    this->bufferSize = 0;
+    this->bufferOwned = false;
+    setBufferSize(MQTT_MAX_PACKET_SIZE);
+#if MQTT_MAX_INFLIGHT > 0
+    this->inflightFirst = 0;
+    this->inflightCount = 0;
+    this->inflightWindow = MQTT_MAX_INFLIGHT;
+    this->inflightDataFirst = 0;
+    this->inflightDataUsed = 0;
+#endif
+}
+
+PubSubClient::~PubSubClient() {
+    if (bufferOwned) {
+        free(buffer);
+    }
+}
+
 boolean PubSubClient::connect(const char *id) {
     return connect(id,NULL,NULL,0,0,0,0,1);
 }
@@ -119,103 +184,216 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
 
 boolean PubSubClient::connect(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession) {
     if (!connected()) {
-        int result = 0;
-
-        if (domain != NULL) {
-            result = _client->connect(this->domain, this->port);
-        } else {
-            result = _client->connect(this->ip, this->port);
+        if (!connectAsync(id,user,pass,willTopic,willQos,willRetain,willMessage,cleanSession)) {
+            return false;
         }
-        if (result == 1) {
-            nextMsgId = 1;
-            // Leave room in the buffer for header and variable length field
-            uint16_t length = MQTT_MAX_HEADER_SIZE;
-            unsigned int j;
+        while (_state == MQTT_CONNECT_PENDING || _state == MQTT_CONNACK_PENDING) {
+            checkConnect();
+        }
+        return _state == MQTT_CONNECTED;
+    }
+    return true;
+}
+
+boolean PubSubClient::connectAsync(const char *id) {
+    return connectAsync(id,NULL,NULL,0,0,0,0,1);
+}
+
+boolean PubSubClient::connectAsync(const char *id, const char *user, const char *pass) {
+    return connectAsync(id,user,pass,0,0,0,0,1);
+}
+
+boolean PubSubClient::connectAsync(const char *id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage) {
+    return connectAsync(id,NULL,NULL,willTopic,willQos,willRetain,willMessage,1);
+}
+
+boolean PubSubClient::connectAsync(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage) {
+    return connectAsync(id,user,pass,willTopic,willQos,willRetain,willMessage,1);
+}
+
+boolean PubSubClient::connectAsync(const char *id, const char *user, const char *pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession) {
+    if (_state == MQTT_CONNECT_PENDING || _state == MQTT_CONNACK_PENDING) {
+        // An attempt is already in progress
+        return true;
+    }
+    if (connected()) {
+        return false;
+    }
+    if (this->bufferSize < MQTT_CONNECT_HEADER_SIZE) {
+        // The fixed header below is written unchecked. This also catches a
+        // buffer that could not be allocated.
+        return false;
+    }
+    // The CONNECT packet is built now and held in the buffer until loop() has
+    // opened the connection, so the strings need not outlive this call.
+    // Leave room in the buffer for header and variable length field
+    uint16_t length = MQTT_MAX_HEADER_SIZE;
+    unsigned int j;
 
 #if MQTT_VERSION == MQTT_VERSION_3_1
-            uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p', MQTT_VERSION};
-#define MQTT_HEADER_VERSION_LENGTH 9
-#elif MQTT_VERSION == MQTT_VERSION_3_1_1
-            uint8_t d[7] = {0x00,0x04,'M','Q','T','T',MQTT_VERSION};
-#define MQTT_HEADER_VERSION_LENGTH 7
-#endif
-            for (j = 0;j<MQTT_HEADER_VERSION_LENGTH;j++) {
-                buffer[length++] = d[j];
-            }
+    uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p', MQTT_VERSION};
+#elif MQTT_VERSION == MQTT_VERSION_3_1_1 || MQTT_VERSION == MQTT_VERSION_5
+    uint8_t d[7] = {0x00,0x04,'M','Q','T','T',MQTT_VERSION};
+#endif
+    for (j = 0;j<MQTT_HEADER_VERSION_LENGTH;j++) {
+        buffer[length++] = d[j];
+    }
 
-            uint8_t v;
-            if (willTopic) {
-                v = 0x04|(willQos<<3)|(willRetain<<5);
-            } else {
-                v = 0x00;
-            }
-            if (cleanSession) {
-                v = v|0x02;
-            }
+    uint8_t v;
+    if (willTopic) {
+        v = 0x04|(willQos<<3)|(willRetain<<5);
+    } else {
+        v = 0x00;
+    }
+    if (cleanSession) {
+        v = v|0x02;
+    }
 
-            if(user != NULL) {
-                v = v|0x80;
+    if(user != NULL) {
+        v = v|0x80;
 
-                if(pass != NULL) {
-                    v = v|(0x80>>1);
-                }
-            }
+        if(pass != NULL) {
+            v = v|(0x80>>1);
+        }
+    }
 
-            buffer[length++] = v;
+    buffer[length++] = v;
 
-            buffer[length++] = ((MQTT_KEEPALIVE) >> 8);
-            buffer[length++] = ((MQTT_KEEPALIVE) & 0xFF);
+    buffer[length++] = (keepAlive >> 8);
+    buffer[length++] = (keepAlive & 0xFF);
 
-            CHECK_STRING_LENGTH(length,id)
-            length = writeString(id,buffer,length);
-            if (willTopic) {
-                CHECK_STRING_LENGTH(length,willTopic)
-                length = writeString(willTopic,buffer,length);
-                CHECK_STRING_LENGTH(length,willMessage)
-                length = writeString(willMessage,buffer,length);
-            }
+#if MQTT_VERSION == MQTT_VERSION_5
+    // Maximum Packet Size, so the server drops what would not fit the buffer
+    buffer[length++] = 5;
+    buffer[length++] = 0x27;
+    buffer[length++] = 0;
+    buffer[length++] = 0;
+    buffer[length++] = (this->bufferSize >> 8);
+    buffer[length++] = (this->bufferSize & 0xFF);
+#endif
 
-            if(user != NULL) {
-                CHECK_STRING_LENGTH(length,user)
-                length = writeString(user,buffer,length);
-                if(pass != NULL) {
-                    CHECK_STRING_LENGTH(length,pass)
-                    length = writeString(pass,buffer,length);
-                }
-            }
+    CHECK_STRING_LENGTH(length,id)
+    length = writeString(id,buffer,length);
+    if (willTopic) {
+#if MQTT_VERSION == MQTT_VERSION_5
+        // Will properties
+        buffer[length++] = 0;
+#endif
+        CHECK_STRING_LENGTH(length,willTopic)
+        length = writeString(willTopic,buffer,length);
+        CHECK_STRING_LENGTH(length,willMessage)
+        length = writeString(willMessage,buffer,length);
+    }
 
-            write(MQTTCONNECT,buffer,length-MQTT_MAX_HEADER_SIZE);
+    if(user != NULL) {
+        CHECK_STRING_LENGTH(length,user)
+        length = writeString(user,buffer,length);
+        if(pass != NULL) {
+            CHECK_STRING_LENGTH(length,pass)
+            length = writeString(pass,buffer,length);
+        }
+    }
 
-            lastInActivity = lastOutActivity = millis();
+    connectLength = length-MQTT_MAX_HEADER_SIZE;
+    _state = MQTT_CONNECT_PENDING;
+    return true;
+}
 
-            while (!_client->available()) {
-                unsigned long t = millis();
-                if (t-lastInActivity >= ((int32_t) MQTT_SOCKET_TIMEOUT*1000UL)) {
-                    _state = MQTT_CONNECTION_TIMEOUT;
-                    _client->stop();
-                    return false;
-                }
+void PubSubClient::checkConnect() {
+    if (_state == MQTT_CONNECT_PENDING) {
+        int result = 0;
+
+        if (domain != NULL) {
+            result = _client->connect(this->domain, this->port);
+        } else {
+            result = _client->connect(this->ip, this->port);
+        }
+        if (result != 1) {
+            _state = MQTT_CONNECT_FAILED;
+            return;
+        }
+#if MQTT_MAX_INFLIGHT > 0
+        // Keep the ids of messages still in flight unique
+        if (inflightCount == 0) {
+            nextMsgId = 1;
+        }
+#else
+        nextMsgId = 1;
+#endif
+        write(MQTTCONNECT,buffer,connectLength);
+        lastInActivity = lastOutActivity = millis();
+        _state = MQTT_CONNACK_PENDING;
+    }
+    if (_state == MQTT_CONNACK_PENDING) {
+        if (!_client->available()) {
+            unsigned long t = millis();
+            if (t-lastInActivity >= ((int32_t) MQTT_SOCKET_TIMEOUT*1000UL)) {
+                _state = MQTT_CONNECTION_TIMEOUT;
+                _client->stop();
+            } else if (!_client->connected()) {
+                _state = MQTT_CONNECT_FAILED;
+                _client->stop();
             }
-            uint8_t llen;
-            uint16_t len = readPacket(&llen);
+            return;
+        }
+        uint8_t llen;
+        uint16_t len = readPacket(&llen);
 
-            if (len == 4) {
-                if (buffer[3] == 0) {
-                    lastInActivity = millis();
-                    pingOutstanding = false;
-                    _state = MQTT_CONNECTED;
-                    return true;
-                } else {
-                    _state = buffer[3];
+#if MQTT_VERSION == MQTT_VERSION_5
+        if (len >= 5 && (buffer[0]&0xF0) == MQTTCONNACK) {
+#else
+        if (len == 4 && (buffer[0]&0xF0) == MQTTCONNACK) {
+#endif
+            if (buffer[llen+2] == 0) {
+                lastInActivity = millis();
+                pingOutstanding = false;
+                _state = MQTT_CONNECTED;
+                keepAliveInterval = keepAlive*1000UL;
+#if MQTT_STATS
+                stats.connects++;
+#endif
+#if MQTT_VERSION == MQTT_VERSION_5
+                // Aliases only last for one connection
+                topicAliasMax = 0;
+                topicAliasSent = 0;
+                uint16_t pos = llen+3;
+                uint32_t plen = readVariable(&pos);
+                uint16_t end = pos + plen;
+                while (pos < end && end <= len) {
+                    if (buffer[pos] == 0x22) {
+                        topicAliasMax = (buffer[pos+1]<<8)+buffer[pos+2];
+                    } else if (buffer[pos] == 0x13) {
+                        // Server Keep Alive replaces the interval we asked for
+                        keepAliveInterval = ((buffer[pos+1]<<8)+buffer[pos+2])*1000UL;
+                    }
+                    uint16_t l = propertyLength(pos);
+                    if (l == 0) {
+                        break;
+                    }
+                    pos += l;
                 }
+#endif
+                pingInterval = keepAliveInterval;
+#if MQTT_MAX_INFLIGHT > 0
+                // Resend anything left unacknowledged by the previous connection
+                retryInflight(lastInActivity, true);
+#endif
+                if (reconnect != NULL) {
+                    reconnect->connected();
+                    resubscribe();
+                }
+                if (discovery != NULL) {
+                    discovery->restart();
+                }
+                return;
+            } else {
+                _state = buffer[llen+2];
             }
-            _client->stop();
         } else {
             _state = MQTT_CONNECT_FAILED;
         }
-        return false;
+        _client->stop();
     }
-    return true;
 }
 
 // reads a byte into result
@@ -243,12 +421,118 @@ boolean PubSubClient::readByte(uint8_t * result, uint16_t * index){
   return false;
 }
 
+boolean PubSubClient::readBytes(uint8_t* buf, uint16_t length) {
+    uint32_t previousMillis = millis();
+    while (length > 0) {
+        int avail = _client->available();
+        if (avail > 0) {
+            int rc = _client->read(buf, (avail < length) ? avail : length);
+            if (rc > 0) {
+                buf += rc;
+                length -= rc;
+                // The timeout applies to each chunk, not the whole read
+                previousMillis = millis();
+                continue;
+            }
+        }
+        yield();
+        uint32_t currentMillis = millis();
+        if(currentMillis - previousMillis >= ((int32_t) MQTT_SOCKET_TIMEOUT * 1000)){
+            return false;
+        }
+    }
+    return true;
+}
+
+void PubSubClient::streamPublish(uint32_t length) {
+    uint8_t header = buffer[0];
+    uint16_t idLength = ((header&0x06) == MQTTQOS1) ? 2 : 0;
+    uint8_t field[2];
+    uint16_t tl = 0;
+    boolean begun = false;
+    boolean ok = (length >= 2) && readBytes(field,2);
+    if (ok) {
+        tl = (field[0]<<8)+field[1];
+        ok = (length >= 2 + (uint32_t)tl + idLength);
+    }
+    uint32_t remaining = ok ? length - 2 - tl - idLength : 0;
+    if (ok && tl < this->bufferSize) {
+        ok = readBytes(buffer,tl);
+        buffer[tl] = 0;
+        uint16_t msgId = 0;
+        if (ok && idLength) {
+            ok = readBytes(field,2);
+            msgId = (field[0]<<8)+field[1];
+        }
+#if MQTT_VERSION == MQTT_VERSION_5
+        // Skip the properties, reading them into the buffer after the topic
+        uint32_t plen = 0;
+        uint32_t multiplier = 1;
+        uint8_t count = 0;
+        do {
+            ok = ok && (remaining > 0) && readBytes(field,1);
+            remaining--;
+            plen += (field[0] & 127) * multiplier;
+            multiplier *= 128;
+        } while (ok && (field[0] & 128) != 0 && ++count < 4);
+        ok = ok && (plen <= remaining) && (tl+1 < this->bufferSize || plen == 0);
+        if (ok) {
+            remaining -= plen;
+        }
+        while (ok && plen > 0) {
+            uint16_t chunk = (plen < (uint32_t)(this->bufferSize-tl-1)) ? plen : this->bufferSize-tl-1;
+            ok = readBytes(buffer+tl+1,chunk);
+            plen -= chunk;
+        }
+#endif
+        if (ok) {
+            begun = true;
+            onMessageBegin((char*)buffer,remaining);
+        }
+        while (ok && remaining > 0) {
+            uint16_t chunk = (remaining < this->bufferSize) ? remaining : this->bufferSize;
+            ok = readBytes(buffer,chunk);
+            if (ok && onMessageData) {
+                onMessageData(buffer,chunk);
+            }
+            remaining -= chunk;
+        }
+        if (begun && onMessageEnd) {
+            onMessageEnd(ok);
+        }
+        if (ok && idLength) {
+            buffer[0] = MQTTPUBACK;
+            buffer[1] = 2;
+            buffer[2] = (msgId >> 8);
+            buffer[3] = (msgId & 0xFF);
+            writeControl(buffer,4);
+            MQTT_COUNT_OUT(MQTTPUBACK,4);
+            lastOutActivity = millis();
+        }
+    } else if (ok) {
+        // The topic does not fit in the buffer - skip the message
+        remaining += tl + idLength;
+        while (ok && remaining > 0) {
+            uint16_t chunk = (remaining < this->bufferSize) ? remaining : this->bufferSize;
+            ok = readBytes(buffer,chunk);
+            remaining -= chunk;
+        }
+    }
+    if (ok) {
+        lastInActivity = millis();
+    } else {
+        // A partial packet leaves the stream out of step - drop the connection
+        _state = MQTT_CONNECTION_LOST;
+        _client->stop();
+    }
+}
+
 uint16_t PubSubClient::readPacket(uint8_t* lengthLength) {
     uint16_t len = 0;
     if(!readByte(buffer, &len)) return 0;
     bool isPublish = (buffer[0]&0xF0) == MQTTPUBLISH;
     uint32_t multiplier = 1;
-    uint16_t length = 0;
+    uint32_t length = 0;
     uint8_t digit = 0;
     uint16_t skip = 0;
     uint8_t start = 0;
@@ -266,6 +550,28 @@ uint16_t PubSubClient::readPacket(uint8_t* lengthLength) {
         multiplier *= 128;
     } while ((digit & 128) != 0);
     *lengthLength = len-1;
+    MQTT_COUNT_IN(buffer[0],len+length);
+
+    if (isPublish && onMessageBegin) {
+        // Delivered as it is read, nothing is left for loop() to do
+        streamPublish(length);
+        return 0;
+    }
+
+    if (!this->stream) {
+        // Read the rest of the packet in bulk
+        if (length <= (uint32_t)(this->bufferSize - len)) {
+            if (!readBytes(buffer+len,length)) return 0;
+            return len+length;
+        }
+        // Too big for the buffer - read past it, the packet is ignored
+        while (length > 0) {
+            uint16_t chunk = (length < (uint32_t)(this->bufferSize - len)) ? length : this->bufferSize - len;
+            if (!readBytes(buffer+len,chunk)) return 0;
+            length -= chunk;
+        }
+        return 0;
+    }
 
     if (isPublish) {
         // Read in topic length to calculate bytes to skip over for Stream writing
@@ -279,30 +585,46 @@ uint16_t PubSubClient::readPacket(uint8_t* lengthLength) {
         }
     }
 
-    for (uint16_t i = start;i<length;i++) {
+    for (uint32_t i = start;i<length;i++) {
         if(!readByte(&digit)) return 0;
         if (this->stream) {
             if (isPublish && len-*lengthLength-2>skip) {
                 this->stream->write(digit);
             }
         }
-        if (len < MQTT_MAX_PACKET_SIZE) {
+        if (len < this->bufferSize) {
             buffer[len] = digit;
         }
         len++;
     }
 
-    if (!this->stream && len > MQTT_MAX_PACKET_SIZE) {
-        len = 0; // This will cause the packet to be ignored.
-    }
-
     return len;
 }
 
 boolean PubSubClient::loop() {
+#if MQTT_STATS
+    unsigned long start = micros();
+    boolean rc = poll();
+    countTime(&stats.loopMax,start);
+    return rc;
+#else
+    return poll();
+#endif
+}
+
+boolean PubSubClient::poll() {
+    if (_state == MQTT_CONNECT_PENDING || _state == MQTT_CONNACK_PENDING) {
+        checkConnect();
+        return _state == MQTT_CONNECTED;
+    }
     if (connected()) {
         unsigned long t = millis();
-        if ((t - lastInActivity > MQTT_KEEPALIVE*1000UL) || (t - lastOutActivity > MQTT_KEEPALIVE*1000UL)) {
+        // Inbound silence only calls for a ping when outbound traffic does not
+        // count as proof the connection is alive, or one is already awaited
+        unsigned long inInterval = pingOutstanding ? keepAliveInterval : pingInterval;
+        boolean inIdle = (t - lastInActivity > inInterval) &&
+                         (keepAliveMode != MQTT_KEEPALIVE_OUTBOUND || pingOutstanding);
+        if (keepAliveInterval != 0 && (inIdle || (t - lastOutActivity > keepAliveInterval))) {
             if (pingOutstanding) {
                 this->_state = MQTT_CONNECTION_TIMEOUT;
                 _client->stop();
@@ -310,12 +632,19 @@ boolean PubSubClient::loop() {
             } else {
                 buffer[0] = MQTTPINGREQ;
                 buffer[1] = 0;
-                _client->write(buffer,2);
+                writeControl(buffer,2);
+                MQTT_COUNT_OUT(MQTTPINGREQ,2);
+#if MQTT_STATS
+                pingSentAt = t;
+#endif
                 lastOutActivity = t;
                 lastInActivity = t;
                 pingOutstanding = true;
             }
         }
+#if MQTT_MAX_INFLIGHT > 0
+        retryInflight(t, false);
+#endif
         if (_client->available()) {
             uint8_t llen;
             uint16_t len = readPacket(&llen);
@@ -325,7 +654,7 @@ boolean PubSubClient::loop() {
                 lastInActivity = t;
                 uint8_t type = buffer[0]&0xF0;
                 if (type == MQTTPUBLISH) {
-                    if (callback) {
+                    if (callback || router) {
                         uint16_t tl = (buffer[llen+1]<<8)+buffer[llen+2]; /* topic length in bytes */
                         memmove(buffer+llen+2,buffer+llen+3,tl); /* move topic inside buffer 1 byte to front */
                         buffer[llen+2+tl] = 0; /* end the topic as a 'C' string with \x00 */
@@ -334,37 +663,130 @@ boolean PubSubClient::loop() {
                         if ((buffer[0]&0x06) == MQTTQOS1) {
                             msgId = (buffer[llen+3+tl]<<8)+buffer[llen+3+tl+1];
                             payload = buffer+llen+3+tl+2;
-                            callback(topic,payload,len-llen-3-tl-2);
+#if MQTT_VERSION == MQTT_VERSION_5
+                            uint16_t pos = skipProperties(llen+3+tl+2);
+                            // Malformed properties drop the message
+                            payload = (pos != 0xFFFF) ? buffer+pos : NULL;
+#endif
+                            if (payload != NULL && payload <= buffer+len) {
+                                dispatch(topic,payload,len-(payload-buffer));
+                            }
 
                             buffer[0] = MQTTPUBACK;
                             buffer[1] = 2;
                             buffer[2] = (msgId >> 8);
                             buffer[3] = (msgId & 0xFF);
-                            _client->write(buffer,4);
+                            writeControl(buffer,4);
+                            MQTT_COUNT_OUT(MQTTPUBACK,4);
                             lastOutActivity = t;
 
                         } else {
                             payload = buffer+llen+3+tl;
-                            callback(topic,payload,len-llen-3-tl);
+#if MQTT_VERSION == MQTT_VERSION_5
+                            uint16_t pos = skipProperties(llen+3+tl);
+                            payload = (pos != 0xFFFF) ? buffer+pos : NULL;
+#endif
+                            if (payload != NULL && payload <= buffer+len) {
+                                dispatch(topic,payload,len-(payload-buffer));
+                            }
+                        }
+                    }
+#if MQTT_MAX_INFLIGHT > 0
+                } else if (type == MQTTPUBACK) {
+                    ackInflight((buffer[llen+1]<<8)+buffer[llen+2]);
+#endif
+                } else if (type == MQTTSUBACK) {
+                    msgId = (buffer[llen+1]<<8)+buffer[llen+2];
+                    if (msgId == subackMsgId) {
+                        uint16_t pos = llen+3;
+#if MQTT_VERSION == MQTT_VERSION_5
+                        pos = skipProperties(pos);
+#endif
+                        for (uint8_t i = 0; i < subackCount && pos+i < len; i++) {
+                            subackResults[i] = buffer[pos+i];
                         }
                     }
                 } else if (type == MQTTPINGREQ) {
                     buffer[0] = MQTTPINGRESP;
                     buffer[1] = 0;
-                    _client->write(buffer,2);
+                    writeControl(buffer,2);
+                    MQTT_COUNT_OUT(MQTTPINGRESP,2);
                 } else if (type == MQTTPINGRESP) {
+#if MQTT_STATS
+                    if (pingOutstanding) {
+                        stats.pingRtt = t - pingSentAt;
+                        if (stats.pingRtt > stats.pingRttMax) {
+                            stats.pingRttMax = stats.pingRtt;
+                        }
+                    }
+#endif
                     pingOutstanding = false;
+                    if (keepAliveMode == MQTT_KEEPALIVE_ADAPTIVE && pingInterval < keepAliveInterval*MQTT_KEEPALIVE_BACKOFF) {
+                        // The link is healthy, so check inbound silence less often
+                        pingInterval *= 2;
+                    }
+#if MQTT_VERSION == MQTT_VERSION_5
+                } else if (type == MQTTDISCONNECT) {
+                    // The server is closing the connection
+                    _state = MQTT_CONNECTION_LOST;
+                    _client->stop();
+                    return false;
+#endif
                 }
             } else if (!connected()) {
                 // readPacket has closed the connection
                 return false;
             }
         }
+        if (store != NULL) {
+            drainStore(t);
+        }
+        if (discovery != NULL) {
+            sendDiscovery();
+        }
         return true;
     }
+    if (reconnect != NULL) {
+        runReconnect(millis());
+    }
     return false;
 }
 
+void PubSubClient::runReconnect(unsigned long t) {
+    if (reconnect->_state == MQTT_RECONNECT_CONNECTED) {
+        reconnect->lost(t);
+    } else if (reconnect->_state == MQTT_RECONNECT_PENDING) {
+        reconnect->failed(t);
+    }
+    if (reconnect->due(t)) {
+        reconnect->attempt();
+        if (!connectAsync(reconnect->_id,reconnect->_user,reconnect->_pass,reconnect->_willTopic,
+                reconnect->_willQos,reconnect->_willRetain,reconnect->_willMessage,reconnect->_cleanSession)) {
+            reconnect->failed(t);
+        }
+    }
+}
+
+void PubSubClient::resubscribe() {
+    // In as few SUBSCRIBE packets as the batch size allows
+    for (uint8_t i = 0; i < reconnect->_topicCount; i += MQTT_MAX_SUBSCRIBE_BATCH) {
+        uint8_t count = reconnect->_topicCount - i;
+        if (count > MQTT_MAX_SUBSCRIBE_BATCH) {
+            count = MQTT_MAX_SUBSCRIBE_BATCH;
+        }
+        subscribe(reconnect->_topics+i,reconnect->_qos ? reconnect->_qos+i : NULL,count);
+    }
+}
+
+void PubSubClient::dispatch(char* topic, uint8_t* payload, unsigned int length) {
+    if (router != NULL && router->dispatch(topic,payload,length) > 0) {
+        return;
+    }
+    if (callback) {
+        callback(topic,payload,length);
+    }
+}
+
 boolean PubSubClient::publish(const char* topic, const char* payload) {
     return publish(topic,(const uint8_t*)payload,strlen(payload),false);
 }
@@ -378,14 +800,21 @@ boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigne
 }
 
 boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    return publish(topic,payload,plength,0,retained);
+}
+
+boolean PubSubClient::publishQos0(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
     if (connected()) {
-        if (MQTT_MAX_PACKET_SIZE < MQTT_MAX_HEADER_SIZE + 2+strlen(topic) + plength) {
+        if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2+strlen(topic) + MQTT_PROPERTIES_LENGTH + plength) {
             // Too long
             return false;
         }
         // Leave room in the buffer for header and variable length field
         uint16_t length = MQTT_MAX_HEADER_SIZE;
         length = writeString(topic,buffer,length);
+#if MQTT_VERSION == MQTT_VERSION_5
+        buffer[length++] = 0;
+#endif
         uint16_t i;
         for (i=0;i<plength;i++) {
             buffer[length++] = payload[i];
@@ -399,85 +828,608 @@ boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigne
     return false;
 }
 
-boolean PubSubClient::publish_P(const char* topic, const char* payload, boolean retained) {
-    return publish_P(topic, (const uint8_t*)payload, strlen(payload), retained);
+boolean PubSubClient::publish(const char* topic, const char* payload, uint8_t qos, boolean retained) {
+    return publish(topic,(const uint8_t*)payload,strlen(payload),qos,retained);
 }
 
-boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
-    uint8_t llen = 0;
-    uint8_t digit;
-    unsigned int rc = 0;
-    uint16_t tlen;
-    unsigned int pos = 0;
-    unsigned int i;
-    uint8_t header;
-    unsigned int len;
-
-    if (!connected()) {
-        return false;
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, uint8_t qos, boolean retained) {
+#if MQTT_STATS
+    unsigned long start = micros();
+#endif
+    boolean rc = false;
+    if (qos == 0) {
+        rc = publishQos0(topic,payload,plength,retained);
     }
-
-    tlen = strlen(topic);
-
-    header = MQTTPUBLISH;
-    if (retained) {
-        header |= 1;
+#if MQTT_MAX_INFLIGHT > 0
+    else if (qos == 1) {
+        rc = publishQos1(topic,payload,plength,retained);
     }
-    buffer[pos++] = header;
-    len = plength + 2 + tlen;
-    do {
-        digit = len % 128;
-        len = len / 128;
-        if (len > 0) {
-            digit |= 0x80;
-        }
-        buffer[pos++] = digit;
-        llen++;
-    } while(len>0);
-
-    pos = writeString(topic,buffer,pos);
-
-    rc += _client->write(buffer,pos);
-
-    for (i=0;i<plength;i++) {
-        rc += _client->write((char)pgm_read_byte_near(payload + i));
+#endif
+#if MQTT_STATS
+    countTime(&stats.publishMax,start);
+    if (!rc) {
+        stats.publishFailures++;
     }
-
-    lastOutActivity = millis();
-
-    return rc == tlen + 4 + plength;
+#endif
+    return rc;
 }
 
-boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained) {
+#if MQTT_MAX_INFLIGHT > 0
+boolean PubSubClient::publishQos1(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
     if (connected()) {
-        // Send the header and variable length field
+        if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2+strlen(topic) + 2 + MQTT_PROPERTIES_LENGTH + plength) {
+            // Too long
+            return false;
+        }
+        // Leave room in the buffer for header and variable length field
         uint16_t length = MQTT_MAX_HEADER_SIZE;
         length = writeString(topic,buffer,length);
-        uint16_t i;
-        uint8_t header = MQTTPUBLISH;
+        uint16_t msgId = ++nextMsgId;
+        if (msgId == 0) {
+            msgId = nextMsgId = 1;
+        }
+        buffer[length++] = (msgId >> 8);
+        buffer[length++] = (msgId & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+        buffer[length++] = 0;
+#endif
+        memcpy(buffer+length,payload,plength);
+        length += plength;
+        uint8_t header = MQTTPUBLISH | MQTTQOS1;
         if (retained) {
             header |= 1;
         }
-        size_t hlen = buildHeader(header, buffer, plength+length-MQTT_MAX_HEADER_SIZE);
-        uint16_t rc = _client->write(buffer+(MQTT_MAX_HEADER_SIZE-hlen),length-(MQTT_MAX_HEADER_SIZE-hlen));
-        lastOutActivity = millis();
-        return (rc == (length-(MQTT_MAX_HEADER_SIZE-hlen)));
+        uint8_t hlen = buildHeader(header, buffer, length-MQTT_MAX_HEADER_SIZE);
+        if (!addInflight(msgId, buffer+(MQTT_MAX_HEADER_SIZE-hlen), length-(MQTT_MAX_HEADER_SIZE-hlen))) {
+            // Window or in-flight buffer full
+            return false;
+        }
+        write(header,buffer,length-MQTT_MAX_HEADER_SIZE);
+        return true;
+    }
+    return false;
+}
+
+boolean PubSubClient::addInflight(uint16_t msgId, uint8_t* buf, uint16_t length) {
+    if (inflightCount >= inflightWindow || inflightDataUsed + length > MQTT_INFLIGHT_BUFFER_SIZE) {
+        return false;
+    }
+    MQTTInflightMessage* msg = &inflight[(inflightFirst + inflightCount) % MQTT_MAX_INFLIGHT];
+    msg->msgId = msgId;
+    msg->offset = (inflightDataFirst + inflightDataUsed) % MQTT_INFLIGHT_BUFFER_SIZE;
+    msg->length = length;
+    msg->sentAt = millis();
+    msg->acked = false;
+    uint16_t pos = msg->offset;
+    for (uint16_t i = 0; i < length; i++) {
+        inflightData[pos++] = buf[i];
+        if (pos == MQTT_INFLIGHT_BUFFER_SIZE) {
+            pos = 0;
+        }
+    }
+    inflightCount++;
+    inflightDataUsed += length;
+    return true;
+}
+
+void PubSubClient::ackInflight(uint16_t msgId) {
+    uint8_t i;
+    for (i = 0; i < inflightCount; i++) {
+        MQTTInflightMessage* msg = &inflight[(inflightFirst + i) % MQTT_MAX_INFLIGHT];
+        if (msg->msgId == msgId) {
+            msg->acked = true;
+            break;
+        }
+    }
+    // Release acknowledged messages from the front of the ring, in order
+    while (inflightCount > 0 && inflight[inflightFirst].acked) {
+        MQTTInflightMessage* msg = &inflight[inflightFirst];
+        inflightDataFirst = (inflightDataFirst + msg->length) % MQTT_INFLIGHT_BUFFER_SIZE;
+        inflightDataUsed -= msg->length;
+        inflightFirst = (inflightFirst + 1) % MQTT_MAX_INFLIGHT;
+        inflightCount--;
+    }
+}
+
+void PubSubClient::retryInflight(unsigned long t, boolean all) {
+    uint8_t i;
+    for (i = 0; i < inflightCount; i++) {
+        MQTTInflightMessage* msg = &inflight[(inflightFirst + i) % MQTT_MAX_INFLIGHT];
+        if (msg->acked || (!all && t - msg->sentAt < MQTT_RETRY_TIMEOUT*1000UL)) {
+            continue;
+        }
+        // Set the DUP flag in the stored fixed header
+        inflightData[msg->offset] |= 0x08;
+        MQTT_COUNT_OUT(inflightData[msg->offset],msg->length);
+        uint16_t first = MQTT_INFLIGHT_BUFFER_SIZE - msg->offset;
+        if (first >= msg->length) {
+            writeControl(inflightData+msg->offset,msg->length);
+        } else {
+            // The packet wraps around the end of the ring
+            writeControl(inflightData+msg->offset,first);
+            writeControl(inflightData,msg->length-first);
+        }
+        msg->sentAt = t;
+        lastOutActivity = t;
+    }
+}
+
+boolean PubSubClient::setInflightWindow(uint8_t window) {
+    if (window == 0 || window > MQTT_MAX_INFLIGHT) {
+        return false;
+    }
+    inflightWindow = window;
+    return true;
+}
+
+uint8_t PubSubClient::getInflightCount() {
+    return inflightCount;
+}
+#endif
+
+boolean PubSubClient::publishOrStore(uint8_t topicId, const char* payload) {
+    return publishOrStore(topicId,(const uint8_t*)payload,strlen(payload));
+}
+
+boolean PubSubClient::publishOrStore(uint8_t topicId, const uint8_t* payload, uint8_t plength) {
+    if (store == NULL || topicId >= (storeTopics != NULL ? storeTopicCount : topicTableCount)) {
+        return false;
+    }
+    // Keep messages in order while older ones are still being drained
+    if (store->empty()) {
+        if (storeTopics != NULL ? publish(storeTopics[topicId],payload,plength) : publishTopic(topicId,payload,plength,false)) {
+            return true;
+        }
+    }
+    return store->push(topicId,millis(),payload,plength);
+}
+
+void PubSubClient::drainStore(unsigned long t) {
+    if (store->empty() || t - lastDrain < drainInterval) {
+        return;
+    }
+    lastDrain = t;
+    uint8_t topicId;
+    uint32_t timestamp;
+    uint8_t plength;
+    for (uint8_t n = 0; n < drainCount && store->peek(&topicId,&timestamp,&plength); n++) {
+        const char* prefix = NULL;
+        const char* suffix = NULL;
+        boolean progmem = false;
+        if (storeTopics != NULL) {
+            if (topicId < storeTopicCount) {
+                suffix = storeTopics[topicId];
+            }
+        } else {
+            prefix = topicPrefix;
+            suffix = topicSuffix(topicId);
+            progmem = true;
+        }
+        if (suffix != NULL) {
+            uint16_t length = writePublishTopic(prefix,suffix,progmem,progmem ? topicId+1 : 0,plength);
+            if (length > 0) {
+                // Read the payload straight into the packet
+                length += store->read(0,buffer+length,plength);
+                if (!write(MQTTPUBLISH,buffer,length-MQTT_MAX_HEADER_SIZE)) {
+                    // Keep it for the next attempt
+                    return;
+                }
+                if (onStoreDrain) {
+                    onStoreDrain(topicId,timestamp);
+                }
+            }
+        }
+        // Messages that can never be sent are discarded
+        store->pop();
+    }
+}
+
+boolean PubSubClient::publishSuffix(const char* suffix, const char* payload) {
+    return publishTopic(suffix,false,0,(const uint8_t*)payload,strlen(payload),false);
+}
+
+boolean PubSubClient::publishSuffix(const char* suffix, const uint8_t* payload, unsigned int plength, boolean retained) {
+    return publishTopic(suffix,false,0,payload,plength,retained);
+}
+
+boolean PubSubClient::publishTopic(uint8_t topic, const char* payload) {
+    return publishTopic(topic,(const uint8_t*)payload,strlen(payload),false);
+}
+
+boolean PubSubClient::publishTopic(uint8_t topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    const char* suffix = topicSuffix(topic);
+    if (suffix == NULL) {
+        return false;
+    }
+    return publishTopic(suffix,true,topic+1,payload,plength,retained);
+}
+
+boolean PubSubClient::publishTopic(const char* suffix, boolean progmem, uint8_t alias, const uint8_t* payload, unsigned int plength, boolean retained) {
+#if MQTT_STATS
+    unsigned long start = micros();
+#endif
+    boolean rc = false;
+    if (connected()) {
+        uint16_t length = writePublishTopic(topicPrefix,suffix,progmem,alias,plength);
+        // A length of 0 means too long
+        if (length != 0) {
+            memcpy(buffer+length,payload,plength);
+            length += plength;
+            uint8_t header = MQTTPUBLISH;
+            if (retained) {
+                header |= 1;
+            }
+            rc = write(header,buffer,length-MQTT_MAX_HEADER_SIZE);
+        }
+    }
+#if MQTT_STATS
+    countTime(&stats.publishMax,start);
+    if (!rc) {
+        stats.publishFailures++;
+    }
+#endif
+    return rc;
+}
+
+uint16_t PubSubClient::writePublishTopic(const char* prefix, const char* suffix, boolean progmem, uint8_t alias, unsigned int plength) {
+    uint16_t tlen = topicLength(prefix,suffix,progmem);
+    uint16_t plen = MQTT_PROPERTIES_LENGTH;
+#if MQTT_VERSION == MQTT_VERSION_5
+    uint32_t aliasBit = 0;
+    if (alias > 0 && alias <= topicAliasMax && alias <= 32) {
+        aliasBit = 1UL << (alias-1);
+        plen += 3;
+    }
+    if (topicAliasSent & aliasBit) {
+        // The server knows the alias - leave the topic out
+        tlen = 0;
+    }
+#endif
+    if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2 + tlen + plen + plength) {
+        return 0;
+    }
+    uint16_t length = MQTT_MAX_HEADER_SIZE;
+#if MQTT_VERSION == MQTT_VERSION_5
+    if (tlen == 0 && aliasBit) {
+        buffer[length++] = 0;
+        buffer[length++] = 0;
+    } else {
+        length = writeTopic(prefix,suffix,progmem,buffer,length);
+    }
+    if (aliasBit) {
+        buffer[length++] = 3;
+        buffer[length++] = 0x23;
+        buffer[length++] = 0;
+        buffer[length++] = alias;
+        topicAliasSent |= aliasBit;
+    } else {
+        buffer[length++] = 0;
+    }
+#else
+    // Topic aliases need MQTT 5
+    (void)alias;
+    length = writeTopic(prefix,suffix,progmem,buffer,length);
+#endif
+    return length;
+}
+
+const char* PubSubClient::topicSuffix(uint8_t topic) {
+    if (topicTable == NULL || topic >= topicTableCount) {
+        return NULL;
+    }
+    return (const char*)pgm_read_ptr(&topicTable[topic]);
+}
+
+uint16_t PubSubClient::topicLength(const char* prefix, const char* suffix, boolean progmem) {
+    uint16_t length = progmem ? strlen_P(suffix) : strlen(suffix);
+    if (prefix != NULL) {
+        length += strlen(prefix);
+    }
+    return length;
+}
+
+uint16_t PubSubClient::writeTopic(const char* prefix, const char* suffix, boolean progmem, uint8_t* buf, uint16_t pos) {
+    uint16_t start = pos;
+    pos += 2;
+    if (prefix != NULL) {
+        uint16_t plen = strlen(prefix);
+        memcpy(buf+pos,prefix,plen);
+        pos += plen;
+    }
+    if (progmem) {
+        uint16_t slen = strlen_P(suffix);
+        memcpy_P(buf+pos,suffix,slen);
+        pos += slen;
+    } else {
+        uint16_t slen = strlen(suffix);
+        memcpy(buf+pos,suffix,slen);
+        pos += slen;
+    }
+    uint16_t length = pos-start-2;
+    buf[start] = (length >> 8);
+    buf[start+1] = (length & 0xFF);
+    return pos;
+}
+
+boolean PubSubClient::publish_P(const char* topic, const char* payload, boolean retained) {
+    return publish_P(topic, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    uint8_t llen = 0;
+    uint8_t digit;
+    unsigned int rc = 0;
+    uint16_t tlen;
+    unsigned int pos = 0;
+    uint8_t header;
+    unsigned int len;
+
+    if (!connected()) {
+        return false;
+    }
+
+    tlen = strlen(topic);
+    if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2 + tlen) {
+        // Too long
+        return false;
+    }
+
+    header = MQTTPUBLISH;
+    if (retained) {
+        header |= 1;
+    }
+    buffer[pos++] = header;
+    len = plength + 2 + tlen + MQTT_PROPERTIES_LENGTH;
+    do {
+        digit = len % 128;
+        len = len / 128;
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        buffer[pos++] = digit;
+        llen++;
+    } while(len>0);
+
+    pos = writeString(topic,buffer,pos);
+#if MQTT_VERSION == MQTT_VERSION_5
+    buffer[pos++] = 0;
+#endif
+
+    flush();
+    rc += writeStaged(buffer,pos);
+    rc += writeP(payload,plength);
+    flush();
+    MQTT_COUNT_OUT(header,pos+plength);
+
+    lastOutActivity = millis();
+
+    boolean failed = writeFailed;
+    writeFailed = false;
+    return !failed && rc == 1 + llen + 2 + tlen + MQTT_PROPERTIES_LENGTH + plength;
+}
+
+boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained) {
+    return beginPublishTopic(topic,false,plength,retained);
+}
+
+boolean PubSubClient::beginPublish_P(const char* topic, unsigned int plength, boolean retained) {
+    return beginPublishTopic(topic,true,plength,retained);
+}
+
+boolean PubSubClient::beginPublishTopic(const char* topic, boolean progmem, unsigned int plength, boolean retained) {
+    if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2 + topicLength(NULL,topic,progmem) + MQTT_PROPERTIES_LENGTH) {
+        // Too long
+        return false;
+    }
+    if (connected()) {
+        // Send the header and variable length field
+        uint16_t length = MQTT_MAX_HEADER_SIZE;
+        length = writeTopic(NULL,topic,progmem,buffer,length);
+#if MQTT_VERSION == MQTT_VERSION_5
+        buffer[length++] = 0;
+#endif
+        uint8_t header = MQTTPUBLISH;
+        if (retained) {
+            header |= 1;
+        }
+        size_t hlen = buildHeader(header, buffer, plength+length-MQTT_MAX_HEADER_SIZE);
+        uint16_t rc = writeStaged(buffer+(MQTT_MAX_HEADER_SIZE-hlen),length-(MQTT_MAX_HEADER_SIZE-hlen));
+        // Counted whole, as the payload is written through write()
+        MQTT_COUNT_OUT(header,hlen+length-MQTT_MAX_HEADER_SIZE+plength);
+        lastOutActivity = millis();
+        return (rc == (length-(MQTT_MAX_HEADER_SIZE-hlen)));
     }
     return false;
 }
 
 int PubSubClient::endPublish() {
- return 1;
+    flush();
+    boolean rc = !writeFailed;
+    writeFailed = false;
+    return rc;
 }
 
 size_t PubSubClient::write(uint8_t data) {
     lastOutActivity = millis();
-    return _client->write(data);
+    if (writeBuffer == NULL) {
+        size_t rc = _client->write(data);
+        writeFailed |= (rc != 1);
+        return rc;
+    }
+    return writeStaged(&data,1);
 }
 
 size_t PubSubClient::write(const uint8_t *buffer, size_t size) {
     lastOutActivity = millis();
-    return _client->write(buffer,size);
+    return writeStaged(buffer,size);
+}
+
+size_t PubSubClient::writeP(const uint8_t *buffer, size_t size) {
+    // Copy out of flash a chunk at a time so each client write carries a block
+    uint8_t chunk[MQTT_PROGMEM_CHUNK_SIZE];
+    size_t rc = 0;
+    lastOutActivity = millis();
+    while (rc < size) {
+        size_t n = size - rc;
+        if (n > MQTT_PROGMEM_CHUNK_SIZE) {
+            n = MQTT_PROGMEM_CHUNK_SIZE;
+        }
+        memcpy_P(chunk,buffer+rc,n);
+        size_t written = writeStaged(chunk,n);
+        rc += written;
+        if (written != n) {
+            break;
+        }
+    }
+    return rc;
+}
+
+size_t PubSubClient::writeStaged(const uint8_t* buf, size_t size) {
+    if (writeBuffer == NULL) {
+        size_t rc = _client->write(buf,size);
+        writeFailed |= (rc != size);
+        return rc;
+    }
+    if (writeBufferUsed + size > writeBufferSize) {
+        flush();
+        if (size >= writeBufferSize) {
+            // Too big to gain anything from staging
+            size_t rc = _client->write(buf,size);
+            writeFailed |= (rc != size);
+            return rc;
+        }
+    }
+    memcpy(writeBuffer+writeBufferUsed,buf,size);
+    writeBufferUsed += size;
+    return size;
+}
+
+void PubSubClient::flush() {
+    if (writeBufferUsed > 0) {
+        writeFailed |= (_client->write(writeBuffer,writeBufferUsed) != writeBufferUsed);
+        writeBufferUsed = 0;
+    }
+}
+
+size_t PubSubClient::writeControl(const uint8_t* buf, size_t size) {
+    // Keep packets in order behind a streamed publish not yet ended
+    flush();
+    return _client->write(buf,size);
+}
+
+PubSubClient& PubSubClient::setWriteBuffer(uint8_t* buf, uint16_t size) {
+    flush();
+    this->writeBuffer = (size > 0) ? buf : NULL;
+    this->writeBufferSize = size;
+    return *this;
+}
+
+boolean PubSubClient::beginBatch() {
+    return beginBatch(buffer, this->bufferSize);
+}
+
+boolean PubSubClient::beginBatch(uint8_t* buf, uint16_t size) {
+    if (buf == NULL || size == 0) {
+        return false;
+    }
+    batchBuffer = buf;
+    batchSize = size;
+    batchLength = 0;
+    batchFailed = false;
+    return true;
+}
+
+boolean PubSubClient::addToBatch(const char* topic, const char* payload) {
+    return addToBatch(topic,(const uint8_t*)payload,strlen(payload),false);
+}
+
+boolean PubSubClient::addToBatch(const char* topic, const char* payload, boolean retained) {
+    return addToBatch(topic,(const uint8_t*)payload,strlen(payload),retained);
+}
+
+boolean PubSubClient::addToBatch(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    if (batchBuffer == NULL || batchFailed) {
+        return false;
+    }
+    uint16_t tlen = strlen(topic);
+    uint32_t len = 2 + tlen + MQTT_PROPERTIES_LENGTH + (uint32_t)plength;
+    uint8_t llen = 0;
+    uint32_t l = len;
+    do {
+        l = l / 128;
+        llen++;
+    } while (l > 0);
+    if ((uint32_t)batchLength + 1 + llen + len > batchSize) {
+        // Too long - refuse the whole batch
+        batchFailed = true;
+        return false;
+    }
+
+    uint8_t* buf = batchBuffer;
+    uint16_t pos = batchLength;
+    uint8_t digit;
+    buf[pos++] = retained ? (MQTTPUBLISH | 1) : MQTTPUBLISH;
+    do {
+        digit = len % 128;
+        len = len / 128;
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        buf[pos++] = digit;
+    } while (len > 0);
+    pos = writeString(topic,buf,pos);
+#if MQTT_VERSION == MQTT_VERSION_5
+    buf[pos++] = 0;
+#endif
+    memcpy(buf+pos,payload,plength);
+    batchLength = pos + plength;
+    return true;
+}
+
+boolean PubSubClient::endBatch() {
+    uint8_t* writeBuf = batchBuffer;
+    uint16_t bytesRemaining = batchLength;
+    boolean result = (writeBuf != NULL) && !batchFailed && connected();
+    batchBuffer = NULL;
+    if (!result || bytesRemaining == 0) {
+        return result;
+    }
+    flush();
+#if MQTT_STATS
+    // Count each packet of the batch
+    uint16_t pos = 0;
+    while (pos < bytesRemaining) {
+        uint16_t start = pos++;
+        uint32_t len = 0;
+        uint8_t shift = 0;
+        do {
+            len += (uint32_t)(writeBuf[pos] & 127) << shift;
+            shift += 7;
+        } while ((writeBuf[pos++] & 128) != 0);
+        pos += len;
+        MQTT_COUNT_OUT(writeBuf[start],pos-start);
+    }
+#endif
+
+#ifdef MQTT_MAX_TRANSFER_SIZE
+    uint16_t rc;
+    uint8_t bytesToWrite;
+    while((bytesRemaining > 0) && result) {
+        bytesToWrite = (bytesRemaining > MQTT_MAX_TRANSFER_SIZE)?MQTT_MAX_TRANSFER_SIZE:bytesRemaining;
+        rc = _client->write(writeBuf,bytesToWrite);
+        result = (rc == bytesToWrite);
+        bytesRemaining -= rc;
+        writeBuf += rc;
+    }
+#else
+    result = (_client->write(writeBuf,bytesRemaining) == bytesRemaining);
+#endif
+    lastOutActivity = millis();
+    return result;
+}
+
+void PubSubClient::abortBatch() {
+    batchBuffer = NULL;
 }
 
 size_t PubSubClient::buildHeader(uint8_t header, uint8_t* buf, uint16_t length) {
@@ -505,7 +1457,9 @@ size_t PubSubClient::buildHeader(uint8_t header, uint8_t* buf, uint16_t length)
 
 boolean PubSubClient::write(uint8_t header, uint8_t* buf, uint16_t length) {
     uint16_t rc;
+    flush();
     uint8_t hlen = buildHeader(header, buf, length);
+    MQTT_COUNT_OUT(header,hlen+length);
 
 #ifdef MQTT_MAX_TRANSFER_SIZE
     uint8_t* writeBuf = buf+(MQTT_MAX_HEADER_SIZE-hlen);
@@ -535,7 +1489,7 @@ boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
     if (qos > 1) {
         return false;
     }
-    if (MQTT_MAX_PACKET_SIZE < 9 + strlen(topic)) {
+    if (this->bufferSize < 9 + strlen(topic) + MQTT_PROPERTIES_LENGTH) {
         // Too long
         return false;
     }
@@ -548,15 +1502,87 @@ boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
         }
         buffer[length++] = (nextMsgId >> 8);
         buffer[length++] = (nextMsgId & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+        buffer[length++] = 0;
+#endif
         length = writeString((char*)topic, buffer,length);
         buffer[length++] = qos;
-        return write(MQTTSUBSCRIBE|MQTTQOS1,buffer,length-MQTT_MAX_HEADER_SIZE);
+        if (!write(MQTTSUBSCRIBE|MQTTQOS1,buffer,length-MQTT_MAX_HEADER_SIZE)) {
+            return false;
+        }
+        subackMsgId = nextMsgId;
+        subackCount = 1;
+        subackResults[0] = MQTT_SUBACK_PENDING;
+        return true;
     }
     return false;
 }
 
+boolean PubSubClient::subscribe(const char* const* topics, const uint8_t* qos, uint8_t count) {
+    if (count == 0 || count > MQTT_MAX_SUBSCRIBE_BATCH) {
+        return false;
+    }
+    // Header, message id, then a length, topic and qos byte per filter
+    uint16_t size = MQTT_MAX_HEADER_SIZE + 2 + MQTT_PROPERTIES_LENGTH;
+    uint8_t i;
+    for (i = 0; i < count; i++) {
+        if (qos != NULL && qos[i] > 1) {
+            return false;
+        }
+        size += 2 + strlen(topics[i]) + 1;
+    }
+    if (this->bufferSize < size) {
+        // Too long
+        return false;
+    }
+    if (connected()) {
+        // Leave room in the buffer for header and variable length field
+        uint16_t length = MQTT_MAX_HEADER_SIZE;
+        nextMsgId++;
+        if (nextMsgId == 0) {
+            nextMsgId = 1;
+        }
+        buffer[length++] = (nextMsgId >> 8);
+        buffer[length++] = (nextMsgId & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+        buffer[length++] = 0;
+#endif
+        for (i = 0; i < count; i++) {
+            length = writeString(topics[i], buffer,length);
+            buffer[length++] = (qos != NULL) ? qos[i] : 0;
+        }
+        if (!write(MQTTSUBSCRIBE|MQTTQOS1,buffer,length-MQTT_MAX_HEADER_SIZE)) {
+            return false;
+        }
+        subackMsgId = nextMsgId;
+        subackCount = count;
+        memset(subackResults,MQTT_SUBACK_PENDING,count);
+        return true;
+    }
+    return false;
+}
+
+uint8_t PubSubClient::getSubscribeResult(uint8_t index) {
+    if (index >= subackCount) {
+        return MQTT_SUBACK_PENDING;
+    }
+    return subackResults[index];
+}
+
 boolean PubSubClient::unsubscribe(const char* topic) {
-    if (MQTT_MAX_PACKET_SIZE < 9 + strlen(topic)) {
+    return unsubscribe(&topic, 1);
+}
+
+boolean PubSubClient::unsubscribe(const char* const* topics, uint8_t count) {
+    if (count == 0 || count > MQTT_MAX_SUBSCRIBE_BATCH) {
+        return false;
+    }
+    uint16_t size = MQTT_MAX_HEADER_SIZE + 2 + MQTT_PROPERTIES_LENGTH;
+    uint8_t i;
+    for (i = 0; i < count; i++) {
+        size += 2 + strlen(topics[i]);
+    }
+    if (this->bufferSize < size) {
         // Too long
         return false;
     }
@@ -568,22 +1594,81 @@ boolean PubSubClient::unsubscribe(const char* topic) {
         }
         buffer[length++] = (nextMsgId >> 8);
         buffer[length++] = (nextMsgId & 0xFF);
-        length = writeString(topic, buffer,length);
+#if MQTT_VERSION == MQTT_VERSION_5
+        buffer[length++] = 0;
+#endif
+        for (i = 0; i < count; i++) {
+            length = writeString(topics[i], buffer,length);
+        }
         return write(MQTTUNSUBSCRIBE|MQTTQOS1,buffer,length-MQTT_MAX_HEADER_SIZE);
     }
     return false;
 }
 
 void PubSubClient::disconnect() {
+    reconnect = NULL;
     buffer[0] = MQTTDISCONNECT;
     buffer[1] = 0;
-    _client->write(buffer,2);
+    writeControl(buffer,2);
+    MQTT_COUNT_OUT(MQTTDISCONNECT,2);
     _state = MQTT_DISCONNECTED;
     _client->flush();
     _client->stop();
     lastInActivity = lastOutActivity = millis();
 }
 
+#if MQTT_VERSION == MQTT_VERSION_5
+uint32_t PubSubClient::readVariable(uint16_t* pos) {
+    uint32_t value = 0;
+    uint32_t multiplier = 1;
+    uint8_t digit;
+    uint8_t count = 0;
+    do {
+        if (*pos >= this->bufferSize) {
+            break;
+        }
+        digit = buffer[(*pos)++];
+        value += (digit & 127) * multiplier;
+        multiplier *= 128;
+    } while ((digit & 128) != 0 && ++count < 4);
+    return value;
+}
+
+uint16_t PubSubClient::propertyLength(uint16_t pos) {
+    switch (buffer[pos]) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            return 2;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            return 3;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            return 5;
+        case 0x0B: {
+            uint16_t end = pos+1;
+            readVariable(&end);
+            return end-pos;
+        }
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            // String or binary data
+            return 3+(buffer[pos+1]<<8)+buffer[pos+2];
+        case 0x26: {
+            // String pair
+            uint16_t l = 1+2+(buffer[pos+1]<<8)+buffer[pos+2];
+            return l+2+(buffer[pos+l]<<8)+buffer[pos+l+1];
+        }
+    }
+    return 0;
+}
+
+uint16_t PubSubClient::skipProperties(uint16_t pos) {
+    uint32_t length = readVariable(&pos);
+    if (pos+length > this->bufferSize) {
+        // Malformed - past anything that was read
+        return 0xFFFF;
+    }
+    return pos+length;
+}
+#endif
+
 uint16_t PubSubClient::writeString(const char* string, uint8_t* buf, uint16_t pos) {
     const char* idp = string;
     uint16_t i = 0;
@@ -610,6 +1695,9 @@ boolean PubSubClient::connected() {
                 _client->flush();
                 _client->stop();
             }
+        } else if (this->_state == MQTT_CONNECT_PENDING || this->_state == MQTT_CONNACK_PENDING) {
+            // Not connected until the CONNACK has been received
+            rc = false;
         }
     }
     return rc;
@@ -648,6 +1736,161 @@ PubSubClient& PubSubClient::setStream(Stream& stream){
     return *this;
 }
 
+PubSubClient& PubSubClient::setMessageCallbacks(MQTT_MESSAGE_BEGIN_SIGNATURE, MQTT_MESSAGE_DATA_SIGNATURE, MQTT_MESSAGE_END_SIGNATURE) {
+    this->onMessageBegin = onMessageBegin;
+    this->onMessageData = onMessageData;
+    this->onMessageEnd = onMessageEnd;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setRouter(MQTTRouter& router) {
+    this->router = &router;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setReconnect(MQTTReconnect& policy) {
+    this->reconnect = &policy;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setDiscovery(MQTTDiscovery& discovery) {
+    this->discovery = &discovery;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAlive(uint16_t keepAlive) {
+    this->keepAlive = keepAlive;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAliveMode(uint8_t mode) {
+    this->keepAliveMode = mode;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setStore(MQTTStore& store, const char* const* topics, uint8_t count) {
+    this->store = &store;
+    this->storeTopics = topics;
+    this->storeTopicCount = count;
+    this->lastDrain = millis();
+    return *this;
+}
+
+PubSubClient& PubSubClient::setStore(MQTTStore& store) {
+    return setStore(store,NULL,0);
+}
+
+PubSubClient& PubSubClient::setTopicPrefix(const char* prefix) {
+    this->topicPrefix = prefix;
+#if MQTT_VERSION == MQTT_VERSION_5
+    // The aliases now stand for different topics
+    this->topicAliasSent = 0;
+#endif
+    return *this;
+}
+
+PubSubClient& PubSubClient::setTopicTable(const char* const* table, uint8_t count) {
+    this->topicTable = table;
+    this->topicTableCount = count;
+#if MQTT_VERSION == MQTT_VERSION_5
+    this->topicAliasSent = 0;
+#endif
+    return *this;
+}
+
+PubSubClient& PubSubClient::setStoreDrainRate(uint8_t count, uint16_t interval) {
+    this->drainCount = count;
+    this->drainInterval = interval;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setStoreCallback(MQTT_STORE_DRAIN_SIGNATURE) {
+    this->onStoreDrain = onStoreDrain;
+    return *this;
+}
+
+boolean PubSubClient::setBufferSize(uint16_t size) {
+    if (size < MQTT_CONNECT_HEADER_SIZE) {
+        // The CONNECT header is built in the buffer before any length is checked
+        return false;
+    }
+    if (_state == MQTT_CONNECT_PENDING && size < MQTT_MAX_HEADER_SIZE + connectLength) {
+        // The CONNECT packet waiting to be sent must still fit
+        return false;
+    }
+    uint8_t* newBuffer;
+    if (bufferOwned) {
+        newBuffer = (uint8_t*)realloc(this->buffer, size);
+    } else {
+        newBuffer = (uint8_t*)malloc(size);
+    }
+    if (newBuffer == NULL) {
+        return false;
+    }
+    if (batchBuffer != NULL && batchBuffer == this->buffer) {
+        // Keep a batch being built in the packet buffer
+        batchBuffer = newBuffer;
+        batchSize = size;
+    }
+    this->buffer = newBuffer;
+    this->bufferSize = size;
+    this->bufferOwned = true;
+    return true;
+}
+
+boolean PubSubClient::setBuffer(uint8_t* buf, uint16_t size) {
+    if (buf == NULL || size < MQTT_CONNECT_HEADER_SIZE) {
+        return false;
+    }
+    if (_state == MQTT_CONNECT_PENDING) {
+        // The CONNECT packet waiting to be sent is in the current buffer
+        return false;
+    }
+    if (batchBuffer != NULL && batchBuffer == this->buffer) {
+        batchBuffer = NULL;
+    }
+    if (bufferOwned) {
+        free(this->buffer);
+    }
+    this->buffer = buf;
+    this->bufferSize = size;
+    this->bufferOwned = false;
+    return true;
+}
+
+uint16_t PubSubClient::getBufferSize() {
+    return this->bufferSize;
+}
+
 int PubSubClient::state() {
     return this->_state;
 }
+
+#if MQTT_STATS
+void PubSubClient::countPacket(uint16_t* packets, uint32_t* bytes, uint8_t header, uint32_t length) {
+    packets[header >> 4]++;
+    bytes[header >> 4] += length;
+}
+
+void PubSubClient::countTime(uint32_t* longest, unsigned long start) {
+    uint32_t elapsed = micros() - start;
+    if (elapsed > *longest) {
+        *longest = elapsed;
+    }
+    uint8_t bucket = 0;
+    uint32_t limit = 64;
+    while (bucket < MQTT_STATS_BUCKETS-1 && elapsed >= limit) {
+        bucket++;
+        limit <<= 2;
+    }
+    stats.latency[bucket]++;
+}
+
+const MQTTStats& PubSubClient::getStats() {
+    return stats;
+}
+
+void PubSubClient::resetStats() {
+    memset(&stats,0,sizeof(stats));
+}
+#endif
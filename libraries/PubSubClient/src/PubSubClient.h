@@ -14,34 +14,119 @@
 
 #define MQTT_VERSION_3_1      3
 #define MQTT_VERSION_3_1_1    4
+#define MQTT_VERSION_5        5
 
 // MQTT_VERSION : Pick the version
 //#define MQTT_VERSION MQTT_VERSION_3_1
+//#define MQTT_VERSION MQTT_VERSION_5
 #ifndef MQTT_VERSION
 #define MQTT_VERSION MQTT_VERSION_3_1_1
 #endif
 
-// MQTT_MAX_PACKET_SIZE : Maximum packet size
+// Length of the properties field in the packets the client sends. MQTT 5
+// packets carry an empty one unless they need a property.
+#if MQTT_VERSION == MQTT_VERSION_5
+#define MQTT_PROPERTIES_LENGTH 1
+#else
+#define MQTT_PROPERTIES_LENGTH 0
+#endif
+
+// MQTT_MAX_PACKET_SIZE : Default maximum packet size. This is the size of the
+//  buffer each client allocates; it can be changed at runtime with setBufferSize()
 #ifndef MQTT_MAX_PACKET_SIZE
 #define MQTT_MAX_PACKET_SIZE 128
 #endif
 
-// MQTT_KEEPALIVE : keepAlive interval in Seconds
+// MQTT_KEEPALIVE : default keepAlive interval in Seconds, see setKeepAlive()
 #ifndef MQTT_KEEPALIVE
 #define MQTT_KEEPALIVE 15
 #endif
 
+// Keepalive modes for setKeepAliveMode(). In every mode a ping is sent once
+// nothing was sent for the keepAlive interval, so the server always hears from
+// the client in time. To ping a quiet link less often, raise keepAlive.
+//  MQTT_KEEPALIVE_FIXED    : also ping once nothing was received for the interval
+//  MQTT_KEEPALIVE_OUTBOUND : do not ping for inbound silence
+//  MQTT_KEEPALIVE_ADAPTIVE : ping for inbound silence, starting at the interval
+//                            and doubling after each reply, up to
+//                            MQTT_KEEPALIVE_BACKOFF times the interval
+#define MQTT_KEEPALIVE_FIXED    0
+#define MQTT_KEEPALIVE_OUTBOUND 1
+#define MQTT_KEEPALIVE_ADAPTIVE 2
+
+// MQTT_KEEPALIVE_BACKOFF : longest inbound silence of MQTT_KEEPALIVE_ADAPTIVE, in keepAlive intervals
+#ifndef MQTT_KEEPALIVE_BACKOFF
+#define MQTT_KEEPALIVE_BACKOFF 8
+#endif
+
 // MQTT_SOCKET_TIMEOUT: socket timeout interval in Seconds
 #ifndef MQTT_SOCKET_TIMEOUT
 #define MQTT_SOCKET_TIMEOUT 15
 #endif
 
+// MQTT_MAX_INFLIGHT : Maximum number of outbound QoS 1 messages awaiting a PUBACK.
+//  0 leaves out QoS 1 publishing and its buffer; set it to 4 or so to use them.
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 0
+#endif
+
+// MQTT_INFLIGHT_BUFFER_SIZE : Bytes held for copies of the in-flight QoS 1 messages,
+//  used to retransmit them
+#ifndef MQTT_INFLIGHT_BUFFER_SIZE
+#define MQTT_INFLIGHT_BUFFER_SIZE 128
+#endif
+
+// MQTT_RETRY_TIMEOUT : interval in Seconds before an unacknowledged QoS 1 message
+//  is sent again
+#ifndef MQTT_RETRY_TIMEOUT
+#define MQTT_RETRY_TIMEOUT 10
+#endif
+
+// MQTT_STORE_DRAIN_COUNT, MQTT_STORE_DRAIN_INTERVAL : default rate at which stored
+//  messages are sent after reconnecting - count messages every interval milliseconds
+#ifndef MQTT_STORE_DRAIN_COUNT
+#define MQTT_STORE_DRAIN_COUNT 1
+#endif
+#ifndef MQTT_STORE_DRAIN_INTERVAL
+#define MQTT_STORE_DRAIN_INTERVAL 100
+#endif
+
+// MQTT_MAX_SUBSCRIBE_BATCH : maximum number of topic filters in one SUBSCRIBE
+//  or UNSUBSCRIBE, and of SUBACK return codes kept for getSubscribeResult()
+#ifndef MQTT_MAX_SUBSCRIBE_BATCH
+#define MQTT_MAX_SUBSCRIBE_BATCH 16
+#endif
+
+// MQTT_STATS : set to 1 to keep packet counters and timings, see getStats().
+//  Left at 0 they are compiled out.
+#ifndef MQTT_STATS
+#define MQTT_STATS 0
+#endif
+
+// MQTT_STATS_BUCKETS : number of buckets of the latency histogram. Bucket i
+//  counts the calls that took under 64 << (2*i) microseconds, the last one
+//  those that took longer.
+#ifndef MQTT_STATS_BUCKETS
+#define MQTT_STATS_BUCKETS 8
+#endif
+
+// MQTT_PROGMEM_CHUNK_SIZE : bytes copied out of PROGMEM onto the stack for
+//  each client write by publish_P() and writeP()
+#ifndef MQTT_PROGMEM_CHUNK_SIZE
+#define MQTT_PROGMEM_CHUNK_SIZE 32
+#endif
+
 // MQTT_MAX_TRANSFER_SIZE : limit how much data is passed to the network client
 //  in each write call. Needed for the Arduino Wifi Shield. Leave undefined to
 //  pass the entire MQTT packet in each write call.
 //#define MQTT_MAX_TRANSFER_SIZE 80
 
 // Possible values for client.state()
+#define MQTT_SUBACK_PENDING 0xFF
+#define MQTT_SUBACK_FAILURE 0x80
+
+#define MQTT_CONNACK_PENDING        -6
+#define MQTT_CONNECT_PENDING        -5
 #define MQTT_CONNECTION_TIMEOUT     -4
 #define MQTT_CONNECTION_LOST        -3
 #define MQTT_CONNECT_FAILED         -2
@@ -52,6 +137,8 @@
 #define MQTT_CONNECT_UNAVAILABLE     3
 #define MQTT_CONNECT_BAD_CREDENTIALS 4
 #define MQTT_CONNECT_UNAUTHORIZED    5
+// With MQTT 5 a refused connection leaves the CONNACK reason code, 0x80 or
+// above, in state()
 
 #define MQTTCONNECT     1 << 4  // Client request to connect to Server
 #define MQTTCONNACK     2 << 4  // Connect Acknowledgment
@@ -76,27 +163,113 @@
 // Maximum size of fixed header and variable length size header
 #define MQTT_MAX_HEADER_SIZE 5
 
+// Protocol name and level at the start of a CONNECT packet
+#if MQTT_VERSION == MQTT_VERSION_3_1
+#define MQTT_HEADER_VERSION_LENGTH 9
+#else
+#define MQTT_HEADER_VERSION_LENGTH 7
+#endif
+// The part of a CONNECT packet built before the client id: header, protocol,
+// flags, keep alive and, with MQTT 5, the Maximum Packet Size property.
+#if MQTT_VERSION == MQTT_VERSION_5
+#define MQTT_CONNECT_HEADER_SIZE (MQTT_MAX_HEADER_SIZE + MQTT_HEADER_VERSION_LENGTH + 3 + 6)
+#else
+#define MQTT_CONNECT_HEADER_SIZE (MQTT_MAX_HEADER_SIZE + MQTT_HEADER_VERSION_LENGTH + 3)
+#endif
+
 #if defined(ESP8266) || defined(ESP32)
 #include <functional>
 #define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+#define MQTT_MESSAGE_BEGIN_SIGNATURE std::function<void(char*, uint32_t)> onMessageBegin
+#define MQTT_MESSAGE_DATA_SIGNATURE std::function<void(uint8_t*, unsigned int)> onMessageData
+#define MQTT_MESSAGE_END_SIGNATURE std::function<void(boolean)> onMessageEnd
+#define MQTT_STORE_DRAIN_SIGNATURE std::function<void(uint8_t, uint32_t)> onStoreDrain
 #else
 #define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+#define MQTT_MESSAGE_BEGIN_SIGNATURE void (*onMessageBegin)(char*, uint32_t)
+#define MQTT_MESSAGE_DATA_SIGNATURE void (*onMessageData)(uint8_t*, unsigned int)
+#define MQTT_MESSAGE_END_SIGNATURE void (*onMessageEnd)(boolean)
+#define MQTT_STORE_DRAIN_SIGNATURE void (*onStoreDrain)(uint8_t, uint32_t)
 #endif
 
-#define CHECK_STRING_LENGTH(l,s) if (l+2+strlen(s) > MQTT_MAX_PACKET_SIZE) {_client->stop();return false;}
+#if MQTT_MAX_INFLIGHT > 0
+// An outbound QoS 1 message awaiting its PUBACK. The packet itself is kept
+// in the in-flight ring at offset.
+struct MQTTInflightMessage {
+   uint16_t msgId;
+   uint16_t offset;
+   uint16_t length;
+   unsigned long sentAt;
+   boolean acked;
+};
+#endif
+
+#if MQTT_STATS
+// Counters kept when MQTT_STATS is 1. Packets and bytes are counted by
+// packet type, the first byte of the packet shifted right by 4.
+struct MQTTStats {
+   uint16_t packetsIn[16];
+   uint16_t packetsOut[16];
+   uint32_t bytesIn[16];
+   uint32_t bytesOut[16];
+   // publish() calls that returned 0
+   uint16_t publishFailures;
+   // Connections made; above 1 they are reconnects
+   uint16_t connects;
+   // Round trip of the last ping and the longest one, in milliseconds
+   uint32_t pingRtt;
+   uint32_t pingRttMax;
+   // Longest time spent in a loop() and a publish() call, in microseconds
+   uint32_t loopMax;
+   uint32_t publishMax;
+   // How long loop() and publish() calls took, see MQTT_STATS_BUCKETS
+   uint32_t latency[MQTT_STATS_BUCKETS];
+};
+#endif
+
+class MQTTStore;
+class MQTTRouter;
+class MQTTReconnect;
+class MQTTDiscovery;
+
+#define CHECK_STRING_LENGTH(l,s) if (l+2+strlen(s) > this->bufferSize) {_client->stop();return false;}
+
+#if MQTT_STATS
+#define MQTT_COUNT_IN(h,l) countPacket(stats.packetsIn,stats.bytesIn,h,l)
+#define MQTT_COUNT_OUT(h,l) countPacket(stats.packetsOut,stats.bytesOut,h,l)
+#else
+#define MQTT_COUNT_IN(h,l)
+#define MQTT_COUNT_OUT(h,l)
+#endif
 
 class PubSubClient : public Print {
 private:
    Client* _client;
-   uint8_t buffer[MQTT_MAX_PACKET_SIZE];
+   uint8_t* buffer;
+   uint16_t bufferSize;
+   boolean bufferOwned;
    uint16_t nextMsgId;
+   uint16_t subackMsgId;
+   uint8_t subackCount;
+   uint8_t subackResults[MQTT_MAX_SUBSCRIBE_BATCH];
    unsigned long lastOutActivity;
    unsigned long lastInActivity;
    bool pingOutstanding;
+   uint16_t keepAlive;
+   uint8_t keepAliveMode;
+   // Keepalive of the current connection, and the inbound silence after which
+   // it is pinged, in milliseconds
+   unsigned long keepAliveInterval;
+   unsigned long pingInterval;
    MQTT_CALLBACK_SIGNATURE;
+   MQTT_MESSAGE_BEGIN_SIGNATURE;
+   MQTT_MESSAGE_DATA_SIGNATURE;
+   MQTT_MESSAGE_END_SIGNATURE;
    uint16_t readPacket(uint8_t*);
    boolean readByte(uint8_t * result);
    boolean readByte(uint8_t * result, uint16_t * index);
+   boolean readBytes(uint8_t* buf, uint16_t length);
+   void streamPublish(uint32_t length);
    boolean write(uint8_t header, uint8_t* buf, uint16_t length);
    uint16_t writeString(const char* string, uint8_t* buf, uint16_t pos);
    // Build up the header ready to send
@@ -109,6 +282,76 @@ private:
    uint16_t port;
    Stream* stream;
    int _state;
+   uint16_t connectLength;
+   MQTTRouter* router;
+   void dispatch(char* topic, uint8_t* payload, unsigned int length);
+   MQTTReconnect* reconnect;
+#if MQTT_STATS
+   MQTTStats stats;
+   unsigned long pingSentAt;
+   void countPacket(uint16_t* packets, uint32_t* bytes, uint8_t header, uint32_t length);
+   void countTime(uint32_t* longest, unsigned long start);
+#endif
+   boolean poll();
+   boolean publishQos0(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+#if MQTT_MAX_INFLIGHT > 0
+   boolean publishQos1(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+#endif
+   void runReconnect(unsigned long t);
+   void resubscribe();
+   MQTTDiscovery* discovery;
+   void sendDiscovery();
+   MQTTStore* store;
+   const char* const* storeTopics;
+   uint8_t storeTopicCount;
+   uint8_t drainCount;
+   uint16_t drainInterval;
+   unsigned long lastDrain;
+   MQTT_STORE_DRAIN_SIGNATURE;
+   void drainStore(unsigned long t);
+   const char* topicPrefix;
+   const char* const* topicTable;
+   uint8_t topicTableCount;
+#if MQTT_VERSION == MQTT_VERSION_5
+   // Topic alias maximum from the CONNACK, and which table entries have
+   // been sent with their alias on this connection
+   uint16_t topicAliasMax;
+   uint32_t topicAliasSent;
+   uint32_t readVariable(uint16_t* pos);
+   uint16_t propertyLength(uint16_t pos);
+   uint16_t skipProperties(uint16_t pos);
+#endif
+   const char* topicSuffix(uint8_t topic);
+   uint16_t topicLength(const char* prefix, const char* suffix, boolean progmem);
+   uint16_t writeTopic(const char* prefix, const char* suffix, boolean progmem, uint8_t* buf, uint16_t pos);
+   uint16_t writePublishTopic(const char* prefix, const char* suffix, boolean progmem, uint8_t alias, unsigned int plength);
+   boolean publishTopic(const char* suffix, boolean progmem, uint8_t alias, const uint8_t* payload, unsigned int plength, boolean retained);
+   void init();
+   void checkConnect();
+#if MQTT_MAX_INFLIGHT > 0
+   MQTTInflightMessage inflight[MQTT_MAX_INFLIGHT];
+   uint8_t inflightFirst;
+   uint8_t inflightCount;
+   uint8_t inflightWindow;
+   uint8_t inflightData[MQTT_INFLIGHT_BUFFER_SIZE];
+   uint16_t inflightDataFirst;
+   uint16_t inflightDataUsed;
+   boolean addInflight(uint16_t msgId, uint8_t* buf, uint16_t length);
+   void ackInflight(uint16_t msgId);
+   void retryInflight(unsigned long t, boolean all);
+#endif
+   uint8_t* writeBuffer;
+   uint16_t writeBufferSize;
+   uint16_t writeBufferUsed;
+   boolean writeFailed;
+   size_t writeStaged(const uint8_t* buf, size_t size);
+   // Write a packet built outside the staging buffer, after what is staged
+   size_t writeControl(const uint8_t* buf, size_t size);
+   boolean beginPublishTopic(const char* topic, boolean progmem, unsigned int plength, boolean retained);
+   uint8_t* batchBuffer;
+   uint16_t batchSize;
+   uint16_t batchLength;
+   boolean batchFailed;
 public:
    PubSubClient();
    PubSubClient(Client& client);
@@ -125,23 +368,114 @@ public:
    PubSubClient(const char*, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client);
    PubSubClient(const char*, uint16_t, MQTT_CALLBACK_SIGNATURE,Client& client, Stream&);
 
+   ~PubSubClient();
+
    PubSubClient& setServer(IPAddress ip, uint16_t port);
    PubSubClient& setServer(uint8_t * ip, uint16_t port);
    PubSubClient& setServer(const char * domain, uint16_t port);
    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+   // Dispatch inbound messages through router. The callback, if any, then
+   // only receives the messages no route matched.
+   PubSubClient& setRouter(MQTTRouter& router);
+   // Receive messages in pieces instead of through the callback or router:
+   // onMessageBegin gets the topic and payload length, onMessageData each piece
+   // of the payload as it is read, and onMessageEnd whether all of it arrived.
+   // The topic is only valid during onMessageBegin. Payloads are not limited by
+   // the buffer size. Pass NULLs to go back to the callback.
+   PubSubClient& setMessageCallbacks(MQTT_MESSAGE_BEGIN_SIGNATURE, MQTT_MESSAGE_DATA_SIGNATURE, MQTT_MESSAGE_END_SIGNATURE);
    PubSubClient& setClient(Client& client);
    PubSubClient& setStream(Stream& stream);
+   // Connect and reconnect from loop(), as policy sets out, and subscribe to its
+   // topics after every connect. disconnect() stops it until set again.
+   PubSubClient& setReconnect(MQTTReconnect& policy);
+   // Send the config messages of discovery from loop() after every connect
+   PubSubClient& setDiscovery(MQTTDiscovery& discovery);
+
+   // Set the keepAlive interval in seconds, 0 to disable pings. The server is
+   // told the interval on the next connect.
+   PubSubClient& setKeepAlive(uint16_t keepAlive);
+   // Choose when pings are sent, see MQTT_KEEPALIVE_FIXED and the other modes.
+   // With MQTT_KEEPALIVE_OUTBOUND a lost connection that is only published to
+   // is noticed when writing fails, rather than by a missing ping reply.
+   PubSubClient& setKeepAliveMode(uint8_t mode);
+
+   // Queue messages in store while they cannot be sent, and send them from loop()
+   // once connected again. Stored messages refer to their topic by its index in
+   // topics, which must outlive the client.
+   PubSubClient& setStore(MQTTStore& store, const char* const* topics, uint8_t count);
+   // As above, with stored messages referring to the topics of setTopicTable()
+   PubSubClient& setStore(MQTTStore& store);
+   // Send at most count stored messages every interval milliseconds, so a
+   // reconnect does not flood the server
+   PubSubClient& setStoreDrainRate(uint8_t count, uint16_t interval);
+   // Called after each stored message is sent, with its topic id and the
+   // millis() at which it was stored, such as to report how late it is
+   PubSubClient& setStoreCallback(MQTT_STORE_DRAIN_SIGNATURE);
+
+   // Set a prefix, such as "client-id/", that publishSuffix() and publishTopic()
+   // write in front of the topic. The string must outlive the client.
+   PubSubClient& setTopicPrefix(const char* prefix);
+   // Set a PROGMEM table of PROGMEM topic suffixes for publishTopic()
+   // With MQTT 5, entries below 32 are given topic aliases as far as the server
+   // allows, so after the first publish they are sent without the topic.
+   PubSubClient& setTopicTable(const char* const* table, uint8_t count);
+
+   // Resize the packet buffer, allocated on the heap. The contents are kept, so this
+   // is safe to call while connected. Inbound packets larger than the buffer are
+   // dropped (unless a Stream is set) and outbound ones are refused.
+   // Returns 1 if the buffer was resized, 0 if the allocation failed, size is
+   // below MQTT_CONNECT_HEADER_SIZE or a pending CONNECT would not fit
+   boolean setBufferSize(uint16_t size);
+   // Use a caller supplied buffer as the packet buffer instead of the heap. The
+   // buffer must outlive the client.
+   // Returns 1 if the buffer was accepted, 0 if it is smaller than MQTT_CONNECT_HEADER_SIZE
+   // or a CONNECT is waiting to be sent
+   boolean setBuffer(uint8_t* buf, uint16_t size);
+   uint16_t getBufferSize();
 
    boolean connect(const char* id);
    boolean connect(const char* id, const char* user, const char* pass);
    boolean connect(const char* id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
    boolean connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
    boolean connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession);
+   // Start to connect without blocking.
+   // Returns 1 if the attempt was started, 0 if already connected or the CONNECT
+   // packet does not fit in the buffer. Each call to loop() then advances the attempt:
+   //   MQTT_CONNECT_PENDING - the network connection is opened on the next loop()
+   //   MQTT_CONNACK_PENDING - CONNECT sent, waiting up to MQTT_SOCKET_TIMEOUT for CONNACK
+   //   MQTT_CONNECTED       - or one of the failure states, as for connect()
+   // Note the network connection itself is opened with the underlying client's own
+   // connect(), which may block depending on the hardware library.
+   boolean connectAsync(const char* id);
+   boolean connectAsync(const char* id, const char* user, const char* pass);
+   boolean connectAsync(const char* id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
+   boolean connectAsync(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
+   boolean connectAsync(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession);
    void disconnect();
    boolean publish(const char* topic, const char* payload);
    boolean publish(const char* topic, const char* payload, boolean retained);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // Publish at QoS 0 or 1. A QoS 1 message is kept until the server acknowledges it,
+   // and resent (flagged DUP) every MQTT_RETRY_TIMEOUT seconds and after a reconnect.
+   // Returns 1 if the message was sent or queued for retransmission, 0 if it is too
+   // long or the in-flight window is full
+   boolean publish(const char* topic, const char* payload, uint8_t qos, boolean retained);
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, uint8_t qos, boolean retained);
+   // Publish to the topic prefix followed by suffix, without building the
+   // topic string first
+   boolean publishSuffix(const char* suffix, const char* payload);
+   boolean publishSuffix(const char* suffix, const uint8_t* payload, unsigned int plength, boolean retained);
+   // Publish to the topic prefix followed by entry topic of the topic table
+   // Returns 0 if topic is not in the table
+   boolean publishTopic(uint8_t topic, const char* payload);
+   boolean publishTopic(uint8_t topic, const uint8_t* payload, unsigned int plength, boolean retained);
+   // Publish to topics[topicId] of the store set with setStore(). If not connected,
+   // the publish fails or older messages are still waiting, the message is stored
+   // instead, stamped with millis().
+   // Returns 1 if the message was sent or stored, 0 if there is no store
+   boolean publishOrStore(uint8_t topicId, const char* payload);
+   boolean publishOrStore(uint8_t topicId, const uint8_t* payload, uint8_t plength);
    boolean publish_P(const char* topic, const char* payload, boolean retained);
    boolean publish_P(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
    // Start to publish a message.
@@ -153,6 +487,8 @@ public:
    // a new buffer and held in memory at one time
    // Returns 1 if the message was started successfully, 0 if there was an error
    boolean beginPublish(const char* topic, unsigned int plength, boolean retained);
+   // As beginPublish, with the topic in PROGMEM
+   boolean beginPublish_P(const char* topic, unsigned int plength, boolean retained);
    // Finish off this publish message (started with beginPublish)
    // Returns 1 if the packet was sent successfully, 0 if there was an error
    int endPublish();
@@ -161,12 +497,63 @@ public:
    // Write size bytes from buffer into the payload (only to be used with beginPublish/endPublish)
    // Returns the number of bytes written
    virtual size_t write(const uint8_t *buffer, size_t size);
+   // Write size bytes from PROGMEM into the payload (only to be used with beginPublish/endPublish)
+   // Returns the number of bytes written
+   size_t writeP(const uint8_t *buffer, size_t size);
+   // Collect what beginPublish() and write() send in buf, and pass it to the
+   // network client when full, on endPublish() or on flush(), rather than one
+   // client write per call. Pass NULL to write straight through again.
+   // The buffer must outlive the client.
+   PubSubClient& setWriteBuffer(uint8_t* buf, uint16_t size);
+   // Send whatever the write buffer holds
+   virtual void flush();
+   // Start a batch of publish messages.
+   // This API:
+   //   beginBatch(...)
+   //   one or more calls to addToBatch(...)
+   //   endBatch()
+   // Packs the PUBLISH packets back-to-back into a single buffer so they are passed
+   // to the network client in one write call. If any message does not fit, the
+   // whole batch is refused and nothing is sent.
+   // beginBatch() uses the internal packet buffer, so no other publish/subscribe
+   // calls may be made until endBatch(). Alternatively, pass a dedicated buffer.
+   boolean beginBatch();
+   boolean beginBatch(uint8_t* buf, uint16_t size);
+   // Append a QoS 0 publish message to the current batch
+   // Returns 1 if the message was added, 0 if it did not fit (the batch is then refused)
+   boolean addToBatch(const char* topic, const char* payload);
+   boolean addToBatch(const char* topic, const char* payload, boolean retained);
+   boolean addToBatch(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // Send the batch
+   // Returns 1 if every message was sent, 0 if the batch was refused or the write failed
+   boolean endBatch();
+   // Discard the current batch without sending anything
+   void abortBatch();
+#if MQTT_MAX_INFLIGHT > 0
+   // Limit the number of unacknowledged QoS 1 messages (at most MQTT_MAX_INFLIGHT)
+   boolean setInflightWindow(uint8_t window);
+   // The number of QoS 1 messages awaiting a PUBACK
+   uint8_t getInflightCount();
+#endif
    boolean subscribe(const char* topic);
    boolean subscribe(const char* topic, uint8_t qos);
+   // Subscribe to count topic filters with a single SUBSCRIBE packet. qos may be
+   // NULL to subscribe to all of them at QoS 0.
+   boolean subscribe(const char* const* topics, const uint8_t* qos, uint8_t count);
+   // Returns the SUBACK return code for filter index of the last subscribe: the
+   // granted QoS, MQTT_SUBACK_FAILURE, or MQTT_SUBACK_PENDING until it arrives.
+   // With MQTT 5 failures are reported with their reason code.
+   uint8_t getSubscribeResult(uint8_t index);
    boolean unsubscribe(const char* topic);
+   // Unsubscribe from count topic filters with a single UNSUBSCRIBE packet
+   boolean unsubscribe(const char* const* topics, uint8_t count);
    boolean loop();
    boolean connected();
    int state();
+#if MQTT_STATS
+   const MQTTStats& getStats();
+   void resetStats();
+#endif
 };
 
 
@@ -0,0 +1,82 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "trace.h"
+
+// Compares one telemetry cycle of sketch_PZEM04 sent as individual
+// publish() calls against the same cycle sent as a single batch.
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+const char* topics[] = {
+    "amega-01/version", "amega-01/mac", "amega-01/ip", "amega-01/uptime",
+    "amega-01/v1", "amega-01/i1", "amega-01/p1", "amega-01/e1",
+    "amega-01/v2", "amega-01/i2", "amega-01/p2", "amega-01/e2",
+    "amega-01/v3", "amega-01/i3", "amega-01/p3", "amega-01/e3",
+    "amega-01/v4", "amega-01/i4", "amega-01/p4", "amega-01/e4",
+    "amega-01/value"
+};
+const char* payloads[] = {
+    "PZEM04_UIPE_MQTT_5.1", "f4-16-3e-12-c8-90", "192.168.17.90", "86400",
+    "229.8", "3.2", "712.4", "123456",
+    "231.1", "0.4", "80.0", "45678",
+    "228.5", "12.7", "2890.3", "987654",
+    "229.8", "16.3", "3682.7", "1156788",
+    "1156788"
+};
+#define TOPIC_COUNT (sizeof(topics)/sizeof(topics[0]))
+#define CYCLES 100
+
+void connect(ShimClient& shimClient, PubSubClient& client) {
+    shimClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    client.connect((char*)"amega-01");
+}
+
+void report(const char* name, ShimClient& shimClient, uint16_t writes, uint16_t bytes) {
+    LOG(name << ": " << (shimClient.writeCount()-writes)/CYCLES << " writes, "
+        << (shimClient.received()-bytes)/CYCLES << " bytes per cycle\n");
+}
+
+int main()
+{
+    LOG("Batch publish benchmark (" << TOPIC_COUNT << " messages per cycle)\n");
+    {
+        ShimClient shimClient;
+        PubSubClient client(server, 1883, callback, shimClient);
+        connect(shimClient, client);
+        uint16_t writes = shimClient.writeCount();
+        uint16_t bytes = shimClient.received();
+        for (int c = 0; c < CYCLES; c++) {
+            for (unsigned int i = 0; i < TOPIC_COUNT; i++) {
+                client.publish(topics[i], payloads[i]);
+            }
+        }
+        report(" - publish()", shimClient, writes, bytes);
+    }
+    {
+        ShimClient shimClient;
+        PubSubClient client(server, 1883, callback, shimClient);
+        connect(shimClient, client);
+        uint8_t batch[512];
+        uint16_t writes = shimClient.writeCount();
+        uint16_t bytes = shimClient.received();
+        for (int c = 0; c < CYCLES; c++) {
+            client.beginBatch(batch, sizeof(batch));
+            for (unsigned int i = 0; i < TOPIC_COUNT; i++) {
+                client.addToBatch(topics[i], payloads[i]);
+            }
+            if (!client.endBatch()) {
+                LOG("batch refused\n");
+                return 1;
+            }
+        }
+        report(" - batch", shimClient, writes, bytes);
+    }
+    return 0;
+}
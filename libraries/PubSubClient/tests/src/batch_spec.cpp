@@ -0,0 +1,173 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+int test_batch_single_write() {
+    IT("sends a batch of messages in a single write");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64,
+                      0x31,0x8,0x0,0x3,0x61,0x2f,0x62,0x41,0x42,0x43};
+    shimClient.expect(publish,26);
+    uint16_t writes = shimClient.writeCount();
+
+    rc = client.beginBatch();
+    IS_TRUE(rc);
+    rc = client.addToBatch((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    rc = client.addToBatch((char*)"a/b",(char*)"ABC",true);
+    IS_TRUE(rc);
+    rc = client.endBatch();
+    IS_TRUE(rc);
+
+    IS_TRUE(shimClient.writeCount() == writes + 1);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_batch_caller_buffer() {
+    IT("batches into a caller supplied buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint8_t batch[512];
+    uint8_t payload[150];
+    memset(payload,'A',150);
+
+    rc = client.beginBatch(batch,sizeof(batch));
+    IS_TRUE(rc);
+    // A message larger than MQTT_MAX_PACKET_SIZE fits into the caller's buffer
+    rc = client.addToBatch((char*)"topic",payload,150,false);
+    IS_TRUE(rc);
+    rc = client.addToBatch((char*)"topic",payload,150,false);
+    IS_TRUE(rc);
+
+    uint16_t received = shimClient.received();
+    rc = client.endBatch();
+    IS_TRUE(rc);
+    // 2 x (1 byte header + 2 bytes length + 2+5 topic + 150 payload)
+    IS_TRUE(shimClient.received() - received == 320);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_batch_refused_when_full() {
+    IT("refuses the whole batch when a message does not fit");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint8_t batch[24];
+    rc = client.beginBatch(batch,sizeof(batch));
+    IS_TRUE(rc);
+    rc = client.addToBatch((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    rc = client.addToBatch((char*)"topic",(char*)"payload");
+    IS_FALSE(rc);
+    // Once refused, the batch stays refused
+    rc = client.addToBatch((char*)"a",(char*)"b");
+    IS_FALSE(rc);
+
+    uint16_t received = shimClient.received();
+    rc = client.endBatch();
+    IS_FALSE(rc);
+    IS_TRUE(shimClient.received() == received);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_batch_abort() {
+    IT("discards an aborted batch");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.beginBatch();
+    IS_TRUE(rc);
+    rc = client.addToBatch((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    client.abortBatch();
+
+    uint16_t received = shimClient.received();
+    rc = client.addToBatch((char*)"topic",(char*)"payload");
+    IS_FALSE(rc);
+    rc = client.endBatch();
+    IS_FALSE(rc);
+    IS_TRUE(shimClient.received() == received);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_batch_not_connected() {
+    IT("batch fails when not connected");
+    ShimClient shimClient;
+
+    PubSubClient client(server, 1883, callback, shimClient);
+
+    int rc = client.beginBatch();
+    IS_TRUE(rc);
+    rc = client.addToBatch((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    rc = client.endBatch();
+    IS_FALSE(rc);
+    IS_TRUE(shimClient.received() == 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Batch");
+    test_batch_single_write();
+    test_batch_caller_buffer();
+    test_batch_refused_when_full();
+    test_batch_abort();
+    test_batch_not_connected();
+
+    FINISH
+}
@@ -0,0 +1,288 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "HeapCount.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+// sizeof(PubSubClient) of release 2.7 on a 64 bit host, before the packet
+// buffer was moved out of the instance
+#define BASELINE_FOOTPRINT 224
+
+byte server[] = { 172, 16, 0, 2 };
+
+bool callback_called = false;
+unsigned int lastLength;
+
+void reset_callback() {
+    callback_called = false;
+    lastLength = 0;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+    lastLength = length;
+}
+
+int test_buffer_default_size() {
+    IT("defaults to MQTT_MAX_PACKET_SIZE");
+    ShimClient shimClient;
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    IS_TRUE(client.getBufferSize() == MQTT_MAX_PACKET_SIZE);
+
+    END_IT
+}
+
+int test_buffer_shrink() {
+    IT("refuses messages larger than a shrunk buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.setBufferSize(64);
+    IS_TRUE(rc);
+    IS_TRUE(client.getBufferSize() == 64);
+
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint8_t payload[100];
+    memset(payload,'A',100);
+    rc = client.publish((char*)"topic",payload,50,false);
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",payload,60,false);
+    IS_FALSE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_buffer_too_small() {
+    IT("refuses a buffer too small for a packet header");
+    ShimClient shimClient;
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.setBufferSize(4);
+    IS_FALSE(rc);
+    IS_TRUE(client.getBufferSize() == MQTT_MAX_PACKET_SIZE);
+
+    uint8_t arena[4];
+    rc = client.setBuffer(arena,sizeof(arena));
+    IS_FALSE(rc);
+    IS_TRUE(client.getBufferSize() == MQTT_MAX_PACKET_SIZE);
+
+    // The fixed part of a CONNECT packet must fit
+    rc = client.setBufferSize(MQTT_CONNECT_HEADER_SIZE-1);
+    IS_FALSE(rc);
+    rc = client.setBufferSize(MQTT_CONNECT_HEADER_SIZE);
+    IS_TRUE(rc);
+    IS_TRUE(client.getBufferSize() == MQTT_CONNECT_HEADER_SIZE);
+
+    END_IT
+}
+
+int test_buffer_allocation_failed() {
+    IT("refuses to connect without a buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    heapFails = true;
+    PubSubClient client(server, 1883, callback, shimClient);
+    heapFails = false;
+    IS_TRUE(client.getBufferSize() == 0);
+
+    int rc = client.connect((char*)"client_test1");
+    IS_FALSE(rc);
+    IS_FALSE(client.connected());
+    IS_TRUE(shimClient.writeCount() == 0);
+
+    // A later resize allocates it
+    rc = client.setBufferSize(64);
+    IS_TRUE(rc);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    END_IT
+}
+
+int test_buffer_resize_while_connected() {
+    IT("resizes the buffer while connected");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint8_t payload[300];
+    memset(payload,'A',300);
+    rc = client.publish((char*)"topic",payload,300,false);
+    IS_FALSE(rc);
+
+    rc = client.setBufferSize(512);
+    IS_TRUE(rc);
+    IS_TRUE(client.connected());
+
+    uint16_t received = shimClient.received();
+    rc = client.publish((char*)"topic",payload,300,false);
+    IS_TRUE(rc);
+    // 1 byte header + 2 bytes length + 2+5 topic + 300 payload
+    IS_TRUE(shimClient.received() - received == 310);
+
+    byte publish[310] = {0x30,0xb3,0x02,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    memset(publish+10,'B',300);
+    shimClient.respond(publish,310);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(lastLength == 300);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_buffer_drops_oversized() {
+    IT("drops inbound messages larger than the buffer and keeps reading");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.setBufferSize(64);
+    IS_TRUE(rc);
+
+    byte bigPublish[80] = {0x30,78,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    memset(bigPublish+9,'A',71);
+    shimClient.respond(bigPublish,80);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,16);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(lastLength == 7);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_buffer_caller_supplied() {
+    IT("uses a caller supplied buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t arena[64];
+    memset(arena,0,sizeof(arena));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.setBuffer(arena,sizeof(arena));
+    IS_TRUE(rc);
+    IS_TRUE(client.getBufferSize() == 64);
+
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,16);
+
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    // The packet was built in the arena
+    IS_TRUE(memcmp(arena+MQTT_MAX_HEADER_SIZE-2,publish,16)==0);
+
+    // Switching back to a heap buffer releases the arena
+    rc = client.setBufferSize(32);
+    IS_TRUE(rc);
+    IS_TRUE(client.getBufferSize() == 32);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_buffer_footprint() {
+    IT("runs from a caller supplied buffer without touching the heap");
+    LOG("[" << sizeof(PubSubClient) << " bytes] ");
+    // The features added since stay within a few pointers of 2.7
+    IS_TRUE(sizeof(PubSubClient) <= BASELINE_FOOTPRINT + 64);
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t arena[64];
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.setBuffer(arena,sizeof(arena));
+    IS_TRUE(rc);
+
+    heapAllocations = 0;
+    heapCounting = true;
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,16);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+
+    reset_callback();
+    shimClient.respond(publish,16);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+
+    byte disconnect[] = {0xe0,0x00};
+    shimClient.expect(disconnect,2);
+    client.disconnect();
+    heapCounting = false;
+    IS_TRUE(heapAllocations == 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Buffer");
+    test_buffer_default_size();
+    test_buffer_shrink();
+    test_buffer_too_small();
+    test_buffer_allocation_failed();
+    test_buffer_resize_while_connected();
+    test_buffer_drops_oversized();
+    test_buffer_caller_supplied();
+    test_buffer_footprint();
+
+    FINISH
+}
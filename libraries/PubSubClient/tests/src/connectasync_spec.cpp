@@ -0,0 +1,220 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+#include <chrono>
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+// Returns the time spent inside a single call to loop(), in microseconds
+long timed_loop(PubSubClient& client, long* maxMicros) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    client.loop();
+    long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    if (elapsed > *maxMicros) {
+        *maxMicros = elapsed;
+    }
+    return elapsed;
+}
+
+int test_connect_async_returns_immediately() {
+    IT("starts an attempt without touching the network");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connectAsync((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECT_PENDING);
+    IS_FALSE(client.connected());
+    IS_TRUE(shimClient.received() == 0);
+
+    END_IT
+}
+
+int test_connect_async_success() {
+    IT("advances through CONNECT and CONNACK in loop()");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connectAsync((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.loop();
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNACK_PENDING);
+    IS_FALSE(client.connected());
+    // No publishing before the CONNACK arrives
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_FALSE(rc);
+
+    rc = client.loop();
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNACK_PENDING);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECTED);
+    IS_TRUE(client.connected());
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_connect_async_tcp_failure() {
+    IT("reports a failed network connection");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(false);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connectAsync((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.loop();
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECT_FAILED);
+
+    END_IT
+}
+
+int test_connect_async_bad_connack() {
+    IT("reports a bad CONNACK return code");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x02 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connectAsync((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.loop();
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECT_BAD_CLIENT_ID);
+    IS_FALSE(shimClient.connected());
+
+    END_IT
+}
+
+int test_connect_async_timeout() {
+    IT("times out without blocking loop()");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connectAsync((char*)"client_test1");
+    IS_TRUE(rc);
+
+    long maxMicros = 0;
+    for (int i = 0; i < 1000; i++) {
+        timed_loop(client, &maxMicros);
+        IS_TRUE(client.state() == MQTT_CONNACK_PENDING);
+    }
+    advanceMillis(MQTT_SOCKET_TIMEOUT*1000UL);
+    timed_loop(client, &maxMicros);
+    IS_TRUE(client.state() == MQTT_CONNECTION_TIMEOUT);
+    IS_FALSE(shimClient.connected());
+
+    LOG("[max " << maxMicros << "us in loop()] ");
+    // A blocking connect() would have spent MQTT_SOCKET_TIMEOUT seconds here
+    IS_TRUE(maxMicros < 10000);
+
+    END_IT
+}
+
+int test_connect_async_while_pending() {
+    IT("keeps the current attempt when called again");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connectAsync((char*)"client_test1");
+    IS_TRUE(rc);
+    client.loop();
+    IS_TRUE(client.state() == MQTT_CONNACK_PENDING);
+
+    uint16_t received = shimClient.received();
+    rc = client.connectAsync((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.state() == MQTT_CONNACK_PENDING);
+    client.loop();
+    IS_TRUE(shimClient.received() == received);
+
+    END_IT
+}
+
+int test_connect_async_when_connected() {
+    IT("refuses to start an attempt when already connected");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.connectAsync((char*)"client_test1");
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECTED);
+
+    END_IT
+}
+
+int test_connect_async_buffer_resize() {
+    IT("keeps the pending CONNECT when the buffer changes");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connectAsync((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Too small for the packet already built
+    rc = client.setBufferSize(MQTT_MAX_HEADER_SIZE+0x18-1);
+    IS_FALSE(rc);
+    uint8_t arena[64];
+    rc = client.setBuffer(arena,sizeof(arena));
+    IS_FALSE(rc);
+    rc = client.setBufferSize(MQTT_MAX_HEADER_SIZE+0x18);
+    IS_TRUE(rc);
+
+    client.loop();
+    IS_TRUE(client.state() == MQTT_CONNACK_PENDING);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Connect Async");
+    test_connect_async_returns_immediately();
+    test_connect_async_success();
+    test_connect_async_tcp_failure();
+    test_connect_async_bad_connack();
+    test_connect_async_timeout();
+    test_connect_async_while_pending();
+    test_connect_async_when_connected();
+    test_connect_async_buffer_resize();
+
+    FINISH
+}
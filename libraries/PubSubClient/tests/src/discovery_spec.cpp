@@ -0,0 +1,235 @@
+#include "PubSubClient.h"
+#include "MQTTDiscovery.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "HeapCount.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+// The buffers publishing an entry puts on the stack: the topic, one chunk
+// copied out of flash and the entry itself
+static_assert(MQTT_DISCOVERY_TOPIC_SIZE + MQTT_PROGMEM_CHUNK_SIZE + sizeof(MQTTEntity) <= 192,
+              "discovery stack buffers grew");
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+
+static const char nameVoltage[] PROGMEM = "Voltage L1";
+static const char nameRelay[] PROGMEM = "Relay 1";
+static const char namePwm[] PROGMEM = "PWM line 1";
+static const char nameOnline[] PROGMEM = "Online";
+static const char unitVolt[] PROGMEM = "V";
+static const char unitPercent[] PROGMEM = "%";
+static const char suffixVoltage[] PROGMEM = "voltage1";
+static const char suffixRelay[] PROGMEM = "relay1";
+static const char suffixPwm[] PROGMEM = "pwm1";
+static const char suffixOnline[] PROGMEM = "online";
+static const char classVoltage[] PROGMEM = "voltage";
+static const char classConnectivity[] PROGMEM = "connectivity";
+
+static const MQTTEntity entities[] PROGMEM = {
+    { MQTT_DISCOVERY_SENSOR, nameVoltage, unitVolt, suffixVoltage, classVoltage },
+    { MQTT_DISCOVERY_SWITCH, nameRelay, NULL, suffixRelay, NULL },
+    { MQTT_DISCOVERY_NUMBER, namePwm, unitPercent, suffixPwm, NULL },
+    { MQTT_DISCOVERY_BINARY_SENSOR, nameOnline, NULL, suffixOnline, classConnectivity },
+    { MQTT_DISCOVERY_SENSOR, nameVoltage, unitVolt, suffixVoltage, classVoltage },
+    { MQTT_DISCOVERY_SENSOR, nameVoltage, unitVolt, suffixVoltage, classVoltage }
+};
+
+// Writes a retained PUBLISH of payload to topic into buf
+// Returns the length of the packet
+int packet(uint8_t* buf, const char* topic, const char* payload) {
+    int tlen = strlen(topic);
+    int plen = strlen(payload);
+    int len = 2 + tlen + plen;
+    int pos = 0;
+    buf[pos++] = 0x31;
+    do {
+        uint8_t digit = len % 128;
+        len = len / 128;
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        buf[pos++] = digit;
+    } while (len > 0);
+    buf[pos++] = tlen >> 8;
+    buf[pos++] = tlen & 0xFF;
+    memcpy(buf+pos,topic,tlen);
+    pos += tlen;
+    memcpy(buf+pos,payload,plen);
+    return pos + plen;
+}
+
+int test_discovery_sensor() {
+    IT("publishes the retained config of a sensor");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTDiscovery discovery("homeassistant","asc_0a1b","asc/0a1b");
+    discovery.setEntities(entities,6);
+
+    uint8_t expected[256];
+    int length = packet(expected,"homeassistant/sensor/asc_0a1b/voltage1/config",
+        "{\"~\":\"asc/0a1b\",\"name\":\"Voltage L1\",\"stat_t\":\"~/voltage1\","
+        "\"unit_of_meas\":\"V\",\"dev_cla\":\"voltage\",\"uniq_id\":\"asc_0a1b_voltage1\"}");
+    shimClient.expect(expected,length);
+
+    rc = discovery.publish(client,0);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_discovery_switch() {
+    IT("streams a config larger than the packet buffer without allocating");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTDiscovery discovery("homeassistant","asc_0a1b","asc/0a1b");
+    discovery.setEntities(entities,6).setDevice("ASC controller");
+
+    const char* payload = "{\"~\":\"asc/0a1b\",\"name\":\"Relay 1\",\"stat_t\":\"~/relay1\","
+        "\"cmd_t\":\"~/relay1/set\",\"uniq_id\":\"asc_0a1b_relay1\","
+        "\"dev\":{\"ids\":\"asc_0a1b\",\"name\":\"ASC controller\"}}";
+    IS_TRUE(strlen(payload) > MQTT_MAX_PACKET_SIZE);
+    uint8_t expected[256];
+    int length = packet(expected,"homeassistant/switch/asc_0a1b/relay1/config",payload);
+    shimClient.expect(expected,length);
+
+    heapAllocations = 0;
+    heapCounting = true;
+    rc = discovery.publish(client,1);
+    heapCounting = false;
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    IS_TRUE(heapAllocations == 0);
+    IS_TRUE(sizeof(MQTTDiscovery) <= 48);
+
+    END_IT
+}
+
+int test_discovery_number() {
+    IT("gives numbers a command topic and a unit");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTDiscovery discovery("homeassistant","asc_0a1b","asc/0a1b");
+    discovery.setEntities(entities,6);
+
+    uint8_t expected[256];
+    int length = packet(expected,"homeassistant/number/asc_0a1b/pwm1/config",
+        "{\"~\":\"asc/0a1b\",\"name\":\"PWM line 1\",\"stat_t\":\"~/pwm1\","
+        "\"cmd_t\":\"~/pwm1/set\",\"unit_of_meas\":\"%\",\"uniq_id\":\"asc_0a1b_pwm1\"}");
+    shimClient.expect(expected,length);
+
+    rc = discovery.publish(client,2);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_discovery_refuses() {
+    IT("refuses entries it cannot send");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+
+    MQTTDiscovery discovery("homeassistant","asc_0a1b","asc/0a1b");
+    IS_FALSE(discovery.publish(client,0));
+    discovery.setEntities(entities,6);
+    IS_FALSE(discovery.publish(client,6));
+    // Not connected
+    IS_FALSE(discovery.publish(client,0));
+
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    MQTTDiscovery longNode("homeassistant",
+        "a_node_id_that_is_far_too_long_to_fit_in_the_topic_buffer_0123456789","asc");
+    longNode.setEntities(entities,6);
+    IS_FALSE(longNode.publish(client,0));
+    // Only the CONNECT was sent
+    IS_TRUE(shimClient.received() == 26);
+
+    END_IT
+}
+
+int test_discovery_connect() {
+    IT("sends every config from loop after each connect");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    MQTTDiscovery discovery("homeassistant","asc_0a1b","asc/0a1b");
+    discovery.setEntities(entities,6);
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setDiscovery(discovery);
+    IS_TRUE(discovery.pending() == 6);
+
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(discovery.pending() == 6);
+
+    uint16_t received = shimClient.received();
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(discovery.pending() == 6 - MQTT_DISCOVERY_BATCH);
+    IS_TRUE(shimClient.received() > received);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(discovery.pending() == 0);
+
+    received = shimClient.received();
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.received() == received);
+
+    // A new connection gets them all again
+    client.disconnect();
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(discovery.pending() == 6);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(discovery.pending() == 6 - MQTT_DISCOVERY_BATCH);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Discovery");
+
+    test_discovery_sensor();
+    test_discovery_switch();
+    test_discovery_number();
+    test_discovery_refuses();
+    test_discovery_connect();
+
+    FINISH
+}
@@ -0,0 +1,290 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+int test_publish_qos1() {
+    IT("publishes a qos1 message and holds it until acknowledged");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,18);
+
+    rc = client.publish((char*)"topic",(char*)"payload",1,false);
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflightCount() == 1);
+
+    byte puback[] = {0x40,0x2,0x0,0x2};
+    shimClient.respond(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflightCount() == 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos1_retry() {
+    IT("resends an unacknowledged message with the DUP flag");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x33,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,18);
+    rc = client.publish((char*)"topic",(char*)"payload",1,true);
+    IS_TRUE(rc);
+
+    // Nothing is resent before the timeout
+    uint16_t received = shimClient.received();
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.received() == received);
+
+    byte dup[] = {0x3b,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(dup,18);
+    advanceMillis(MQTT_RETRY_TIMEOUT*1000UL);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflightCount() == 1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos1_window() {
+    IT("refuses qos1 messages when the window is full");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.setInflightWindow(0);
+    IS_FALSE(rc);
+    rc = client.setInflightWindow(MQTT_MAX_INFLIGHT+1);
+    IS_FALSE(rc);
+    rc = client.setInflightWindow(2);
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(char*)"1",1,false);
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",(char*)"2",1,false);
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",(char*)"3",1,false);
+    IS_FALSE(rc);
+    // QoS 0 is not affected by the window
+    rc = client.publish((char*)"topic",(char*)"4",0,false);
+    IS_TRUE(rc);
+
+    // Acknowledged out of order: the window opens once the first is released
+    byte puback3[] = {0x40,0x2,0x0,0x3};
+    shimClient.respond(puback3,4);
+    client.loop();
+    IS_TRUE(client.getInflightCount() == 2);
+    rc = client.publish((char*)"topic",(char*)"3",1,false);
+    IS_FALSE(rc);
+
+    byte puback2[] = {0x40,0x2,0x0,0x2};
+    shimClient.respond(puback2,4);
+    client.loop();
+    IS_TRUE(client.getInflightCount() == 0);
+    rc = client.publish((char*)"topic",(char*)"3",1,false);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos1_buffer_full() {
+    IT("refuses qos1 messages when the in-flight buffer is full");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    client.setBufferSize(MQTT_INFLIGHT_BUFFER_SIZE+MQTT_MAX_HEADER_SIZE);
+    uint8_t payload[MQTT_INFLIGHT_BUFFER_SIZE];
+    memset(payload,'A',sizeof(payload));
+    // 2 byte header + 7 byte topic + 2 byte id
+    rc = client.publish((char*)"topic",payload,MQTT_INFLIGHT_BUFFER_SIZE-11,1,false);
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",payload,1,1,false);
+    IS_FALSE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos1_wrap() {
+    IT("resends a message that wraps around the in-flight buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Each packet takes half the buffer, less a little
+    uint16_t plength = MQTT_INFLIGHT_BUFFER_SIZE/2 - 11 - 4;
+    uint8_t payload[MQTT_INFLIGHT_BUFFER_SIZE];
+    memset(payload,'A',sizeof(payload));
+
+    rc = client.publish((char*)"topic",payload,plength,1,false);
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",payload,plength,1,false);
+    IS_TRUE(rc);
+    byte puback[] = {0x40,0x2,0x0,0x2};
+    shimClient.respond(puback,4);
+    client.loop();
+    IS_TRUE(client.getInflightCount() == 1);
+
+    payload[0] = 'B';
+    payload[plength-1] = 'C';
+    rc = client.publish((char*)"topic",payload,plength,1,false);
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflightCount() == 2);
+
+    // Both are resent in order, the second in two pieces
+    byte expected[2*MQTT_INFLIGHT_BUFFER_SIZE];
+    uint16_t pos = 0;
+    for (int m = 0; m < 2; m++) {
+        expected[pos++] = 0x3a;
+        expected[pos++] = 2+5+2+plength;
+        expected[pos++] = 0x0;
+        expected[pos++] = 0x5;
+        memcpy(expected+pos,"topic",5);
+        pos += 5;
+        expected[pos++] = 0x0;
+        expected[pos++] = 3+m;
+        memset(expected+pos,'A',plength);
+        if (m == 1) {
+            expected[pos] = 'B';
+            expected[pos+plength-1] = 'C';
+        }
+        pos += plength;
+    }
+    shimClient.expect(expected,pos);
+    uint16_t writes = shimClient.writeCount();
+    advanceMillis(MQTT_RETRY_TIMEOUT*1000UL);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.writeCount() - writes == 3);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos1_reconnect() {
+    IT("resends unacknowledged messages after reconnecting");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(char*)"payload",1,false);
+    IS_TRUE(rc);
+
+    shimClient.setConnected(false);
+    IS_FALSE(client.connected());
+    rc = client.publish((char*)"topic",(char*)"payload",1,false);
+    IS_FALSE(rc);
+
+    shimClient.respond(connack,4);
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    byte dup[] = {0x3a,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(connect,26);
+    shimClient.expect(dup,18);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflightCount() == 1);
+
+    // New ids do not collide with the message still in flight
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x3,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,18);
+    rc = client.publish((char*)"topic",(char*)"payload",1,false);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_invalid_qos() {
+    IT("publish fails with invalid qos values");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(char*)"payload",2,false);
+    IS_FALSE(rc);
+    IS_TRUE(client.getInflightCount() == 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("In-flight");
+    test_publish_qos1();
+    test_publish_qos1_retry();
+    test_publish_qos1_window();
+    test_publish_qos1_buffer_full();
+    test_publish_qos1_wrap();
+    test_publish_qos1_reconnect();
+    test_publish_invalid_qos();
+
+    FINISH
+}
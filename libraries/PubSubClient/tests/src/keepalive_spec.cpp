@@ -172,6 +172,283 @@ int test_keepalive_disconnects_hung() {
     END_IT
 }
 
+// Runs loop() once a simulated second for the given number of seconds,
+// publishing every publishEvery seconds (0 for never) and answering each
+// ping. Records the second of each ping in pingAt, returns how many were sent.
+int run(PubSubClient& client, ShimClient& shimClient, int seconds, int publishEvery, int* pingAt) {
+    byte pingresp[] = { 0xD0,0x0 };
+    int pings = 0;
+    for (int i = 1; i <= seconds; i++) {
+        advanceMillis(1000);
+        if (publishEvery && i % publishEvery == 0) {
+            client.publish((char*)"topic",(char*)"payload");
+        }
+        uint16_t before = shimClient.received();
+        if (!client.loop()) {
+            return -1;
+        }
+        if (shimClient.received()-before == 2) {
+            if (pingAt) {
+                pingAt[pings] = i;
+            }
+            pings++;
+            shimClient.respond(pingresp,2);
+        }
+    }
+    return pings;
+}
+
+int test_keepalive_runtime_interval() {
+    IT("sends a runtime keepalive interval and pings at it");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setKeepAlive(60);
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0x3c,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    int pingAt[8];
+    int pings = run(client,shimClient,130,0,pingAt);
+    IS_TRUE(pings == 2);
+    IS_TRUE(pingAt[0] >= 60 && pingAt[0] <= 62);
+    IS_TRUE(pingAt[1]-pingAt[0] >= 60 && pingAt[1]-pingAt[0] <= 62);
+
+    END_IT
+}
+
+int test_keepalive_disabled() {
+    IT("does not ping with a keepalive of 0");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setKeepAlive(0);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    IS_TRUE(run(client,shimClient,120,0,NULL) == 0);
+    IS_TRUE(client.connected());
+
+    END_IT
+}
+
+int test_keepalive_outbound_suppresses_pings() {
+    IT("does not ping while publishing in outbound mode");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setKeepAliveMode(MQTT_KEEPALIVE_OUTBOUND);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Publishing every 10 seconds keeps a 15 second keepalive satisfied
+    IS_TRUE(run(client,shimClient,120,10,NULL) == 0);
+
+    // Once publishing stops, pings resume
+    int pingAt[8];
+    int pings = run(client,shimClient,40,0,pingAt);
+    IS_TRUE(pings == 2);
+    IS_TRUE(pingAt[0] >= 15 && pingAt[0] <= 17);
+
+    END_IT
+}
+
+int test_keepalive_fixed_pings_while_publishing() {
+    IT("pings while publishing in fixed mode");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // The publishes land in the same second as some pings, so only check
+    // that inbound silence is still probed
+    int pings = run(client,shimClient,120,10,NULL);
+    IS_TRUE(pings >= 6);
+
+    END_IT
+}
+
+int test_keepalive_outbound_times_out() {
+    IT("disconnects an unanswered ping in outbound mode while publishing");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setKeepAliveMode(MQTT_KEEPALIVE_OUTBOUND);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Go quiet until a ping is sent, but do not answer it
+    for (int i = 0; i < 17; i++) {
+        advanceMillis(1000);
+        rc = client.loop();
+    }
+    IS_TRUE(rc);
+    for (int i = 0; i < 17 && rc; i++) {
+        advanceMillis(1000);
+        client.publish((char*)"topic",(char*)"payload");
+        rc = client.loop();
+    }
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECTION_TIMEOUT);
+
+    END_IT
+}
+
+int test_keepalive_adaptive_backs_off() {
+    IT("backs off the pings of a publishing link in adaptive mode");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setKeepAliveMode(MQTT_KEEPALIVE_ADAPTIVE);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Publishing every 10 seconds keeps a 15 second keepalive satisfied, so
+    // the replies are checked for after 15, 30, 60 and then 120 seconds
+    int pingAt[16];
+    int pings = run(client,shimClient,600,10,pingAt);
+    IS_TRUE(pings == 7);
+    int expected[] = { 15, 30, 60, 120, 120, 120, 120 };
+    int last = 0;
+    for (int i = 0; i < 7 && i < pings; i++) {
+        IS_TRUE(pingAt[i]-last >= expected[i] && pingAt[i]-last <= expected[i]+2);
+        last = pingAt[i];
+    }
+
+    // A new connection starts again from the keepalive
+    client.disconnect();
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    pings = run(client,shimClient,20,10,pingAt);
+    IS_TRUE(pings == 1);
+    IS_TRUE(pingAt[0] >= 15 && pingAt[0] <= 17);
+
+    END_IT
+}
+
+int test_keepalive_adaptive_fewer_pings() {
+    IT("sends fewer pings while publishing in adaptive mode than in fixed mode");
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    int pingAt[64];
+
+    ShimClient fixedShim;
+    fixedShim.setAllowConnect(true);
+    fixedShim.respond(connack,4);
+    PubSubClient fixed(server, 1883, callback, fixedShim);
+    int rc = fixed.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    int fixedPings = run(fixed,fixedShim,600,10,pingAt);
+
+    ShimClient adaptiveShim;
+    adaptiveShim.setAllowConnect(true);
+    adaptiveShim.respond(connack,4);
+    PubSubClient adaptive(server, 1883, callback, adaptiveShim);
+    adaptive.setKeepAliveMode(MQTT_KEEPALIVE_ADAPTIVE);
+    rc = adaptive.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    int adaptivePings = run(adaptive,adaptiveShim,600,10,pingAt);
+    LOG("[" << fixedPings << " fixed, " << adaptivePings << " adaptive] ");
+
+    IS_TRUE(adaptivePings > 0);
+    IS_TRUE(adaptivePings*4 < fixedPings);
+    IS_TRUE(adaptive.connected());
+
+    END_IT
+}
+
+int test_keepalive_adaptive_idle() {
+    IT("still pings an idle link every keepalive in adaptive mode");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setKeepAliveMode(MQTT_KEEPALIVE_ADAPTIVE);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Never silent for longer than the keepalive it asked the server for
+    int pingAt[16];
+    int pings = run(client,shimClient,200,0,pingAt);
+    IS_TRUE(pings >= 11);
+    int last = 0;
+    for (int i = 0; i < pings; i++) {
+        IS_TRUE(pingAt[i]-last >= MQTT_KEEPALIVE && pingAt[i]-last <= MQTT_KEEPALIVE+1);
+        last = pingAt[i];
+    }
+
+    END_IT
+}
+
+int test_keepalive_adaptive_times_out() {
+    IT("disconnects an unanswered ping after backing off in adaptive mode");
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setKeepAliveMode(MQTT_KEEPALIVE_ADAPTIVE);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(run(client,shimClient,300,10,NULL) > 0);
+
+    // Keep publishing but stop answering. The next ping comes within the
+    // backed off interval, and its reply is only waited for one keepalive.
+    int i;
+    for (i = 0; i < MQTT_KEEPALIVE*MQTT_KEEPALIVE_BACKOFF + MQTT_KEEPALIVE + 2 && rc; i++) {
+        advanceMillis(1000);
+        if (i % 10 == 0) {
+            client.publish((char*)"topic",(char*)"payload");
+        }
+        rc = client.loop();
+    }
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECTION_TIMEOUT);
+
+    END_IT
+}
+
 int main()
 {
     SUITE("Keep-alive");
@@ -180,6 +457,15 @@ int main()
     test_keepalive_pings_with_inbound_qos0();
     test_keepalive_no_pings_inbound_qos1();
     test_keepalive_disconnects_hung();
+    test_keepalive_runtime_interval();
+    test_keepalive_disabled();
+    test_keepalive_outbound_suppresses_pings();
+    test_keepalive_fixed_pings_while_publishing();
+    test_keepalive_outbound_times_out();
+    test_keepalive_adaptive_backs_off();
+    test_keepalive_adaptive_fewer_pings();
+    test_keepalive_adaptive_idle();
+    test_keepalive_adaptive_times_out();
 
     FINISH
 }
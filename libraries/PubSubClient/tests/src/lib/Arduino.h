@@ -6,7 +6,9 @@
 #include <string.h>
 #include <math.h>
 #include "Print.h"
-
+#ifdef COUNT_HEAP
+#include "HeapCount.h"
+#endif
 
 extern "C"{
     typedef uint8_t byte ;
@@ -16,10 +18,15 @@ extern "C"{
     extern void setup( void ) ;
     extern void loop( void ) ;
     uint32_t millis( void );
+    uint32_t micros( void );
 }
 
 #define PROGMEM
+#define PSTR(s) (s)
 #define pgm_read_byte_near(x) *(x)
+#define pgm_read_ptr(x) *(x)
+#define strlen_P strlen
+#define memcpy_P memcpy
 
 #define yield(x) {}
 
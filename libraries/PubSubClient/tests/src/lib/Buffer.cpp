@@ -11,8 +11,8 @@ Buffer::Buffer(uint8_t* buf, size_t size) {
     this->length = 0;
     this->add(buf,size);
 }
-bool Buffer::available() {
-    return this->pos < this->length;
+int Buffer::available() {
+    return this->length - this->pos;
 }
 
 uint8_t Buffer::next() {
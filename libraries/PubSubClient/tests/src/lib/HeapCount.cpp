@@ -0,0 +1,37 @@
+#include <stdlib.h>
+
+// Built without HeapCount.h, so these call the real allocator
+
+bool heapCounting = false;
+unsigned long heapAllocations = 0;
+bool heapFails = false;
+
+void* countMalloc(size_t size) {
+    if (heapCounting) {
+        heapAllocations++;
+    }
+    if (heapFails) {
+        return NULL;
+    }
+    return malloc(size);
+}
+
+void* countCalloc(size_t count, size_t size) {
+    if (heapCounting) {
+        heapAllocations++;
+    }
+    if (heapFails) {
+        return NULL;
+    }
+    return calloc(count,size);
+}
+
+void* countRealloc(void* ptr, size_t size) {
+    if (heapCounting) {
+        heapAllocations++;
+    }
+    if (heapFails) {
+        return NULL;
+    }
+    return realloc(ptr,size);
+}
@@ -0,0 +1,23 @@
+#ifndef heapcount_h
+#define heapcount_h
+
+// Counts the heap allocations of code built with -DCOUNT_HEAP. Arduino.h
+// includes this, so the calls made by the library are routed through here
+// without depending on how the C library implements them.
+
+#include <stdlib.h>
+
+extern bool heapCounting;
+extern unsigned long heapAllocations;
+// Make every allocation fail, as on a device out of memory
+extern bool heapFails;
+
+void* countMalloc(size_t size);
+void* countCalloc(size_t count, size_t size);
+void* countRealloc(void* ptr, size_t size);
+
+#define malloc(size) countMalloc(size)
+#define calloc(count,size) countCalloc(count,size)
+#define realloc(ptr,size) countRealloc(ptr,size)
+
+#endif
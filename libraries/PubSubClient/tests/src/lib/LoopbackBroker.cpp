@@ -0,0 +1,257 @@
+#include "LoopbackBroker.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#define MAX_CONNECTIONS 16
+
+struct Connection {
+    int fd;
+    std::vector<uint8_t> in;
+    std::vector<std::string> filters;
+};
+
+LoopbackBroker::LoopbackBroker() {
+    this->listener = -1;
+    this->_port = 0;
+    this->pid = -1;
+}
+
+LoopbackBroker::~LoopbackBroker() {
+    stop();
+}
+
+bool LoopbackBroker::start() {
+    this->listener = socket(AF_INET,SOCK_STREAM,0);
+    if (this->listener < 0) {
+        return false;
+    }
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(this->listener,(struct sockaddr*)&addr,sizeof(addr)) != 0 ||
+        listen(this->listener,MAX_CONNECTIONS) != 0 ||
+        getsockname(this->listener,(struct sockaddr*)&addr,&len) != 0) {
+        close(this->listener);
+        return false;
+    }
+    this->_port = ntohs(addr.sin_port);
+    this->pid = fork();
+    if (this->pid == 0) {
+        serve();
+        _exit(0);
+    }
+    // Only the child accepts connections
+    close(this->listener);
+    this->listener = -1;
+    return this->pid > 0;
+}
+
+void LoopbackBroker::stop() {
+    if (this->pid > 0) {
+        kill(this->pid,SIGTERM);
+        waitpid(this->pid,NULL,0);
+        this->pid = -1;
+    }
+}
+
+uint16_t LoopbackBroker::port() {
+    return this->_port;
+}
+
+bool LoopbackBroker::matches(const char* filter, const char* topic) {
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        }
+        if (*filter == '+') {
+            while (*topic && *topic != '/') {
+                topic++;
+            }
+            filter++;
+        } else {
+            if (*filter != *topic) {
+                // "a/#" also matches "a"
+                return (*topic == 0 && filter[0] == '/' && filter[1] == '#' && filter[2] == 0);
+            }
+            filter++;
+            topic++;
+        }
+    }
+    return *topic == 0;
+}
+
+static void sendAll(int fd, const uint8_t* buf, size_t length) {
+    while (length > 0) {
+        ssize_t rc = send(fd,buf,length,MSG_NOSIGNAL);
+        if (rc <= 0) {
+            return;
+        }
+        buf += rc;
+        length -= rc;
+    }
+}
+
+static void sendPacket(int fd, uint8_t header, const uint8_t* body, size_t length) {
+    std::vector<uint8_t> packet;
+    packet.push_back(header);
+    size_t len = length;
+    do {
+        uint8_t digit = len % 128;
+        len /= 128;
+        packet.push_back(len > 0 ? (digit | 0x80) : digit);
+    } while (len > 0);
+    packet.insert(packet.end(),body,body+length);
+    sendAll(fd,packet.data(),packet.size());
+}
+
+// Handles one complete packet from connections[c]
+// Returns false to close the connection
+static bool handle(std::vector<Connection>& connections, size_t c, uint8_t header, const uint8_t* body, size_t length) {
+    Connection& conn = connections[c];
+    uint8_t type = header & 0xF0;
+    if (type == 0x10) {
+        // CONNECT - accept anything
+        uint8_t connack[] = { 0x00, 0x00 };
+        sendPacket(conn.fd,0x20,connack,2);
+    } else if (type == 0x30) {
+        if (length < 2) {
+            return false;
+        }
+        size_t tl = (body[0]<<8) + body[1];
+        size_t pos = 2 + tl;
+        uint8_t qos = (header >> 1) & 0x03;
+        if (pos + (qos ? 2 : 0) > length) {
+            return false;
+        }
+        std::string topic((const char*)body+2,tl);
+        if (qos) {
+            sendPacket(conn.fd,0x40,body+pos,2);
+            pos += 2;
+        }
+        std::vector<uint8_t> out(body,body+2+tl);
+        out.insert(out.end(),body+pos,body+length);
+        for (size_t i = 0; i < connections.size(); i++) {
+            for (size_t f = 0; f < connections[i].filters.size(); f++) {
+                if (LoopbackBroker::matches(connections[i].filters[f].c_str(),topic.c_str())) {
+                    sendPacket(connections[i].fd,0x30,out.data(),out.size());
+                    break;
+                }
+            }
+        }
+    } else if (type == 0x80 || type == 0xA0) {
+        // SUBSCRIBE or UNSUBSCRIBE
+        if (length < 2) {
+            return false;
+        }
+        std::vector<uint8_t> ack(body,body+2);
+        size_t pos = 2;
+        while (pos + 2 <= length) {
+            size_t tl = (body[pos]<<8) + body[pos+1];
+            pos += 2;
+            if (pos + tl > length) {
+                return false;
+            }
+            std::string filter((const char*)body+pos,tl);
+            pos += tl;
+            if (type == 0x80) {
+                if (pos >= length) {
+                    return false;
+                }
+                uint8_t qos = body[pos++];
+                conn.filters.push_back(filter);
+                // Everything is delivered at QoS 0
+                ack.push_back(qos > 1 ? 0x80 : 0x00);
+            } else {
+                for (size_t f = 0; f < conn.filters.size(); f++) {
+                    if (conn.filters[f] == filter) {
+                        conn.filters.erase(conn.filters.begin()+f);
+                        break;
+                    }
+                }
+            }
+        }
+        sendPacket(conn.fd,(type == 0x80) ? 0x90 : 0xB0,ack.data(),ack.size());
+    } else if (type == 0xC0) {
+        sendPacket(conn.fd,0xD0,NULL,0);
+    } else if (type == 0xE0) {
+        return false;
+    }
+    return true;
+}
+
+void LoopbackBroker::serve() {
+    signal(SIGTERM,SIG_DFL);
+    std::vector<Connection> connections;
+    uint8_t buf[4096];
+    while (true) {
+        std::vector<struct pollfd> fds(connections.size()+1);
+        fds[0].fd = this->listener;
+        fds[0].events = POLLIN;
+        for (size_t i = 0; i < connections.size(); i++) {
+            fds[i+1].fd = connections[i].fd;
+            fds[i+1].events = POLLIN;
+        }
+        if (poll(fds.data(),fds.size(),-1) < 0) {
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(this->listener,NULL,NULL);
+            if (fd >= 0) {
+                int one = 1;
+                setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+                Connection conn;
+                conn.fd = fd;
+                connections.push_back(conn);
+            }
+        }
+        for (size_t i = connections.size(); i-- > 0; ) {
+            if (i+1 >= fds.size() || !(fds[i+1].revents & (POLLIN|POLLHUP|POLLERR))) {
+                continue;
+            }
+            ssize_t rc = recv(connections[i].fd,buf,sizeof(buf),0);
+            bool open = rc > 0;
+            if (open) {
+                std::vector<uint8_t>& in = connections[i].in;
+                in.insert(in.end(),buf,buf+rc);
+                // Handle every complete packet
+                while (open && in.size() >= 2) {
+                    size_t length = 0;
+                    size_t multiplier = 1;
+                    size_t pos = 1;
+                    bool complete = false;
+                    while (pos < in.size() && pos < 5) {
+                        length += (in[pos] & 127) * multiplier;
+                        multiplier *= 128;
+                        if ((in[pos++] & 128) == 0) {
+                            complete = true;
+                            break;
+                        }
+                    }
+                    if (!complete || in.size() < pos + length) {
+                        open = (pos < 5);
+                        break;
+                    }
+                    std::vector<uint8_t> body(in.begin()+pos,in.begin()+pos+length);
+                    uint8_t header = in[0];
+                    in.erase(in.begin(),in.begin()+pos+length);
+                    open = handle(connections,i,header,body.data(),body.size());
+                }
+            }
+            if (!open) {
+                close(connections[i].fd);
+                connections.erase(connections.begin()+i);
+            }
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef loopbackbroker_h
+#define loopbackbroker_h
+
+#include "Arduino.h"
+#include <sys/types.h>
+
+// A minimal MQTT 3.1.1 server on 127.0.0.1, run in a child process, so the
+// library can be exercised over real sockets without a broker installed.
+// It accepts any CONNECT, answers SUBSCRIBE, UNSUBSCRIBE and PINGREQ,
+// acknowledges QoS 1 PUBLISH, and forwards every PUBLISH at QoS 0 to the
+// connections subscribed to a matching filter. Retained messages, wills and
+// sessions are not supported.
+class LoopbackBroker {
+private:
+    int listener;
+    uint16_t _port;
+    pid_t pid;
+    void serve();
+
+public:
+    LoopbackBroker();
+    ~LoopbackBroker();
+
+    // Listen on an unused port and start serving
+    // Returns 1 if the server started
+    bool start();
+    void stop();
+    uint16_t port();
+
+    // Returns 1 if topic matches the subscription filter
+    static bool matches(const char* filter, const char* topic);
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "PayloadDecoder.h"
+#include "MQTTPayload.h"
+#include <string.h>
+
+PayloadDecoder::PayloadDecoder(const uint8_t* buf, uint16_t length, uint8_t format) {
+    this->buf = buf;
+    this->length = length;
+    this->format = format;
+    this->pos = 0;
+}
+
+bool PayloadDecoder::readLE(uint32_t* value) {
+    if (pos+4 > length) {
+        return false;
+    }
+    *value = buf[pos] | (buf[pos+1] << 8) | (buf[pos+2] << 16) | ((uint32_t)buf[pos+3] << 24);
+    pos += 4;
+    return true;
+}
+
+bool PayloadDecoder::readCBOR(uint8_t* major, uint32_t* value) {
+    if (pos >= length) {
+        return false;
+    }
+    *major = buf[pos] >> 5;
+    uint8_t info = buf[pos++] & 0x1F;
+    uint8_t bytes;
+    if (info < 24) {
+        *value = info;
+        return true;
+    } else if (info == 24) {
+        bytes = 1;
+    } else if (info == 25) {
+        bytes = 2;
+    } else if (info == 26) {
+        bytes = 4;
+    } else {
+        return false;
+    }
+    if (pos+bytes > length) {
+        return false;
+    }
+    *value = 0;
+    for (uint8_t i = 0; i < bytes; i++) {
+        *value = (*value << 8) | buf[pos++];
+    }
+    return true;
+}
+
+bool PayloadDecoder::readSchema(uint16_t* schemaId) {
+    pos = 0;
+    if (format == MQTT_PAYLOAD_CBOR) {
+        if (length < 1 || buf[0] != 0x9F) {
+            return false;
+        }
+        pos = 1;
+        uint8_t major;
+        uint32_t value;
+        if (!readCBOR(&major,&value) || major != 0 || value > 0xFFFF) {
+            return false;
+        }
+        *schemaId = value;
+        return true;
+    }
+    if (length < 2) {
+        return false;
+    }
+    *schemaId = buf[0] | (buf[1] << 8);
+    pos = 2;
+    return true;
+}
+
+bool PayloadDecoder::readFloat(float* value) {
+    uint32_t bits;
+    if (format == MQTT_PAYLOAD_CBOR) {
+        // Only single precision floats are produced by the encoder
+        uint8_t major;
+        if (pos >= length || buf[pos] != 0xFA || !readCBOR(&major,&bits)) {
+            return false;
+        }
+    } else if (!readLE(&bits)) {
+        return false;
+    }
+    memcpy(value,&bits,4);
+    return true;
+}
+
+bool PayloadDecoder::readInt(int32_t* value) {
+    uint32_t bits;
+    if (format == MQTT_PAYLOAD_CBOR) {
+        uint8_t major;
+        if (!readCBOR(&major,&bits)) {
+            return false;
+        }
+        if (major == 1) {
+            *value = -1-(int32_t)bits;
+            return true;
+        }
+        if (major != 0) {
+            return false;
+        }
+    } else if (!readLE(&bits)) {
+        return false;
+    }
+    *value = (int32_t)bits;
+    return true;
+}
+
+bool PayloadDecoder::readUInt(uint32_t* value) {
+    if (format == MQTT_PAYLOAD_CBOR) {
+        uint8_t major;
+        return readCBOR(&major,value) && major == 0;
+    }
+    return readLE(value);
+}
+
+bool PayloadDecoder::done() {
+    if (format == MQTT_PAYLOAD_CBOR) {
+        return pos+1 == length && buf[pos] == 0xFF;
+    }
+    return pos == length;
+}
@@ -0,0 +1,29 @@
+#ifndef payloaddecoder_h
+#define payloaddecoder_h
+
+#include "Arduino.h"
+
+// Host side reader for messages built by MQTTPayload, as a receiving
+// service would decode them. Each read returns false on a malformed or
+// truncated message.
+class PayloadDecoder {
+private:
+    const uint8_t* buf;
+    uint16_t length;
+    uint16_t pos;
+    uint8_t format;
+    bool readLE(uint32_t* value);
+    bool readCBOR(uint8_t* major, uint32_t* value);
+
+public:
+    PayloadDecoder(const uint8_t* buf, uint16_t length, uint8_t format);
+
+    bool readSchema(uint16_t* schemaId);
+    bool readFloat(float* value);
+    bool readInt(int32_t* value);
+    bool readUInt(uint32_t* value);
+    // True once the whole message has been consumed
+    bool done();
+};
+
+#endif
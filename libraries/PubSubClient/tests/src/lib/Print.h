@@ -23,6 +23,7 @@
 class Print {
     public:
         virtual size_t write(uint8_t) = 0;
+        virtual void flush() { }
 };
 
 #endif
@@ -4,20 +4,33 @@
 #include <Arduino.h>
 #include <ctime>
 
+static uint32_t millisOffset = 0;
+
 extern "C" {
     uint32_t millis(void) {
-       return time(0)*1000;
+       return time(0)*1000 + millisOffset;
+    }
+    uint32_t micros(void) {
+       return millis()*1000;
     }
 }
 
+void advanceMillis(uint32_t ms) {
+    millisOffset += ms;
+}
+
 ShimClient::ShimClient() {
     this->responseBuffer = new Buffer();
     this->expectBuffer = new Buffer();
     this->_allowConnect = true;
     this->_connected = false;
     this->_error = false;
+    this->_writeFails = false;
     this->expectAnything = true;
     this->_received = 0;
+    this->_writeCount = 0;
+    this->_availableCount = 0;
+    this->_readCount = 0;
     this->_expectedPort = 0;
 }
 
@@ -55,7 +68,11 @@ int ShimClient::connect(const char *host, uint16_t port)  {
     return this->_connected;
 }
 size_t ShimClient::write(uint8_t b)  {
+    if (this->_writeFails) {
+        return 0;
+    }
     this->_received += 1;
+    this->_writeCount += 1;
     TRACE(std::hex << (unsigned int)b);
     if (!this->expectAnything) {
         if (this->expectBuffer->available()) {
@@ -72,7 +89,11 @@ size_t ShimClient::write(uint8_t b)  {
     return 1;
 }
 size_t ShimClient::write(const uint8_t *buf, size_t size)  {
+    if (this->_writeFails) {
+        return 0;
+    }
     this->_received += size;
+    this->_writeCount += 1;
     TRACE( "[" << std::dec << (unsigned int)(size) << "] ");
     uint16_t i=0;
     for (;i<size;i++) {
@@ -97,15 +118,21 @@ size_t ShimClient::write(const uint8_t *buf, size_t size)  {
     return size;
 }
 int ShimClient::available()  {
+    this->_availableCount += 1;
     return this->responseBuffer->available();
 }
-int ShimClient::read()  { return this->responseBuffer->next(); }
+int ShimClient::read()  {
+    this->_readCount += 1;
+    return this->responseBuffer->next();
+}
 int ShimClient::read(uint8_t *buf, size_t size) {
-    uint16_t i = 0;
-    for (;i<size;i++) {
-        buf[i] = this->read();
+    this->_readCount += 1;
+    // Like a network client, only returns what has arrived
+    size_t i = 0;
+    for (;i<size && this->responseBuffer->available();i++) {
+        buf[i] = this->responseBuffer->next();
     }
-    return size;
+    return i;
 }
 int ShimClient::peek()  { return 0; }
 void ShimClient::flush() {}
@@ -130,6 +157,9 @@ ShimClient* ShimClient::expect(uint8_t *buf, size_t size) {
 void ShimClient::setConnected(bool b) {
     this->_connected = b;
 }
+void ShimClient::setWriteFails(bool b) {
+    this->_writeFails = b;
+}
 void ShimClient::setAllowConnect(bool b) {
     this->_allowConnect = b;
 }
@@ -142,6 +172,18 @@ uint16_t ShimClient::received() {
     return this->_received;
 }
 
+uint16_t ShimClient::writeCount() {
+    return this->_writeCount;
+}
+
+uint32_t ShimClient::availableCount() {
+    return this->_availableCount;
+}
+
+uint32_t ShimClient::readCount() {
+    return this->_readCount;
+}
+
 void ShimClient::expectConnect(IPAddress ip, uint16_t port) {
     this->_expectedIP = ip;
     this->_expectedPort = port;
@@ -6,6 +6,8 @@
 #include "IPAddress.h"
 #include "Buffer.h"
 
+// Moves the shim clock forward, so timeouts can be tested without sleeping
+void advanceMillis(uint32_t ms);
 
 class ShimClient : public Client {
 private:
@@ -15,7 +17,11 @@ private:
     bool _connected;
     bool expectAnything;
     bool _error;
+    bool _writeFails;
     uint16_t _received;
+    uint16_t _writeCount;
+    uint32_t _availableCount;
+    uint32_t _readCount;
     IPAddress _expectedIP;
     uint16_t _expectedPort;
     const char* _expectedHost;
@@ -42,10 +48,16 @@ public:
   virtual void expectConnect(const char *host, uint16_t port);
   
   virtual uint16_t received();
+  virtual uint16_t writeCount();
+  // Number of calls to available() and to either read()
+  virtual uint32_t availableCount();
+  virtual uint32_t readCount();
   virtual bool error();
   
   virtual void setAllowConnect(bool b);
   virtual void setConnected(bool b);
+  // Make writes send nothing and return 0, as on a closed socket
+  virtual void setWriteFails(bool b);
 };
 
 #endif
@@ -0,0 +1,130 @@
+#include "SocketClient.h"
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <stdio.h>
+
+SocketClient::SocketClient() {
+    this->fd = -1;
+    this->closed = true;
+}
+
+SocketClient::~SocketClient() {
+    stop();
+}
+
+int SocketClient::connect(IPAddress ip, uint16_t port) {
+    char host[16];
+    snprintf(host,sizeof(host),"%d.%d.%d.%d",ip[0],ip[1],ip[2],ip[3]);
+    return connect(host,port);
+}
+
+int SocketClient::connect(const char *host, uint16_t port) {
+    stop();
+    struct addrinfo hints;
+    struct addrinfo* result;
+    char service[6];
+    memset(&hints,0,sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service,sizeof(service),"%u",port);
+    if (getaddrinfo(host,service,&hints,&result) != 0) {
+        return 0;
+    }
+    this->fd = socket(AF_INET,SOCK_STREAM,0);
+    if (this->fd >= 0 && ::connect(this->fd,result->ai_addr,result->ai_addrlen) == 0) {
+        // The library writes whole packets, so do not hold them back
+        int one = 1;
+        setsockopt(this->fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+        this->closed = false;
+    } else {
+        stop();
+    }
+    freeaddrinfo(result);
+    return connected();
+}
+
+size_t SocketClient::write(uint8_t b) {
+    return write(&b,1);
+}
+
+size_t SocketClient::write(const uint8_t *buf, size_t size) {
+    size_t sent = 0;
+    while (!this->closed && sent < size) {
+        ssize_t rc = send(this->fd,buf+sent,size-sent,MSG_NOSIGNAL);
+        if (rc <= 0) {
+            this->closed = true;
+            break;
+        }
+        sent += rc;
+    }
+    return sent;
+}
+
+int SocketClient::available() {
+    if (this->closed) {
+        return 0;
+    }
+    int count = 0;
+    if (ioctl(this->fd,FIONREAD,&count) < 0) {
+        this->closed = true;
+        return 0;
+    }
+    if (count == 0) {
+        // Notice the server closing the connection
+        uint8_t b;
+        if (recv(this->fd,&b,1,MSG_PEEK|MSG_DONTWAIT) == 0) {
+            this->closed = true;
+        }
+    }
+    return count;
+}
+
+int SocketClient::read() {
+    uint8_t b;
+    if (read(&b,1) != 1) {
+        return -1;
+    }
+    return b;
+}
+
+int SocketClient::read(uint8_t *buf, size_t size) {
+    if (this->closed) {
+        return -1;
+    }
+    ssize_t rc = recv(this->fd,buf,size,MSG_DONTWAIT);
+    if (rc == 0) {
+        this->closed = true;
+    }
+    return (rc > 0) ? rc : -1;
+}
+
+int SocketClient::peek() {
+    uint8_t b;
+    if (this->closed || recv(this->fd,&b,1,MSG_PEEK|MSG_DONTWAIT) != 1) {
+        return -1;
+    }
+    return b;
+}
+
+void SocketClient::flush() {
+}
+
+void SocketClient::stop() {
+    if (this->fd >= 0) {
+        close(this->fd);
+    }
+    this->fd = -1;
+    this->closed = true;
+}
+
+uint8_t SocketClient::connected() {
+    return !this->closed;
+}
+
+SocketClient::operator bool() {
+    return this->fd >= 0;
+}
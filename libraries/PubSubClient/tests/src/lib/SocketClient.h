@@ -0,0 +1,32 @@
+#ifndef socketclient_h
+#define socketclient_h
+
+#include "Arduino.h"
+#include "Client.h"
+#include "IPAddress.h"
+
+// A Client over a real TCP socket, for running the library against a
+// server on the host, such as LoopbackBroker
+class SocketClient : public Client {
+private:
+    int fd;
+    bool closed;
+
+public:
+    SocketClient();
+    virtual ~SocketClient();
+    virtual int connect(IPAddress ip, uint16_t port);
+    virtual int connect(const char *host, uint16_t port);
+    virtual size_t write(uint8_t);
+    virtual size_t write(const uint8_t *buf, size_t size);
+    virtual int available();
+    virtual int read();
+    virtual int read(uint8_t *buf, size_t size);
+    virtual int peek();
+    virtual void flush();
+    virtual void stop();
+    virtual uint8_t connected();
+    virtual operator bool();
+};
+
+#endif
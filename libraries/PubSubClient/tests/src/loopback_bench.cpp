@@ -0,0 +1,142 @@
+#include "PubSubClient.h"
+#include "SocketClient.h"
+#include "LoopbackBroker.h"
+#include "trace.h"
+#include <stdio.h>
+#include <chrono>
+#include <algorithm>
+
+// Runs the library over real sockets against LoopbackBroker: publish and
+// receive round trips, then a stream of publishes, reporting throughput,
+// the time per operation and the heap allocations made while running.
+// Allocations are counted by wrapping the glibc malloc.
+
+#define CYCLES 10000
+#define PAYLOAD 32
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static bool counting = false;
+static unsigned long allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    return __libc_calloc(count,size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    return __libc_realloc(ptr,size);
+}
+
+static unsigned long received = 0;
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    received++;
+}
+
+double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs loop() until count messages have arrived, or a second has passed
+bool wait_for(PubSubClient& client, unsigned long count) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (received < count) {
+        if (!client.loop() || elapsed_ns(start) > 1e9) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void report(const char* name, double* ns, int count, double total) {
+    std::sort(ns,ns+count);
+    double sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += ns[i];
+    }
+    LOG(" - " << name << ": " << (int)(count/(total/1e9)) << " per second, "
+        << (int)(sum/count/1000) << "/" << (int)(ns[count/2]/1000) << "/"
+        << (int)(ns[count*99/100]/1000) << "/" << (int)(ns[count-1]/1000)
+        << " us mean/p50/p99/max, " << allocations << " allocations\n");
+}
+
+int main()
+{
+    LOG("Loopback benchmark (" << CYCLES << " cycles, " << PAYLOAD << " byte payload)\n");
+    LoopbackBroker broker;
+    if (!broker.start()) {
+        LOG(" - could not start the broker\n");
+        return 1;
+    }
+
+    SocketClient socketClient;
+    PubSubClient client(IPAddress(127,0,0,1), broker.port(), callback, socketClient);
+    if (!client.connect("bench")) {
+        LOG(" - could not connect, state " << client.state() << "\n");
+        return 1;
+    }
+    client.subscribe("bench/#");
+    while (client.getSubscribeResult(0) == MQTT_SUBACK_PENDING) {
+        client.loop();
+    }
+
+    uint8_t payload[PAYLOAD];
+    memset(payload,'A',sizeof(payload));
+    static double ns[CYCLES];
+
+    // Publish a message and wait for it to come back
+    allocations = 0;
+    counting = true;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < CYCLES; i++) {
+        std::chrono::steady_clock::time_point op = std::chrono::steady_clock::now();
+        client.publish("bench/rtt",payload,sizeof(payload));
+        if (!wait_for(client,received+1)) {
+            counting = false;
+            LOG(" - round trip " << i << " failed, state " << client.state() << "\n");
+            return 1;
+        }
+        ns[i] = elapsed_ns(op);
+    }
+    double total = elapsed_ns(start);
+    counting = false;
+    report("publish and receive",ns,CYCLES,total);
+
+    // Publish without waiting, then collect what comes back
+    unsigned long before = received;
+    allocations = 0;
+    counting = true;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < CYCLES; i++) {
+        std::chrono::steady_clock::time_point op = std::chrono::steady_clock::now();
+        client.publish("bench/stream",payload,sizeof(payload));
+        client.loop();
+        ns[i] = elapsed_ns(op);
+    }
+    bool complete = wait_for(client,before+CYCLES);
+    total = elapsed_ns(start);
+    counting = false;
+    report("publish and loop",ns,CYCLES,total);
+    if (!complete) {
+        LOG(" - only " << received-before << " of " << CYCLES << " messages came back\n");
+    }
+
+    client.disconnect();
+    broker.stop();
+    return 0;
+}
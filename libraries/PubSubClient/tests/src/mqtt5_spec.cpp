@@ -0,0 +1,430 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+// Built with -DMQTT_VERSION=5, see the Makefile
+
+byte server[] = { 172, 16, 0, 2 };
+
+bool callback_called = false;
+char lastTopic[64];
+char lastPayload[64];
+unsigned int lastLength;
+
+void reset_callback() {
+    callback_called = false;
+    lastTopic[0] = '\0';
+    lastPayload[0] = '\0';
+    lastLength = 0;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+    strcpy(lastTopic,topic);
+    memcpy(lastPayload,payload,length);
+    lastLength = length;
+}
+
+// One telemetry cycle of sketch_PZEM04
+const char t0[] PROGMEM = "version";
+const char t1[] PROGMEM = "mac";
+const char t2[] PROGMEM = "ip";
+const char t3[] PROGMEM = "uptime";
+const char t4[] PROGMEM = "v1";
+const char t5[] PROGMEM = "i1";
+const char t6[] PROGMEM = "p1";
+const char t7[] PROGMEM = "e1";
+const char t8[] PROGMEM = "v2";
+const char t9[] PROGMEM = "i2";
+const char t10[] PROGMEM = "p2";
+const char t11[] PROGMEM = "e2";
+const char t12[] PROGMEM = "v3";
+const char t13[] PROGMEM = "i3";
+const char t14[] PROGMEM = "p3";
+const char t15[] PROGMEM = "e3";
+const char t16[] PROGMEM = "v4";
+const char t17[] PROGMEM = "i4";
+const char t18[] PROGMEM = "p4";
+const char t19[] PROGMEM = "e4";
+const char t20[] PROGMEM = "value";
+const char* const topics[] PROGMEM = {
+    t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19, t20
+};
+const char* payloads[] = {
+    "PZEM04_UIPE_MQTT_5.1", "f4-16-3e-12-c8-90", "192.168.17.90", "86400",
+    "229.8", "3.2", "712.4", "123456",
+    "231.1", "0.4", "80.0", "45678",
+    "228.5", "12.7", "2890.3", "987654",
+    "229.8", "16.3", "3682.7", "1156788",
+    "1156788"
+};
+#define TOPIC_COUNT 21
+
+// CONNECT for "client_test1", with a Maximum Packet Size of 128
+byte connect[] = {0x10,0x1e,0x0,0x4,0x4d,0x51,0x54,0x54,0x5,0x2,0x0,0xf,0x5,0x27,0x0,0x0,0x0,0x80,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+// CONNACK allowing 32 topic aliases
+byte connack[] = { 0x20,0x06,0x00,0x00,0x03,0x22,0x00,0x20 };
+
+int test_mqtt5_connect() {
+    IT("connects with MQTT 5 properties");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    shimClient.expect(connect,sizeof(connect));
+    shimClient.respond(connack,sizeof(connack));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECTED);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_connect_refused() {
+    IT("reports the CONNACK reason code of a refused connection");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte refused[] = { 0x20,0x03,0x00,0x87,0x00 };
+    shimClient.respond(refused,sizeof(refused));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == 0x87);
+
+    END_IT
+}
+
+int test_mqtt5_publish() {
+    IT("publishes with an empty properties field");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,sizeof(connack));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xf,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,sizeof(publish));
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+
+    byte publishQos1[] = {0x32,0x11,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publishQos1,sizeof(publishQos1));
+    rc = client.publish((char*)"topic",(char*)"payload",1,false);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_topic_alias() {
+    IT("sends table topics by alias after the first publish");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,sizeof(connack));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    client.setTopicPrefix("amega-01/").setTopicTable(topics,TOPIC_COUNT);
+
+    // "amega-01/e3" with alias 16
+    byte first[] = {0x30,0x17,0x0,0xb,0x61,0x6d,0x65,0x67,0x61,0x2d,0x30,0x31,0x2f,0x65,0x33,0x3,0x23,0x0,0x10,0x39,0x38,0x37,0x36,0x35,0x34};
+    shimClient.expect(first,sizeof(first));
+    rc = client.publishTopic(15,"987654");
+    IS_TRUE(rc);
+
+    byte second[] = {0x30,0xc,0x0,0x0,0x3,0x23,0x0,0x10,0x39,0x38,0x37,0x36,0x35,0x35};
+    shimClient.expect(second,sizeof(second));
+    rc = client.publishTopic(15,"987655");
+    IS_TRUE(rc);
+
+    // A new prefix changes what the aliases stand for
+    client.setTopicPrefix("amega-02/");
+    byte renamed[] = {0x30,0x17,0x0,0xb,0x61,0x6d,0x65,0x67,0x61,0x2d,0x30,0x32,0x2f,0x65,0x33,0x3,0x23,0x0,0x10,0x39,0x38,0x37,0x36,0x35,0x35};
+    shimClient.expect(renamed,sizeof(renamed));
+    rc = client.publishTopic(15,"987655");
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_topic_alias_maximum() {
+    IT("only uses aliases the server allows");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack2[] = { 0x20,0x06,0x00,0x00,0x03,0x22,0x00,0x02 };
+    shimClient.respond(connack2,sizeof(connack2));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    client.setTopicTable(topics,TOPIC_COUNT);
+
+    byte aliased[] = {0x30,0xe,0x0,0x3,0x6d,0x61,0x63,0x3,0x23,0x0,0x2,0x31,0x2e,0x32,0x33,0x34};
+    shimClient.expect(aliased,sizeof(aliased));
+    rc = client.publishTopic(1,"1.234");
+    IS_TRUE(rc);
+
+    byte plain[] = {0x30,0xc,0x0,0x6,0x75,0x70,0x74,0x69,0x6d,0x65,0x0,0x31,0x32,0x33};
+    shimClient.expect(plain,sizeof(plain));
+    rc = client.publishTopic(3,"123");
+    IS_TRUE(rc);
+    shimClient.expect(plain,sizeof(plain));
+    rc = client.publishTopic(3,"123");
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_subscribe() {
+    IT("subscribes and reads SUBACK reason codes after the properties");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,sizeof(connack));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    const char* filters[] = { "a", "b" };
+    byte subscribe[] = {0x82,0xb,0x0,0x2,0x0,0x0,0x1,0x61,0x0,0x0,0x1,0x62,0x0};
+    shimClient.expect(subscribe,sizeof(subscribe));
+    rc = client.subscribe(filters,NULL,2);
+    IS_TRUE(rc);
+
+    // A reason string property, then the codes
+    byte suback[] = {0x90,0x9,0x0,0x2,0x4,0x1f,0x0,0x1,0x78,0x0,0x87};
+    shimClient.respond(suback,sizeof(suback));
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(client.getSubscribeResult(0) == 0);
+    IS_TRUE(client.getSubscribeResult(1) == 0x87);
+
+    byte unsubscribe[] = {0xa2,0x6,0x0,0x3,0x0,0x0,0x1,0x61};
+    shimClient.expect(unsubscribe,sizeof(unsubscribe));
+    rc = client.unsubscribe("a");
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_receive() {
+    IT("skips the properties of a received message");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,sizeof(connack));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Payload format indicator property
+    byte publish[] = {0x30,0x11,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x2,0x1,0x1,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,sizeof(publish));
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic") == 0);
+    IS_TRUE(lastLength == 7);
+    IS_TRUE(memcmp(lastPayload,"payload",7) == 0);
+
+    reset_callback();
+    byte publishQos1[] = {0x32,0x11,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publishQos1,sizeof(publishQos1));
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(lastLength == 7);
+    IS_TRUE(memcmp(lastPayload,"payload",7) == 0);
+
+    // A properties length past the end of the buffer drops the message
+    reset_callback();
+    byte malformed[] = {0x30,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0xff,0x7f,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(malformed,sizeof(malformed));
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+uint32_t streamLength;
+unsigned int streamReceived;
+
+void onBegin(char* topic, uint32_t length) {
+    strcpy(lastTopic,topic);
+    streamLength = length;
+    streamReceived = 0;
+}
+
+void onData(uint8_t* data, unsigned int length) {
+    memcpy(lastPayload+streamReceived,data,length);
+    streamReceived += length;
+}
+
+void onEnd(boolean complete) {
+    callback_called = complete;
+}
+
+int test_mqtt5_stream_receive() {
+    IT("skips the properties of a streamed message");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,sizeof(connack));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setMessageCallbacks(onBegin,onData,onEnd);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0x11,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x2,0x1,0x1,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,sizeof(publish));
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic") == 0);
+    IS_TRUE(streamLength == 7);
+    IS_TRUE(streamReceived == 7);
+    IS_TRUE(memcmp(lastPayload,"payload",7) == 0);
+
+    END_IT
+}
+
+int test_mqtt5_server_disconnect() {
+    IT("closes the connection when the server disconnects");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,sizeof(connack));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte disconnect[] = {0xe0,0x1,0x8e};
+    shimClient.respond(disconnect,sizeof(disconnect));
+    rc = client.loop();
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == MQTT_CONNECTION_LOST);
+    IS_FALSE(client.connected());
+
+    END_IT
+}
+
+// Size of a QoS 0 PUBLISH under MQTT 3.1.1
+unsigned int mqtt311_size(const char* topic, const char* payload) {
+    unsigned int length = 2 + strlen(topic) + strlen(payload);
+    return 1 + (length < 128 ? 1 : 2) + length;
+}
+
+int test_mqtt5_cycle_bytes() {
+    IT("sends a PZEM telemetry cycle in fewer bytes than 3.1.1");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,sizeof(connack));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    client.setTopicPrefix("amega-01/").setTopicTable(topics,TOPIC_COUNT);
+
+    unsigned int mqtt311 = 0;
+    char topic[32];
+    for (int i = 0; i < TOPIC_COUNT; i++) {
+        strcpy(topic,"amega-01/");
+        strcat(topic,topics[i]);
+        mqtt311 += mqtt311_size(topic,payloads[i]);
+    }
+
+    uint16_t start = shimClient.received();
+    for (int i = 0; i < TOPIC_COUNT; i++) {
+        IS_TRUE(client.publishTopic(i,payloads[i]));
+    }
+    unsigned int firstCycle = shimClient.received() - start;
+
+    start = shimClient.received();
+    for (int i = 0; i < TOPIC_COUNT; i++) {
+        IS_TRUE(client.publishTopic(i,payloads[i]));
+    }
+    unsigned int nextCycle = shimClient.received() - start;
+
+    LOG("[3.1.1 " << mqtt311 << " bytes, 5 " << firstCycle << " then " << nextCycle << " bytes] ");
+    // The first cycle pays 4 bytes a message to set up the aliases
+    IS_TRUE(firstCycle == mqtt311 + 4*TOPIC_COUNT);
+    IS_TRUE(nextCycle < mqtt311);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_mqtt5_server_keep_alive() {
+    IT("uses the Server Keep Alive of the CONNACK");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    byte connack2[] = { 0x20,0x06,0x00,0x00,0x03,0x13,0x00,0x3c };
+    shimClient.respond(connack2,sizeof(connack2));
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Asked for 15 seconds, but the server wants 60
+    uint16_t sent = shimClient.received();
+    for (int i = 0; i < 58; i++) {
+        advanceMillis(1000);
+        rc = client.loop();
+    }
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.received() == sent);
+
+    byte pingreq[] = { 0xC0,0x0 };
+    shimClient.expect(pingreq,2);
+    for (int i = 0; i < 4; i++) {
+        advanceMillis(1000);
+        rc = client.loop();
+    }
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.received() == sent+2);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("MQTT 5");
+    test_mqtt5_connect();
+    test_mqtt5_connect_refused();
+    test_mqtt5_publish();
+    test_mqtt5_topic_alias();
+    test_mqtt5_topic_alias_maximum();
+    test_mqtt5_subscribe();
+    test_mqtt5_receive();
+    test_mqtt5_stream_receive();
+    test_mqtt5_server_disconnect();
+    test_mqtt5_cycle_bytes();
+    test_mqtt5_server_keep_alive();
+
+    FINISH
+}
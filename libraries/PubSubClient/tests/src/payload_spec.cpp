@@ -0,0 +1,238 @@
+#include "PubSubClient.h"
+#include "MQTTPayload.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "PayloadDecoder.h"
+#include "BDDTest.h"
+#include "trace.h"
+#include <stdio.h>
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+#define SCHEMA_PZEM 1
+
+// One measurement cycle of four PZEM-004T meters
+struct Readings {
+    uint32_t uptime;
+    float v[4];
+    float i[4];
+    float p[4];
+    float e[4];
+};
+
+Readings sample() {
+    Readings r;
+    r.uptime = 86400;
+    for (int n = 0; n < 4; n++) {
+        r.v[n] = 229.5+n;
+        r.i[n] = 1.25*n;
+        r.p[n] = 287.0*n;
+        r.e[n] = 12345.0+n;
+    }
+    return r;
+}
+
+void encode(MQTTPayload& payload, Readings& r) {
+    payload.begin(SCHEMA_PZEM);
+    payload.addUInt(r.uptime);
+    for (int n = 0; n < 4; n++) {
+        payload.addFloat(r.v[n]);
+        payload.addFloat(r.i[n]);
+        payload.addFloat(r.p[n]);
+        payload.addFloat(r.e[n]);
+    }
+}
+
+bool decode(PayloadDecoder& decoder, Readings& r) {
+    uint16_t schemaId;
+    if (!decoder.readSchema(&schemaId) || schemaId != SCHEMA_PZEM) {
+        return false;
+    }
+    if (!decoder.readUInt(&r.uptime)) {
+        return false;
+    }
+    for (int n = 0; n < 4; n++) {
+        if (!decoder.readFloat(&r.v[n]) || !decoder.readFloat(&r.i[n]) ||
+            !decoder.readFloat(&r.p[n]) || !decoder.readFloat(&r.e[n])) {
+            return false;
+        }
+    }
+    return decoder.done();
+}
+
+bool same(Readings& a, Readings& b) {
+    return memcmp(&a,&b,sizeof(Readings)) == 0;
+}
+
+int test_packed_round_trip() {
+    IT("encodes a packed cycle that decodes to the same readings");
+    uint8_t buf[128];
+    MQTTPayload payload(buf,sizeof(buf),MQTT_PAYLOAD_PACKED);
+    Readings r = sample();
+    encode(payload,r);
+    IS_TRUE(payload.end());
+    IS_TRUE(payload.length() == 2+17*4);
+    IS_TRUE(buf[0] == SCHEMA_PZEM);
+    IS_TRUE(buf[1] == 0);
+    // uptime, little-endian
+    IS_TRUE(buf[2] == 0x80 && buf[3] == 0x51 && buf[4] == 0x01 && buf[5] == 0x00);
+
+    PayloadDecoder decoder(payload.data(),payload.length(),MQTT_PAYLOAD_PACKED);
+    Readings d;
+    IS_TRUE(decode(decoder,d));
+    IS_TRUE(same(r,d));
+
+    END_IT
+}
+
+int test_cbor_round_trip() {
+    IT("encodes a CBOR cycle that decodes to the same readings");
+    uint8_t buf[128];
+    MQTTPayload payload(buf,sizeof(buf),MQTT_PAYLOAD_CBOR);
+    Readings r = sample();
+    encode(payload,r);
+    IS_TRUE(payload.end());
+    // array start, schema, uptime (1+4), 16 floats (1+4), break
+    IS_TRUE(payload.length() == 1+1+5+16*5+1);
+
+    PayloadDecoder decoder(payload.data(),payload.length(),MQTT_PAYLOAD_CBOR);
+    Readings d;
+    IS_TRUE(decode(decoder,d));
+    IS_TRUE(same(r,d));
+
+    END_IT
+}
+
+int test_cbor_encoding() {
+    IT("uses the shortest CBOR encoding for each value");
+    uint8_t buf[32];
+    MQTTPayload payload(buf,sizeof(buf),MQTT_PAYLOAD_CBOR);
+    payload.begin(300);
+    payload.addUInt(10);
+    payload.addUInt(200);
+    payload.addInt(-500);
+    payload.addFloat(1.5);
+    IS_TRUE(payload.end());
+
+    uint8_t expected[] = { 0x9F, 0x19,0x01,0x2C, 0x0A, 0x18,0xC8, 0x39,0x01,0xF3, 0xFA,0x3F,0xC0,0x00,0x00, 0xFF };
+    IS_TRUE(payload.length() == sizeof(expected));
+    IS_TRUE(memcmp(buf,expected,sizeof(expected)) == 0);
+
+    PayloadDecoder decoder(payload.data(),payload.length(),MQTT_PAYLOAD_CBOR);
+    uint16_t schemaId;
+    uint32_t u;
+    int32_t s;
+    float f;
+    IS_TRUE(decoder.readSchema(&schemaId));
+    IS_TRUE(schemaId == 300);
+    IS_TRUE(decoder.readUInt(&u));
+    IS_TRUE(u == 10);
+    IS_TRUE(decoder.readUInt(&u));
+    IS_TRUE(u == 200);
+    IS_TRUE(decoder.readInt(&s));
+    IS_TRUE(s == -500);
+    IS_TRUE(decoder.readFloat(&f));
+    IS_TRUE(f == 1.5);
+    IS_TRUE(decoder.done());
+
+    END_IT
+}
+
+int test_overflow() {
+    IT("reports a message that does not fit the buffer");
+    uint8_t buf[16];
+    MQTTPayload payload(buf,sizeof(buf),MQTT_PAYLOAD_PACKED);
+    Readings r = sample();
+    encode(payload,r);
+    IS_FALSE(payload.end());
+    IS_TRUE(payload.length() == sizeof(buf));
+
+    // The buffer can be reused for a smaller message
+    payload.begin(2);
+    payload.addInt(-1);
+    IS_TRUE(payload.end());
+    IS_TRUE(payload.length() == 6);
+    IS_TRUE(buf[2] == 0xFF && buf[5] == 0xFF);
+
+    END_IT
+}
+
+int test_truncated() {
+    IT("rejects a truncated message when decoding");
+    uint8_t buf[128];
+    MQTTPayload payload(buf,sizeof(buf),MQTT_PAYLOAD_CBOR);
+    Readings r = sample();
+    encode(payload,r);
+    IS_TRUE(payload.end());
+
+    PayloadDecoder decoder(payload.data(),payload.length()-3,MQTT_PAYLOAD_CBOR);
+    Readings d;
+    IS_FALSE(decode(decoder,d));
+
+    END_IT
+}
+
+int test_single_publish() {
+    IT("sends a cycle as one publish instead of a topic per value");
+    Readings r = sample();
+    char topic[32];
+    char value[16];
+
+    ShimClient textClient;
+    textClient.setAllowConnect(true);
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    textClient.respond(connack,4);
+    PubSubClient text(server, 1883, callback, textClient);
+    IS_TRUE(text.connect((char*)"client_test1"));
+    uint16_t start = textClient.received();
+    const char* names = "vipe";
+    sprintf(value,"%lu",(unsigned long)r.uptime);
+    IS_TRUE(text.publish("client_test1/uptime",value));
+    for (int n = 0; n < 4; n++) {
+        float* values[] = { r.v, r.i, r.p, r.e };
+        for (int k = 0; k < 4; k++) {
+            sprintf(topic,"client_test1/%c%d",names[k],n+1);
+            sprintf(value,"%.1f",values[k][n]);
+            IS_TRUE(text.publish(topic,value));
+        }
+    }
+    uint16_t textBytes = textClient.received()-start;
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+    PubSubClient client(server, 1883, callback, shimClient);
+    IS_TRUE(client.connect((char*)"client_test1"));
+    start = shimClient.received();
+    uint8_t buf[128];
+    MQTTPayload payload(buf,sizeof(buf),MQTT_PAYLOAD_PACKED);
+    encode(payload,r);
+    IS_TRUE(payload.end());
+    IS_TRUE(client.publish("client_test1/pzem",payload.data(),payload.length()));
+    uint16_t packedBytes = shimClient.received()-start;
+
+    // Fixed header, topic and payload of the single message
+    IS_TRUE(packedBytes == 2+2+17+payload.length());
+    IS_TRUE(packedBytes < textBytes);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Payload");
+    test_packed_round_trip();
+    test_cbor_round_trip();
+    test_cbor_encoding();
+    test_overflow();
+    test_truncated();
+    test_single_publish();
+
+    FINISH
+}
@@ -175,6 +175,275 @@ int test_publish_P() {
 
 
 
+int test_publish_P_chunked() {
+    IT("publishes PROGMEM payloads in chunks");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint8_t payload[100];
+    memset(payload,'A',sizeof(payload));
+
+    uint16_t writes = shimClient.writeCount();
+    uint16_t received = shimClient.received();
+    rc = client.publish_P((char*)"topic",payload,100,false);
+    IS_TRUE(rc);
+    // The header then 100 bytes in chunks of MQTT_PROGMEM_CHUNK_SIZE
+    IS_TRUE(shimClient.received() - received == 109);
+    IS_TRUE(shimClient.writeCount() - writes == 1 + 4);
+
+    // With a write buffer the whole packet goes in one write
+    uint8_t writeBuffer[128];
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    writes = shimClient.writeCount();
+    rc = client.publish_P((char*)"topic",payload,100,false);
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.writeCount() - writes == 1);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_P_long() {
+    IT("publishes a PROGMEM payload with a two byte remaining length");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint8_t payload[200];
+    memset(payload,'A',sizeof(payload));
+
+    // 2+5 topic + 200 payload is 207, sent as 0xcf 0x01
+    byte publish[210] = {0x30,0xcf,0x1,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    memset(publish+10,'A',200);
+    shimClient.expect(publish,210);
+
+    rc = client.publish_P((char*)"topic",payload,200,false);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_beginPublish_P() {
+    IT("streams a publish with a PROGMEM topic and payload");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    static const char topic[] PROGMEM = "topic";
+    static const uint8_t payload[] PROGMEM = { 0x01,0x02,0x03,0x0,0x05 };
+    byte publish[] = {0x31,0xc,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x1,0x2,0x3,0x0,0x5};
+    shimClient.expect(publish,14);
+
+    rc = client.beginPublish_P(topic,5,true);
+    IS_TRUE(rc);
+    IS_TRUE(client.writeP(payload,5) == 5);
+    rc = client.endPublish();
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_streamed() {
+    IT("streams a 1KB publish with one client write per byte");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint16_t writes = shimClient.writeCount();
+    uint16_t received = shimClient.received();
+    rc = client.beginPublish((char*)"topic",1024,false);
+    IS_TRUE(rc);
+    for (int i = 0; i < 1024; i++) {
+        client.write((uint8_t)'A');
+    }
+    rc = client.endPublish();
+    IS_TRUE(rc);
+
+    // 1 byte header + 2 bytes length + 2+5 topic + 1024 payload
+    IS_TRUE(shimClient.received() - received == 1034);
+    IS_TRUE(shimClient.writeCount() - writes == 1 + 1024);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_streamed_write_buffer() {
+    IT("coalesces a streamed 1KB publish through the write buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    uint8_t writeBuffer[128];
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+
+    uint16_t writes = shimClient.writeCount();
+    uint16_t received = shimClient.received();
+    rc = client.beginPublish((char*)"topic",1024,false);
+    IS_TRUE(rc);
+    for (int i = 0; i < 1024; i++) {
+        client.write((uint8_t)'A');
+    }
+    // 8 full buffers so far, the last 10 bytes wait for endPublish
+    IS_TRUE(shimClient.writeCount() - writes == 8);
+    rc = client.endPublish();
+    IS_TRUE(rc);
+
+    IS_TRUE(shimClient.received() - received == 1034);
+    IS_TRUE(shimClient.writeCount() - writes == 9);
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_write_buffer_order() {
+    IT("sends buffered bytes before any other packet");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    uint8_t writeBuffer[64];
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+
+    byte streamed[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte publish[] = {0x30,0xc,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x1,0x2,0x3,0x0,0x5};
+    shimClient.expect(streamed,16);
+    shimClient.expect(publish,14);
+
+    rc = client.beginPublish((char*)"topic",7,false);
+    IS_TRUE(rc);
+    client.write((const uint8_t*)"payload",7);
+    uint16_t writes = shimClient.writeCount();
+    byte payload[] = { 0x01,0x02,0x03,0x0,0x05 };
+    rc = client.publish((char*)"topic",payload,5);
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.writeCount() - writes == 2);
+    IS_FALSE(shimClient.error());
+
+    // Writes larger than the buffer go straight through
+    uint8_t large[100];
+    memset(large,'A',sizeof(large));
+    rc = client.beginPublish((char*)"topic",100,false);
+    IS_TRUE(rc);
+    writes = shimClient.writeCount();
+    IS_TRUE(client.write(large,100) == 100);
+    IS_TRUE(shimClient.writeCount() - writes == 2);
+    IS_TRUE(client.endPublish());
+
+    END_IT
+}
+
+int test_publish_write_buffer_control() {
+    IT("sends buffered bytes before pings and the disconnect");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    uint8_t writeBuffer[64];
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+
+    byte streamed[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte pingreq[] = {0xc0,0x0};
+    byte disconnect[] = {0xe0,0x0};
+    shimClient.expect(streamed,16);
+    shimClient.expect(pingreq,2);
+    shimClient.expect(disconnect,2);
+
+    rc = client.beginPublish((char*)"topic",7,false);
+    IS_TRUE(rc);
+    client.write((const uint8_t*)"payload",7);
+    advanceMillis((MQTT_KEEPALIVE+1)*1000UL);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.received() - 26 == 18);
+    IS_TRUE(client.endPublish());
+
+    client.disconnect();
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_streamed_write_fails() {
+    IT("reports a failed streamed write from endPublish");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Straight to the client
+    rc = client.beginPublish((char*)"topic",7,false);
+    IS_TRUE(rc);
+    shimClient.setWriteFails(true);
+    IS_TRUE(client.write((const uint8_t*)"payload",7) == 0);
+    IS_FALSE(client.endPublish());
+
+    // The failure is only reported once
+    shimClient.setWriteFails(false);
+    rc = client.beginPublish((char*)"topic",7,false);
+    IS_TRUE(rc);
+    client.write((const uint8_t*)"payload",7);
+    IS_TRUE(client.endPublish());
+
+    // Through the write buffer, found when it is flushed
+    uint8_t writeBuffer[64];
+    client.setWriteBuffer(writeBuffer,sizeof(writeBuffer));
+    rc = client.beginPublish((char*)"topic",7,false);
+    IS_TRUE(rc);
+    IS_TRUE(client.write((const uint8_t*)"payload",7) == 7);
+    shimClient.setWriteFails(true);
+    IS_FALSE(client.endPublish());
+
+    END_IT
+}
+
 int main()
 {
     SUITE("Publish");
@@ -185,6 +454,14 @@ int main()
     test_publish_not_connected();
     test_publish_too_long();
     test_publish_P();
+    test_publish_P_chunked();
+    test_publish_P_long();
+    test_publish_beginPublish_P();
+    test_publish_streamed();
+    test_publish_streamed_write_buffer();
+    test_publish_write_buffer_order();
+    test_publish_write_buffer_control();
+    test_publish_streamed_write_fails();
 
     FINISH
 }
@@ -0,0 +1,80 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "trace.h"
+
+// Counts the available() and read() calls made to receive one packet.
+// "per byte" replays the former readPacket(), which polled available()
+// and called read() for every byte, against the current bulk read.
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+// The shim holds at most 1024 bytes of responses
+#define PACKETS 8
+
+// The former receive path: the available() check in loop(), then one
+// available() and one read() per byte
+void read_per_byte(ShimClient& shimClient) {
+    while (shimClient.available()) {
+        shimClient.read();
+    }
+}
+
+void report(const char* name, ShimClient& shimClient, uint32_t available, uint32_t reads) {
+    LOG("   - " << name << ": " << (double)(shimClient.availableCount()-available)/PACKETS << " available(), "
+        << (double)(shimClient.readCount()-reads)/PACKETS << " read() per packet\n");
+}
+
+void bench(const char* name, uint8_t* packet, uint16_t size) {
+    LOG(" - " << name << " (" << size << " bytes)\n");
+    {
+        ShimClient shimClient;
+        uint32_t available = shimClient.availableCount();
+        uint32_t reads = shimClient.readCount();
+        for (int i = 0; i < PACKETS; i++) {
+            shimClient.respond(packet,size);
+            read_per_byte(shimClient);
+        }
+        report("per byte", shimClient, available, reads);
+    }
+    {
+        ShimClient shimClient;
+        shimClient.setAllowConnect(true);
+        byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+        shimClient.respond(connack,4);
+        PubSubClient client(server, 1883, callback, shimClient);
+        client.connect((char*)"client_test1");
+        uint32_t available = shimClient.availableCount();
+        uint32_t reads = shimClient.readCount();
+        for (int i = 0; i < PACKETS; i++) {
+            shimClient.respond(packet,size);
+            client.loop();
+        }
+        report("bulk", shimClient, available, reads);
+    }
+}
+
+int main()
+{
+    LOG("Receive benchmark\n");
+
+    // rmc-01/relay05 = 1
+    byte relay[] = {0x30,0x11,0x0,0xe,0x72,0x6d,0x63,0x2d,0x30,0x31,0x2f,0x72,0x65,0x6c,0x61,0x79,0x30,0x35,0x31};
+    bench("relay command", relay, sizeof(relay));
+
+    byte large[2+7+100] = {0x30,7+100,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    memset(large+9,'A',100);
+    bench("100 byte payload", large, sizeof(large));
+
+    byte suback[] = { 0x90,0x3,0x0,0x2,0x0 };
+    bench("SUBACK", suback, sizeof(suback));
+
+    byte pingresp[] = { 0xd0,0x0 };
+    bench("PINGRESP", pingresp, sizeof(pingresp));
+
+    return 0;
+}
@@ -106,8 +106,8 @@ int test_receive_max_sized_message() {
     IS_TRUE(rc);
 
     int length = MQTT_MAX_PACKET_SIZE;
-    byte publish[] = {0x30,length-2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
-    byte bigPublish[length];
+    byte publish[] = {0x30,(byte)(length-2),0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte bigPublish[length+1];
     memset(bigPublish,'A',length);
     bigPublish[length] = 'B';
     memcpy(bigPublish,publish,16);
@@ -142,8 +142,8 @@ int test_receive_oversized_message() {
     IS_TRUE(rc);
 
     int length = MQTT_MAX_PACKET_SIZE+1;
-    byte publish[] = {0x30,length-2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
-    byte bigPublish[length];
+    byte publish[] = {0x30,(byte)(length-2),0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte bigPublish[length+1];
     memset(bigPublish,'A',length);
     bigPublish[length] = 'B';
     memcpy(bigPublish,publish,16);
@@ -206,9 +206,9 @@ int test_receive_oversized_stream_message() {
     IS_TRUE(rc);
 
     int length = MQTT_MAX_PACKET_SIZE+1;
-    byte publish[] = {0x30,length-2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    byte publish[] = {0x30,(byte)(length-2),0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
 
-    byte bigPublish[length];
+    byte bigPublish[length+1];
     memset(bigPublish,'A',length);
     bigPublish[length] = 'B';
     memcpy(bigPublish,publish,16);
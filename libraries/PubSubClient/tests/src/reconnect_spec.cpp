@@ -0,0 +1,227 @@
+#include "PubSubClient.h"
+#include "MQTTReconnect.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+
+// Runs loop() every 100 simulated milliseconds for ms milliseconds, and
+// records the time of each connection attempt it starts in attemptAt.
+// Returns the number of attempts.
+int run(PubSubClient& client, unsigned long ms, unsigned long* attemptAt) {
+    int attempts = 0;
+    unsigned long start = millis();
+    while (millis() - start < ms) {
+        advanceMillis(100);
+        int before = client.state();
+        client.loop();
+        if (client.state() == MQTT_CONNECT_PENDING && before != MQTT_CONNECT_PENDING) {
+            if (attemptAt) {
+                attemptAt[attempts] = millis() - start;
+            }
+            attempts++;
+        }
+    }
+    return attempts;
+}
+
+int test_reconnect_backoff() {
+    IT("backs off exponentially while the server is down");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(false);
+
+    MQTTReconnect policy(10000, 80000, 0, 0);
+    policy.setConnect("client_test1");
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setReconnect(policy);
+
+    // The first attempt is immediate, then waits of 10, 20, 40, 80 and 80 seconds
+    unsigned long attemptAt[16];
+    int attempts = run(client, 240000, attemptAt);
+    IS_TRUE(attempts == 6);
+    unsigned long expected[] = { 0, 10000, 20000, 40000, 80000, 80000 };
+    unsigned long last = 0;
+    for (int i = 0; i < 6 && i < attempts; i++) {
+        unsigned long wait = attemptAt[i] - last;
+        // The shim clock also follows the real time
+        IS_TRUE(wait >= expected[i] && wait <= expected[i] + 1300);
+        last = attemptAt[i];
+    }
+    IS_TRUE(policy.getAttempts() == 6);
+    IS_FALSE(client.connected());
+
+    END_IT
+}
+
+int test_reconnect_jitter() {
+    IT("randomises part of each wait by the seed");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(false);
+
+    MQTTReconnect policy1(10000, 80000, 50, 0);
+    policy1.setConnect("client_test1").setSeed(0x12345678);
+    MQTTReconnect policy2(10000, 80000, 50, 0);
+    policy2.setConnect("client_test1").setSeed(0x9abcdef0);
+    PubSubClient client1(server, 1883, callback, shimClient);
+    client1.setReconnect(policy1);
+    PubSubClient client2(server, 1883, callback, shimClient);
+    client2.setReconnect(policy2);
+
+    boolean differ = false;
+    for (int i = 0; i < 4; i++) {
+        uint32_t base = 10000UL << i;
+        // Start an attempt each, fail it, and then see it counted
+        for (int j = 0; j < 3; j++) {
+            advanceMillis(100000);
+            client1.loop();
+            client2.loop();
+        }
+        IS_TRUE(policy1.getAttempts() == i+1);
+        IS_TRUE(policy2.getAttempts() == i+1);
+        IS_TRUE(policy1.getDelay() <= base && policy1.getDelay() >= base/2);
+        IS_TRUE(policy2.getDelay() <= base && policy2.getDelay() >= base/2);
+        if (policy1.getDelay() != policy2.getDelay()) {
+            differ = true;
+        }
+    }
+    IS_TRUE(differ);
+
+    END_IT
+}
+
+int test_reconnect_clock_seed() {
+    IT("seeds itself from the clock without setSeed()");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(false);
+
+    MQTTReconnect policy1(10000, 80000, 50, 0);
+    policy1.setConnect("client_test1");
+    MQTTReconnect policy2(10000, 80000, 50, 0);
+    policy2.setConnect("client_test1");
+    PubSubClient client1(server, 1883, callback, shimClient);
+    client1.setReconnect(policy1);
+    PubSubClient client2(server, 1883, callback, shimClient);
+    client2.setReconnect(policy2);
+
+    // The same policy failing a few milliseconds apart
+    boolean differ = false;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 3; j++) {
+            advanceMillis(100000);
+            client1.loop();
+            advanceMillis(3);
+            client2.loop();
+        }
+        IS_TRUE(policy1.getAttempts() == i+1);
+        IS_TRUE(policy2.getAttempts() == i+1);
+        if (policy1.getDelay() != policy2.getDelay()) {
+            differ = true;
+        }
+    }
+    IS_TRUE(differ);
+
+    END_IT
+}
+
+int test_reconnect_max_attempts() {
+    IT("gives up after the maximum number of attempts");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(false);
+
+    MQTTReconnect policy(1000, 4000, 0, 3);
+    policy.setConnect("client_test1");
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setReconnect(policy);
+
+    IS_TRUE(run(client, 60000, NULL) == 3);
+    IS_TRUE(policy.exhausted());
+
+    // reset() starts over, and a connection clears the count
+    policy.reset();
+    IS_FALSE(policy.exhausted());
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+    IS_TRUE(run(client, 1000, NULL) == 1);
+    IS_TRUE(client.connected());
+    IS_TRUE(policy.getAttempts() == 0);
+
+    END_IT
+}
+
+int test_reconnect_resubscribes() {
+    IT("connects and subscribes to the topics from loop()");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    const char* topics[] = { "topic", "other" };
+    uint8_t qos[] = { 0, 1 };
+    MQTTReconnect policy(10000, 80000, 0, 0);
+    policy.setConnect("client_test1").setSubscriptions(topics, qos, 2);
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setReconnect(policy);
+
+    byte subscribe[] = { 0x82,0x12,0x0,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x0,0x5,0x6f,0x74,0x68,0x65,0x72,0x1 };
+    shimClient.respond(connack,4);
+    shimClient.expect(connect,sizeof(connect));
+    shimClient.expect(subscribe,sizeof(subscribe));
+    IS_TRUE(run(client, 1000, NULL) == 1);
+    IS_TRUE(client.connected());
+    IS_FALSE(shimClient.error());
+
+    // Losing the connection waits the minimum delay before trying again
+    shimClient.setConnected(false);
+    shimClient.respond(connack,4);
+    shimClient.expect(connect,sizeof(connect));
+    shimClient.expect(subscribe,sizeof(subscribe));
+    unsigned long attemptAt[4];
+    IS_TRUE(run(client, 15000, attemptAt) == 1);
+    IS_TRUE(attemptAt[0] >= 10000 && attemptAt[0] <= 11300);
+    IS_TRUE(client.connected());
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_reconnect_stops_on_disconnect() {
+    IT("stops reconnecting after disconnect()");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    MQTTReconnect policy(1000, 1000, 0, 0);
+    policy.setConnect("client_test1");
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setReconnect(policy);
+
+    shimClient.respond(connack,4);
+    IS_TRUE(run(client, 1000, NULL) == 1);
+    IS_TRUE(client.connected());
+
+    client.disconnect();
+    IS_TRUE(run(client, 10000, NULL) == 0);
+    IS_FALSE(client.connected());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Reconnect");
+    test_reconnect_backoff();
+    test_reconnect_jitter();
+    test_reconnect_clock_seed();
+    test_reconnect_max_attempts();
+    test_reconnect_resubscribes();
+    test_reconnect_stops_on_disconnect();
+
+    FINISH
+}
@@ -0,0 +1,228 @@
+#include "PubSubClient.h"
+#include "MQTTReport.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+const char voltage[] PROGMEM = "voltage";
+const char current[] PROGMEM = "current";
+const char* const topics[] PROGMEM = { voltage, current };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+
+int test_report_deadband() {
+    IT("publishes only values that move by the deadband");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopicTable(topics,2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTReportEntry entries[2];
+    MQTTReport report(client,entries,2);
+    report.setDeadband(0,5,1);
+
+    // "voltage" "230.1"
+    byte publish1[] = {0x30,0xe,0x0,0x7,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x32,0x33,0x30,0x2e,0x31};
+    shimClient.expect(publish1,16);
+    rc = report.report(0,(int32_t)2301);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    uint16_t received = shimClient.received();
+    IS_FALSE(report.report(0,(int32_t)2301));
+    IS_FALSE(report.report(0,(int32_t)2305));
+    IS_FALSE(report.report(0,(int32_t)2297));
+    IS_TRUE(shimClient.received() == received);
+
+    // "voltage" "230.6"
+    byte publish2[] = {0x30,0xe,0x0,0x7,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x32,0x33,0x30,0x2e,0x36};
+    shimClient.expect(publish2,16);
+    rc = report.report(0,(int32_t)2306);
+    IS_TRUE(rc);
+    IS_FALSE(shimClient.error());
+
+    // Measured from the last value sent, not the last offered
+    IS_FALSE(report.report(0,(int32_t)2302));
+    IS_TRUE(report.report(0,(int32_t)2301));
+
+    END_IT
+}
+
+int test_report_silence() {
+    IT("repeats an unchanged value after the max silence");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopicTable(topics,2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTReportEntry entries[2];
+    MQTTReport report(client,entries,2);
+    report.setDeadband(1,10,2).setMaxSilence(60);
+
+    IS_TRUE(report.report(1,(int32_t)150));
+    advanceMillis(30000);
+    IS_FALSE(report.report(1,(int32_t)150));
+    // The shim clock also follows the real time
+    advanceMillis(31500);
+    IS_TRUE(report.report(1,(int32_t)150));
+    IS_FALSE(report.report(1,(int32_t)150));
+
+    END_IT
+}
+
+int test_report_format() {
+    IT("formats fixed point and float values");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopicTable(topics,2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTReportEntry entries[2];
+    MQTTReport report(client,entries,2);
+    report.setDeadband(1,0,2);
+
+    // "current" "0.05"
+    byte publish1[] = {0x30,0xd,0x0,0x7,0x63,0x75,0x72,0x72,0x65,0x6e,0x74,0x30,0x2e,0x30,0x35};
+    shimClient.expect(publish1,15);
+    IS_TRUE(report.report(1,(int32_t)5));
+    IS_FALSE(shimClient.error());
+
+    // "current" "-1.25", rounded from the float
+    byte publish2[] = {0x30,0xe,0x0,0x7,0x63,0x75,0x72,0x72,0x65,0x6e,0x74,0x2d,0x31,0x2e,0x32,0x35};
+    shimClient.expect(publish2,16);
+    IS_TRUE(report.report(1,-1.2481f));
+    IS_FALSE(shimClient.error());
+
+    // No decimals, "voltage" "-7"
+    byte publish3[] = {0x30,0xb,0x0,0x7,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x2d,0x37};
+    shimClient.expect(publish3,13);
+    IS_TRUE(report.report(0,(int32_t)-7));
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_report_types() {
+    IT("takes int, long and float values alike");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopicTable(topics,2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTReportEntry entries[2];
+    MQTTReport report(client,entries,2);
+    report.setDeadband(0,5,1);
+
+    // "voltage" "230.1"
+    byte publish[] = {0x30,0xe,0x0,0x7,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x32,0x33,0x30,0x2e,0x31};
+    shimClient.expect(publish,16);
+    int i = 2301;
+    IS_TRUE(report.report(0,i));
+    IS_FALSE(shimClient.error());
+    IS_FALSE(report.report(0,2302));
+    IS_FALSE(report.report(0,2303L));
+    IS_FALSE(report.report(0,(int16_t)2304));
+    IS_FALSE(report.report(0,230.5f));
+
+    END_IT
+}
+
+int test_report_retry() {
+    IT("retries values that could not be sent");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopicTable(topics,2);
+
+    MQTTReportEntry entries[2];
+    MQTTReport report(client,entries,2);
+    report.setDeadband(0,5,1);
+
+    // Not connected
+    IS_FALSE(report.report(0,(int32_t)2301));
+    IS_FALSE(report.report(2,(int32_t)2301));
+
+    shimClient.respond(connack,4);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(report.report(0,(int32_t)2301));
+    IS_FALSE(report.report(0,(int32_t)2301));
+
+    report.resend();
+    IS_TRUE(report.report(0,(int32_t)2301));
+
+    END_IT
+}
+
+int test_report_traffic() {
+    IT("cuts the messages of steady readings by an order of magnitude");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopicTable(topics,2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    MQTTReportEntry entries[2];
+    MQTTReport report(client,entries,2);
+    report.setDeadband(0,10,1).setDeadband(1,5,2).setMaxSilence(900);
+
+    // An hour of readings every 10 seconds, wandering within the deadbands,
+    // with one step change in the voltage
+    int offered = 0;
+    int published = 0;
+    for (int i = 0; i < 360; i++) {
+        advanceMillis(10000);
+        int32_t v = 2301 + (i % 7) - 3 + (i >= 180 ? 40 : 0);
+        int32_t a = 150 + (i % 5) - 2;
+        published += report.report(0,v);
+        published += report.report(1,a);
+        offered += 2;
+    }
+    // The first of each, the step, and a repeat every 15 minutes or so
+    IS_TRUE(published <= 12);
+    IS_TRUE(published * 10 <= offered);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Report");
+
+    test_report_deadband();
+    test_report_silence();
+    test_report_format();
+    test_report_types();
+    test_report_retry();
+    test_report_traffic();
+
+    FINISH
+}
@@ -0,0 +1,77 @@
+#include "PubSubClient.h"
+#include "MQTTRouter.h"
+#include "trace.h"
+#include <stdio.h>
+#include <chrono>
+
+// Compares the per-message cost of the sketch_RMC mqtt_callback pattern,
+// which formats and compares every candidate topic, against MQTTRouter
+// with 64 subscriptions.
+
+#define ROUTES 64
+#define MESSAGES 100000
+
+const char* client_id = "rmc-01";
+char filters[ROUTES][32];
+int values[ROUTES];
+
+void handler(char* topic, uint8_t* payload, unsigned int length, void* context) {
+    *(int*)context = payload[0];
+}
+
+// The linear scan of the sketches, without the String allocations
+void linear_callback(char* topic, uint8_t* payload, unsigned int length) {
+    char msgParam[100];
+    for (int i = 0; i < ROUTES; i++) {
+        sprintf(msgParam,"%s/%s%02d",client_id,"relay",i+1);
+        if (strcmp(msgParam,topic) == 0) {
+            values[i] = payload[0];
+        }
+    }
+}
+
+double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    LOG("Router benchmark (" << ROUTES << " subscriptions)\n");
+    for (int i = 0; i < ROUTES; i++) {
+        sprintf(filters[i],"%s/%s%02d",client_id,"relay",i+1);
+    }
+    char topics[ROUTES][32];
+    memcpy(topics,filters,sizeof(topics));
+    uint8_t payload[] = { '1' };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int m = 0; m < MESSAGES; m++) {
+        linear_callback(topics[m % ROUTES],payload,1);
+    }
+    LOG(" - linear scan: " << elapsed_ns(start)/MESSAGES << " ns per message\n");
+
+    MQTTRoute routes[ROUTES+1];
+    MQTTRouter router(routes,ROUTES+1);
+    for (int i = 0; i < ROUTES; i++) {
+        router.add(filters[i],handler,&values[i]);
+    }
+    start = std::chrono::steady_clock::now();
+    unsigned long called = 0;
+    for (int m = 0; m < MESSAGES; m++) {
+        called += router.dispatch(topics[m % ROUTES],payload,1);
+    }
+    LOG(" - router: " << elapsed_ns(start)/MESSAGES << " ns per message\n");
+
+    router.add("rmc-01/+/set",handler,&values[0]);
+    start = std::chrono::steady_clock::now();
+    for (int m = 0; m < MESSAGES; m++) {
+        called += router.dispatch(topics[m % ROUTES],payload,1);
+    }
+    LOG(" - router with a wildcard route: " << elapsed_ns(start)/MESSAGES << " ns per message\n");
+
+    if (called != 2*MESSAGES) {
+        LOG("unexpected dispatch count " << called << "\n");
+        return 1;
+    }
+    return 0;
+}
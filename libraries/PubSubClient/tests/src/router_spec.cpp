@@ -0,0 +1,168 @@
+#include "PubSubClient.h"
+#include "MQTTRouter.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+bool callback_called = false;
+char lastTopic[64];
+int handled[4];
+char lastPayload[16];
+
+void reset_callback() {
+    callback_called = false;
+    lastTopic[0] = '\0';
+    lastPayload[0] = '\0';
+    memset(handled,0,sizeof(handled));
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+    strcpy(lastTopic,topic);
+}
+
+void handler(char* topic, uint8_t* payload, unsigned int length, void* context) {
+    handled[*(int*)context]++;
+    memcpy(lastPayload,payload,length);
+    lastPayload[length] = '\0';
+}
+
+int test_router_matches() {
+    IT("matches topic filters with wildcards");
+    IS_TRUE(MQTTRouter::matches("a/b/c","a/b/c"));
+    IS_FALSE(MQTTRouter::matches("a/b/c","a/b/cd"));
+    IS_FALSE(MQTTRouter::matches("a/b/c","a/b"));
+    IS_TRUE(MQTTRouter::matches("a/+/c","a/b/c"));
+    IS_TRUE(MQTTRouter::matches("a/+/c","a//c"));
+    IS_FALSE(MQTTRouter::matches("a/+/c","a/b/d/c"));
+    IS_TRUE(MQTTRouter::matches("a/+","a/b"));
+    IS_FALSE(MQTTRouter::matches("a/+","a"));
+    IS_TRUE(MQTTRouter::matches("+/+","a/b"));
+    IS_TRUE(MQTTRouter::matches("a/#","a/b/c"));
+    IS_TRUE(MQTTRouter::matches("a/#","a"));
+    IS_FALSE(MQTTRouter::matches("a/#","ab"));
+    IS_TRUE(MQTTRouter::matches("#","a/b"));
+    IS_FALSE(MQTTRouter::matches("#","$SYS/uptime"));
+    IS_FALSE(MQTTRouter::matches("+/uptime","$SYS/uptime"));
+    IS_TRUE(MQTTRouter::matches("$SYS/#","$SYS/uptime"));
+    END_IT
+}
+
+int test_router_add() {
+    IT("refuses invalid filters and a full table");
+    MQTTRoute routes[2];
+    MQTTRouter router(routes,2);
+    int ctx = 0;
+    IS_FALSE(router.add("",handler,&ctx));
+    IS_FALSE(router.add("a/#/b",handler,&ctx));
+    IS_FALSE(router.add("a/b#",handler,&ctx));
+    IS_FALSE(router.add("a/+b",handler,&ctx));
+    IS_FALSE(router.add("a/b",NULL,&ctx));
+    IS_TRUE(router.add("a/b",handler,&ctx));
+    IS_TRUE(router.add("a/+",handler,&ctx));
+    IS_FALSE(router.add("a/c",handler,&ctx));
+    IS_TRUE(router.count() == 2);
+    router.clear();
+    IS_TRUE(router.count() == 0);
+    IS_TRUE(router.add("a/c",handler,&ctx));
+    END_IT
+}
+
+int test_router_dispatch() {
+    IT("calls every matching handler");
+    reset_callback();
+    int ctx[] = { 0, 1, 2, 3 };
+    char name[16];
+    // Enough exact routes to share buckets
+    static char filters[32][16];
+    for (int i = 0; i < 32; i++) {
+        sprintf(filters[i],"rm/relay%02d",i+1);
+    }
+    MQTTRoute many[34];
+    MQTTRouter big(many,34);
+    for (int i = 0; i < 32; i++) {
+        IS_TRUE(big.add(filters[i],handler,&ctx[i == 20 ? 1 : 0]));
+    }
+    IS_TRUE(big.add("rm/+",handler,&ctx[2]));
+    IS_TRUE(big.add("other/#",handler,&ctx[3]));
+
+    strcpy(name,"rm/relay21");
+    IS_TRUE(big.dispatch(name,(uint8_t*)"1",1) == 2);
+    IS_TRUE(handled[0] == 0);
+    IS_TRUE(handled[1] == 1);
+    IS_TRUE(handled[2] == 1);
+    IS_TRUE(handled[3] == 0);
+
+    strcpy(name,"rm/relay99");
+    IS_TRUE(big.dispatch(name,(uint8_t*)"1",1) == 1);
+    IS_TRUE(handled[2] == 2);
+
+    strcpy(name,"nothing");
+    IS_TRUE(big.dispatch(name,(uint8_t*)"1",1) == 0);
+    END_IT
+}
+
+int test_router_receive() {
+    IT("routes received messages, passing unmatched ones to the callback");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    MQTTRoute routes[4];
+    MQTTRouter router(routes,4);
+    int ctx = 1;
+    router.add("topic",handler,&ctx);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setRouter(router);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,16);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(handled[1] == 1);
+    IS_TRUE(strcmp(lastPayload,"payload") == 0);
+    IS_FALSE(callback_called);
+
+    // QoS 1 is routed and acknowledged
+    byte publishQos1[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publishQos1,18);
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(handled[1] == 2);
+    IS_FALSE(callback_called);
+
+    byte other[] = {0x30,0xe,0x0,0x5,0x6f,0x74,0x68,0x65,0x72,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(other,16);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(handled[1] == 2);
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"other") == 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Router");
+    test_router_matches();
+    test_router_add();
+    test_router_dispatch();
+    test_router_receive();
+
+    FINISH
+}
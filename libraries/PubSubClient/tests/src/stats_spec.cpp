@@ -0,0 +1,187 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+// Built with MQTT_STATS set to 1, see the Makefile
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+// Takes 5ms of the shim clock
+void slowCallback(char* topic, byte* payload, unsigned int length) {
+  advanceMillis(5);
+}
+
+byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+
+int test_stats_connect() {
+    IT("counts the CONNECT and CONNACK");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    const MQTTStats& stats = client.getStats();
+    IS_TRUE(stats.connects == 1);
+    IS_TRUE(stats.packetsOut[MQTTCONNECT >> 4] == 1);
+    IS_TRUE(stats.bytesOut[MQTTCONNECT >> 4] == 26);
+    IS_TRUE(stats.packetsIn[MQTTCONNACK >> 4] == 1);
+    IS_TRUE(stats.bytesIn[MQTTCONNACK >> 4] == 4);
+
+    END_IT
+}
+
+int test_stats_publish() {
+    IT("counts publishes and publish failures");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    char payload[200];
+    memset(payload,'A',sizeof(payload)-1);
+    payload[sizeof(payload)-1] = 0;
+    rc = client.publish((char*)"topic",payload);
+    IS_FALSE(rc);
+
+    const MQTTStats& stats = client.getStats();
+    IS_TRUE(stats.packetsOut[MQTTPUBLISH >> 4] == 1);
+    IS_TRUE(stats.bytesOut[MQTTPUBLISH >> 4] == 16);
+    IS_TRUE(stats.publishFailures == 1);
+
+    // Each packet of a batch is counted
+    rc = client.beginBatch();
+    IS_TRUE(rc);
+    client.addToBatch((char*)"topic",(char*)"payload");
+    client.addToBatch((char*)"a/b",(char*)"ABC",true);
+    rc = client.endBatch();
+    IS_TRUE(rc);
+    IS_TRUE(stats.packetsOut[MQTTPUBLISH >> 4] == 3);
+    IS_TRUE(stats.bytesOut[MQTTPUBLISH >> 4] == 16+16+10);
+
+    client.disconnect();
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_FALSE(rc);
+    IS_TRUE(stats.publishFailures == 2);
+    IS_TRUE(stats.packetsOut[MQTTDISCONNECT >> 4] == 1);
+
+    END_IT
+}
+
+int test_stats_receive() {
+    IT("counts inbound packets and the replies to them");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,18);
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    const MQTTStats& stats = client.getStats();
+    IS_TRUE(stats.packetsIn[MQTTPUBLISH >> 4] == 1);
+    IS_TRUE(stats.bytesIn[MQTTPUBLISH >> 4] == 18);
+    IS_TRUE(stats.packetsOut[MQTTPUBACK >> 4] == 1);
+    IS_TRUE(stats.bytesOut[MQTTPUBACK >> 4] == 4);
+
+    client.resetStats();
+    IS_TRUE(stats.packetsIn[MQTTPUBLISH >> 4] == 0);
+    IS_TRUE(stats.connects == 0);
+
+    END_IT
+}
+
+int test_stats_ping_rtt() {
+    IT("measures the ping round trip");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    advanceMillis(16000);
+    rc = client.loop();
+    IS_TRUE(rc);
+    const MQTTStats& stats = client.getStats();
+    IS_TRUE(stats.packetsOut[MQTTPINGREQ >> 4] == 1);
+
+    advanceMillis(250);
+    byte pingresp[] = { 0xD0,0x0 };
+    shimClient.respond(pingresp,2);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(stats.packetsIn[MQTTPINGRESP >> 4] == 1);
+    // The shim clock also follows the real time
+    IS_TRUE(stats.pingRtt >= 250 && stats.pingRtt <= 1250);
+    IS_TRUE(stats.pingRttMax == stats.pingRtt);
+
+    END_IT
+}
+
+int test_stats_latency() {
+    IT("records the longest loop() and a histogram of call times");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, slowCallback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,16);
+    rc = client.loop();
+    IS_TRUE(rc);
+    rc = client.loop();
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+
+    const MQTTStats& stats = client.getStats();
+    IS_TRUE(stats.loopMax >= 5000);
+    uint32_t calls = 0;
+    uint32_t slow = 0;
+    for (int i = 0; i < MQTT_STATS_BUCKETS; i++) {
+        calls += stats.latency[i];
+        if (i >= 4) {
+            // 4096 microseconds and up
+            slow += stats.latency[i];
+        }
+    }
+    IS_TRUE(calls == 3);
+    IS_TRUE(slow >= 1);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Stats");
+    test_stats_connect();
+    test_stats_publish();
+    test_stats_receive();
+    test_stats_ping_rtt();
+    test_stats_latency();
+
+    FINISH
+}
@@ -0,0 +1,234 @@
+#include "PubSubClient.h"
+#include "MQTTStore.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+const char* topics[] = { "pzem/voltage", "pzem/current" };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+int drained = 0;
+uint8_t drainedTopic;
+uint32_t drainedAt;
+
+void storeCallback(uint8_t topicId, uint32_t timestamp) {
+    drained++;
+    drainedTopic = topicId;
+    drainedAt = timestamp;
+}
+
+int test_store_fill() {
+    IT("stores and returns records in order");
+    uint8_t ram[64];
+    MQTTRamStorage storage(ram,sizeof(ram));
+    MQTTStore store(storage);
+
+    IS_TRUE(store.empty());
+    IS_TRUE(store.push(0,1000,(const uint8_t*)"230.1",5));
+    IS_TRUE(store.push(1,2000,(const uint8_t*)"1.25",4));
+    IS_TRUE(store.count() == 2);
+    IS_TRUE(store.used() == 2*MQTT_STORE_RECORD_HEADER+9);
+
+    uint8_t topicId;
+    uint32_t timestamp;
+    uint8_t length;
+    uint8_t payload[8];
+    IS_TRUE(store.peek(&topicId,&timestamp,&length));
+    IS_TRUE(topicId == 0);
+    IS_TRUE(timestamp == 1000);
+    IS_TRUE(length == 5);
+    IS_TRUE(store.read(0,payload,sizeof(payload)) == 5);
+    IS_TRUE(memcmp(payload,"230.1",5) == 0);
+    IS_TRUE(store.read(3,payload,sizeof(payload)) == 2);
+    IS_TRUE(memcmp(payload,".1",2) == 0);
+    store.pop();
+
+    IS_TRUE(store.peek(&topicId,&timestamp,&length));
+    IS_TRUE(topicId == 1);
+    IS_TRUE(timestamp == 2000);
+    IS_TRUE(length == 4);
+    store.pop();
+
+    IS_TRUE(store.empty());
+    IS_FALSE(store.peek(&topicId,&timestamp,&length));
+    IS_TRUE(store.dropped() == 0);
+
+    END_IT
+}
+
+int test_store_wrap() {
+    IT("wraps records around the end of the storage");
+    uint8_t ram[32];
+    MQTTRamStorage storage(ram,sizeof(ram));
+    MQTTStore store(storage);
+
+    // 6 + 8 bytes each, so the third wraps
+    IS_TRUE(store.push(0,1,(const uint8_t*)"AAAAAAAA",8));
+    IS_TRUE(store.push(0,2,(const uint8_t*)"BBBBBBBB",8));
+    store.pop();
+    IS_TRUE(store.push(1,0x01020304,(const uint8_t*)"CCCCCCCD",8));
+    IS_TRUE(store.dropped() == 0);
+    store.pop();
+
+    uint8_t topicId;
+    uint32_t timestamp;
+    uint8_t length;
+    uint8_t payload[8];
+    IS_TRUE(store.peek(&topicId,&timestamp,&length));
+    IS_TRUE(topicId == 1);
+    IS_TRUE(timestamp == 0x01020304);
+    IS_TRUE(store.read(0,payload,length) == 8);
+    IS_TRUE(memcmp(payload,"CCCCCCCD",8) == 0);
+
+    END_IT
+}
+
+int test_store_drop_oldest() {
+    IT("drops the oldest records when full");
+    uint8_t ram[32];
+    MQTTRamStorage storage(ram,sizeof(ram));
+    MQTTStore store(storage);
+
+    IS_TRUE(store.push(0,1,(const uint8_t*)"AAAAAAAA",8));
+    IS_TRUE(store.push(0,2,(const uint8_t*)"BBBBBBBB",8));
+    IS_TRUE(store.push(0,3,(const uint8_t*)"CCCCCCCC",8));
+    IS_TRUE(store.count() == 2);
+    IS_TRUE(store.dropped() == 1);
+
+    uint8_t topicId;
+    uint32_t timestamp;
+    uint8_t length;
+    IS_TRUE(store.peek(&topicId,&timestamp,&length));
+    IS_TRUE(timestamp == 2);
+
+    // A record larger than the storage is refused
+    uint8_t big[32];
+    IS_FALSE(store.push(0,4,big,sizeof(big)));
+    IS_TRUE(store.count() == 2);
+
+    END_IT
+}
+
+int test_publish_or_store_connected() {
+    IT("publishes directly when connected and nothing is stored");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    uint8_t ram[64];
+    MQTTRamStorage storage(ram,sizeof(ram));
+    MQTTStore store(storage);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.publishOrStore(0,"230.1");
+    IS_FALSE(rc);
+    client.setStore(store,topics,2);
+    rc = client.publishOrStore(2,"230.1");
+    IS_FALSE(rc);
+
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0x13,0x0,0xc,0x70,0x7a,0x65,0x6d,0x2f,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x32,0x33,0x30,0x2e,0x31};
+    shimClient.expect(publish,21);
+    rc = client.publishOrStore(0,"230.1");
+    IS_TRUE(rc);
+    IS_TRUE(store.empty());
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_or_store_drain() {
+    IT("stores while disconnected and drains at the set rate");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    uint8_t ram[64];
+    MQTTRamStorage storage(ram,sizeof(ram));
+    MQTTStore store(storage);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setStore(store,topics,2).setStoreDrainRate(1,1000).setStoreCallback(storeCallback);
+
+    uint32_t storedAt = millis();
+    int rc = client.publishOrStore(0,"230.1");
+    IS_TRUE(rc);
+    advanceMillis(500);
+    rc = client.publishOrStore(1,"1.25");
+    IS_TRUE(rc);
+    IS_TRUE(store.count() == 2);
+    IS_TRUE(shimClient.received() == 0);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Newer messages queue behind the stored ones
+    rc = client.publishOrStore(0,"230.2");
+    IS_TRUE(rc);
+    IS_TRUE(store.count() == 3);
+
+    byte publish1[] = {0x30,0x13,0x0,0xc,0x70,0x7a,0x65,0x6d,0x2f,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x32,0x33,0x30,0x2e,0x31};
+    shimClient.expect(publish1,21);
+    advanceMillis(1000);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(store.count() == 2);
+    // Told when the message was stored
+    IS_TRUE(drained == 1);
+    IS_TRUE(drainedTopic == 0);
+    IS_TRUE(drainedAt == storedAt);
+
+    // Nothing more until the interval has passed
+    uint16_t received = shimClient.received();
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.received() == received);
+
+    byte publish2[] = {0x30,0x12,0x0,0xc,0x70,0x7a,0x65,0x6d,0x2f,0x63,0x75,0x72,0x72,0x65,0x6e,0x74,0x31,0x2e,0x32,0x35};
+    shimClient.expect(publish2,20);
+    advanceMillis(1000);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(store.count() == 1);
+    IS_TRUE(drained == 2);
+    IS_TRUE(drainedTopic == 1);
+    IS_TRUE(drainedAt == storedAt + 500);
+
+    // A larger drain count sends the rest at once
+    client.setStoreDrainRate(4,1000);
+    byte publish3[] = {0x30,0x13,0x0,0xc,0x70,0x7a,0x65,0x6d,0x2f,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x32,0x33,0x30,0x2e,0x32};
+    shimClient.expect(publish3,21);
+    advanceMillis(1000);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(store.empty());
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Store");
+    test_store_fill();
+    test_store_wrap();
+    test_store_drop_oldest();
+    test_publish_or_store_connected();
+    test_publish_or_store_drain();
+
+    FINISH
+}
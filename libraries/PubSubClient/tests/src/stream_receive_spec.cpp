@@ -0,0 +1,217 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+bool callback_called = false;
+char lastTopic[64];
+uint32_t lastLength;
+uint8_t received[256];
+unsigned int receivedLength;
+int chunks;
+int ends;
+boolean lastComplete;
+
+void reset_callback() {
+    callback_called = false;
+    lastTopic[0] = '\0';
+    lastLength = 0;
+    receivedLength = 0;
+    chunks = 0;
+    ends = 0;
+    lastComplete = false;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+}
+
+void onBegin(char* topic, uint32_t length) {
+    strcpy(lastTopic,topic);
+    lastLength = length;
+}
+
+void onData(uint8_t* data, unsigned int length) {
+    memcpy(received+receivedLength,data,length);
+    receivedLength += length;
+    chunks++;
+}
+
+void onEnd(boolean complete) {
+    ends++;
+    lastComplete = complete;
+}
+
+int test_stream_receive() {
+    IT("delivers the topic then the payload in pieces");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setMessageCallbacks(onBegin,onData,onEnd);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    client.setBufferSize(16);
+
+    // A payload larger than the buffer
+    byte publish[2+7+40] = {0x30,7+40,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    for (int i = 0; i < 40; i++) {
+        publish[9+i] = 'A'+i;
+    }
+    shimClient.respond(publish,sizeof(publish));
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic") == 0);
+    IS_TRUE(lastLength == 40);
+    IS_TRUE(receivedLength == 40);
+    IS_TRUE(memcmp(received,publish+9,40) == 0);
+    IS_TRUE(chunks == 3);
+    IS_TRUE(ends == 1);
+    IS_TRUE(lastComplete);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_stream_receive_qos1() {
+    IT("acknowledges a streamed qos 1 message");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setMessageCallbacks(onBegin,onData,onEnd);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,18);
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(strcmp(lastTopic,"topic") == 0);
+    IS_TRUE(lastLength == 7);
+    IS_TRUE(memcmp(received,"payload",7) == 0);
+    IS_TRUE(ends == 1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_stream_receive_empty() {
+    IT("delivers an empty payload without data");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setMessageCallbacks(onBegin,onData,onEnd);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0x7,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    shimClient.respond(publish,9);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(strcmp(lastTopic,"topic") == 0);
+    IS_TRUE(lastLength == 0);
+    IS_TRUE(chunks == 0);
+    IS_TRUE(ends == 1);
+    IS_TRUE(lastComplete);
+
+    END_IT
+}
+
+int test_stream_receive_long_topic() {
+    IT("skips a message whose topic does not fit in the buffer");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setMessageCallbacks(onBegin,onData,onEnd);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    client.setBufferSize(16);
+
+    byte publish[2+2+20+3] = {0x30,2+20+3,0x0,20};
+    memset(publish+4,'t',20);
+    memcpy(publish+24,"abc",3);
+    shimClient.respond(publish,sizeof(publish));
+    byte next[] = {0x30,0xa,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x61,0x62,0x63};
+    shimClient.respond(next,12);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(ends == 0);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(ends == 1);
+    IS_TRUE(strcmp(lastTopic,"topic") == 0);
+    IS_TRUE(memcmp(received,"abc",3) == 0);
+
+    END_IT
+}
+
+int test_stream_receive_disabled() {
+    IT("returns to the callback when the handlers are cleared");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setMessageCallbacks(onBegin,onData,onEnd);
+    client.setMessageCallbacks(NULL,NULL,NULL);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,16);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(callback_called);
+    IS_TRUE(ends == 0);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Stream Receive");
+    test_stream_receive();
+    test_stream_receive_qos1();
+    test_stream_receive_empty();
+    test_stream_receive_long_topic();
+    test_stream_receive_disabled();
+
+    FINISH
+}
@@ -124,6 +124,81 @@ int test_subscribe_too_long() {
 }
 
 
+int test_subscribe_batch() {
+    IT("subscribes to several filters in one packet");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    const char* topics[] = { "a/b", "c" };
+    uint8_t qos[] = { 0, 1 };
+    byte subscribe[] = { 0x82,0xc,0x0,0x2,0x0,0x3,0x61,0x2f,0x62,0x0,0x0,0x1,0x63,0x1 };
+    shimClient.expect(subscribe,14);
+
+    uint16_t writes = shimClient.writeCount();
+    rc = client.subscribe(topics,qos,2);
+    IS_TRUE(rc);
+    IS_TRUE(shimClient.writeCount() - writes == 1);
+    IS_TRUE(client.getSubscribeResult(0) == MQTT_SUBACK_PENDING);
+    IS_TRUE(client.getSubscribeResult(1) == MQTT_SUBACK_PENDING);
+
+    byte suback[] = { 0x90,0x4,0x0,0x2,0x0,0x80 };
+    shimClient.respond(suback,6);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(client.getSubscribeResult(0) == 0);
+    IS_TRUE(client.getSubscribeResult(1) == MQTT_SUBACK_FAILURE);
+    IS_TRUE(client.getSubscribeResult(2) == MQTT_SUBACK_PENDING);
+
+    // Without qos all filters are subscribed at 0
+    byte subscribe0[] = { 0x82,0xc,0x0,0x3,0x0,0x3,0x61,0x2f,0x62,0x0,0x0,0x1,0x63,0x0 };
+    shimClient.expect(subscribe0,14);
+    rc = client.subscribe(topics,NULL,2);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_subscribe_batch_invalid() {
+    IT("batch subscribe fails with invalid qos or too many filters");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    const char* topics[MQTT_MAX_SUBSCRIBE_BATCH+1];
+    for (int i = 0; i <= MQTT_MAX_SUBSCRIBE_BATCH; i++) {
+        topics[i] = "t";
+    }
+    uint16_t received = shimClient.received();
+    uint8_t qos[] = { 0, 2 };
+    rc = client.subscribe(topics,qos,2);
+    IS_FALSE(rc);
+    rc = client.subscribe(topics,NULL,0);
+    IS_FALSE(rc);
+    rc = client.subscribe(topics,NULL,MQTT_MAX_SUBSCRIBE_BATCH+1);
+    IS_FALSE(rc);
+    rc = client.unsubscribe(topics,MQTT_MAX_SUBSCRIBE_BATCH+1);
+    IS_FALSE(rc);
+
+    IS_TRUE(shimClient.received() == received);
+
+    END_IT
+}
+
 int test_unsubscribe() {
     IT("unsubscribes");
     ShimClient shimClient;
@@ -149,6 +224,32 @@ int test_unsubscribe() {
     END_IT
 }
 
+int test_unsubscribe_batch() {
+    IT("unsubscribes from several filters in one packet");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    const char* topics[] = { "a/b", "c" };
+    byte unsubscribe[] = { 0xA2,0xa,0x0,0x2,0x0,0x3,0x61,0x2f,0x62,0x0,0x1,0x63 };
+    shimClient.expect(unsubscribe,12);
+    byte unsuback[] = { 0xB0,0x2,0x0,0x2 };
+    shimClient.respond(unsuback,4);
+
+    rc = client.unsubscribe(topics,2);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int test_unsubscribe_not_connected() {
     IT("unsubscribe fails when not connected");
     ShimClient shimClient;
@@ -171,7 +272,10 @@ int main()
     test_subscribe_not_connected();
     test_subscribe_invalid_qos();
     test_subscribe_too_long();
+    test_subscribe_batch();
+    test_subscribe_batch_invalid();
     test_unsubscribe();
+    test_unsubscribe_batch();
     test_unsubscribe_not_connected();
     FINISH
 }
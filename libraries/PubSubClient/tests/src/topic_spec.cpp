@@ -0,0 +1,151 @@
+#include "PubSubClient.h"
+#include "MQTTStore.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+const char voltage[] PROGMEM = "voltage";
+const char current[] PROGMEM = "current";
+const char* const topics[] PROGMEM = { voltage, current };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+int test_publish_suffix() {
+    IT("publishes to the prefix followed by a suffix");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    client.setTopicPrefix("amega-01/");
+
+    // "amega-01/voltage"
+    byte publish[] = {0x30,0x17,0x0,0x10,0x61,0x6d,0x65,0x67,0x61,0x2d,0x30,0x31,0x2f,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x32,0x33,0x30,0x2e,0x31};
+    shimClient.expect(publish,25);
+    rc = client.publishSuffix("voltage","230.1");
+    IS_TRUE(rc);
+
+    // Without a prefix the suffix is the whole topic
+    client.setTopicPrefix(NULL);
+    byte retained[] = {0x31,0xe,0x0,0x7,0x76,0x6f,0x6c,0x74,0x61,0x67,0x65,0x32,0x33,0x30,0x2e,0x31};
+    shimClient.expect(retained,16);
+    rc = client.publishSuffix("voltage",(const uint8_t*)"230.1",5,true);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_topic() {
+    IT("publishes to an entry of the topic table");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publishTopic(0,"230.1");
+    IS_FALSE(rc);
+
+    client.setTopicPrefix("amega-01/").setTopicTable(topics,2);
+
+    // "amega-01/current"
+    byte publish[] = {0x30,0x16,0x0,0x10,0x61,0x6d,0x65,0x67,0x61,0x2d,0x30,0x31,0x2f,0x63,0x75,0x72,0x72,0x65,0x6e,0x74,0x31,0x2e,0x32,0x35};
+    shimClient.expect(publish,24);
+    rc = client.publishTopic(1,"1.25");
+    IS_TRUE(rc);
+
+    rc = client.publishTopic(2,"1.25");
+    IS_FALSE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_topic_too_long() {
+    IT("refuses a topic and payload larger than the buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    client.setTopicPrefix("amega-01/").setTopicTable(topics,2);
+    client.setBufferSize(MQTT_MAX_HEADER_SIZE+2+16+4);
+
+    uint16_t received = shimClient.received();
+    rc = client.publishTopic(0,"12345");
+    IS_FALSE(rc);
+    IS_TRUE(shimClient.received() == received);
+    rc = client.publishTopic(0,"1234");
+    IS_TRUE(rc);
+
+    END_IT
+}
+
+int test_store_topic_table() {
+    IT("drains stored messages using the topic table");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    uint8_t ram[64];
+    MQTTRamStorage storage(ram,sizeof(ram));
+    MQTTStore store(storage);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopicPrefix("amega-01/").setTopicTable(topics,2).setStore(store);
+
+    int rc = client.publishOrStore(1,"1.25");
+    IS_TRUE(rc);
+    rc = client.publishOrStore(2,"1.25");
+    IS_FALSE(rc);
+    IS_TRUE(store.count() == 1);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0x16,0x0,0x10,0x61,0x6d,0x65,0x67,0x61,0x2d,0x30,0x31,0x2f,0x63,0x75,0x72,0x72,0x65,0x6e,0x74,0x31,0x2e,0x32,0x35};
+    shimClient.expect(publish,24);
+    advanceMillis(MQTT_STORE_DRAIN_INTERVAL);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(store.empty());
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Topic");
+    test_publish_suffix();
+    test_publish_topic();
+    test_publish_topic_too_long();
+    test_store_topic_table();
+
+    FINISH
+}